@@ -52,6 +52,18 @@ void setup() {
   webConfig.fillConfig(&config);
   webConfig.begin(config.hostname);
   webConfig.setSpiffsReset("/reset");
+
+  // new firmware can be uploaded from the config page (or with
+  // curl -u admin:<OTA password> -F "firmware=@sketch.ino.bin" http://<device>/update)
+  // - the user name is admin and the password is the OTA password of the config
+  webConfig.setFirmwareUpload("/update");
+
+  // show the MQTT round trip times on the info page - the default client can't ping
+  // the broker so a probe goes to a topic of this device once a minute and back
+  static char rttTopic[64];
+  snprintf(rttTopic, sizeof(rttTopic), "/%s/rtt", config.hostname);
+  myESP.enableRTTProbe(60000, rttTopic);
+  webConfig.setStatusSource(&myESP);
 }
 
 
@@ -127,6 +139,8 @@ void startWifi() {
   myESP.OTA_setPassword(config.otaPassword);
   myESP.OTA_setHostnameWithVersion(config.hostname);
   myESP.OTA_enable();
+  // stop the config page while an OTA update is uploading (it comes back if the update fails)
+  myESP.setOTAMaintenance(true, &webConfig);
 
   Serial.println("Connecting to network");  // Serial debug prints
   // connect to Wi-Fi before proceeding.
@@ -0,0 +1,87 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	This is a demo of the built in MQTT client (ESPHelperMQTT) used in place
+	of PubSubClient. It parses incoming messages of up to 2KB in place, streams
+	anything larger to a second callback piece by piece, and publishes at QoS 1.
+*/
+#include "ESPHelper.h"
+
+#define CONFIG_TOPIC "/your/mqtt/config"
+#define BLOB_TOPIC "/your/mqtt/blob"
+#define STATUS_TOPIC "/your/mqtt/status"
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+//built in MQTT client with a 2KB arena for incoming packets
+ESPHelperMQTT mqtt(2048);
+
+void setup() {
+	Serial.begin(115200);
+
+	//uncomment to talk MQTT 5 (topic aliases, flow control) and let the broker
+	//throw away status messages nobody picked up within 5 minutes
+	// mqtt.setProtocolVersion(MQTT_V5);
+	// mqtt.setMessageExpiry(300);
+
+	//use the built in client instead of PubSubClient
+	myESP.setTransport(mqtt);
+
+	myESP.addSubscription(CONFIG_TOPIC);
+	myESP.addSubscription(BLOB_TOPIC);
+	myESP.setMQTTCallback(callback);
+	myESP.setMQTTStreamCallback(streamCallback);
+
+	myESP.begin();
+}
+
+void loop(){
+	myESP.loop();
+	yield();
+}
+
+//messages that fit in the arena (the payload points straight into it)
+void callback(char* topic, uint8_t* payload, unsigned int length) {
+	Serial.print(topic);
+	Serial.print(" - ");
+	Serial.print(length);
+	Serial.println(" bytes");
+
+	//QoS 1 publish (only the built in client can do this)
+	myESP.publish(STATUS_TOPIC, (const uint8_t*)"got it", 6, false, 1);
+}
+
+//messages larger than the arena arrive here one piece at a time
+void streamCallback(char* topic, unsigned int offset, uint8_t* chunk, unsigned int length, unsigned int total) {
+	Serial.print(topic);
+	Serial.print(" - ");
+	Serial.print(offset + length);
+	Serial.print("/");
+	Serial.println(total);
+}
@@ -0,0 +1,94 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	A dimmable light that keeps its state in a device shadow instead of publishing
+	a status string after every command.
+
+	Set the light by publishing (retained) to "/home/light/desired", e.g.
+		{"v":4,"on":true,"level":80}
+	Only the fields that changed are reported back on "/home/light/reported",
+	e.g. {"v":12,"level":80}, and everything is reported after each reconnect.
+	Because the desired document is retained the light comes back in the right
+	state after a reboot, and a repeat of an old "v" is ignored.
+*/
+#include "ESPHelper.h"
+
+#define REPORTED_TOPIC "/home/light/reported"
+#define DESIRED_TOPIC "/home/light/desired"
+
+#define LIGHT_PIN 12
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+int8_t onField;
+int8_t levelField;
+int8_t uptimeField;
+unsigned long lastUptime = 0;
+
+//set the output from the current state
+void updateLight(){
+	ESPHelperShadow* shadow = myESP.getShadow();
+	int level = shadow->getBool(onField) ? shadow->getInt(levelField) : 0;
+	analogWrite(LIGHT_PIN, map(constrain(level, 0, 100), 0, 100, 0, PWMRANGE));
+}
+
+//a desired document changed a field
+void shadowChanged(int8_t field){
+	if(field == onField || field == levelField){
+		updateLight();
+	}
+}
+
+void setup() {
+	Serial.begin(115200);
+	pinMode(LIGHT_PIN, OUTPUT);
+
+	ESPHelperShadow* shadow = myESP.getShadow();
+	onField = shadow->addBool("on", false);
+	levelField = shadow->addInt("level", 100);
+	uptimeField = shadow->addInt("uptime", 0);
+
+	myESP.enableShadow(REPORTED_TOPIC, DESIRED_TOPIC);
+	myESP.setShadowCallback(shadowChanged);
+
+	myESP.begin();
+	updateLight();
+}
+
+void loop(){
+	myESP.loop();
+
+	//changing a field is all it takes to report it
+	if(millis() - lastUptime >= 60000){
+		lastUptime = millis();
+		myESP.getShadow()->setInt(uptimeField, millis() / 60000);
+	}
+
+	yield();
+}
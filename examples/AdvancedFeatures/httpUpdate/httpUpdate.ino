@@ -0,0 +1,77 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Pull firmware updates over HTTP instead of pushing them with ArduinoOTA.
+
+	Publish the URL of an image to "/home/device/update" (optionally followed by a
+	space and the MD5 of the file) and the device downloads it, writes it to flash
+	and reboots into it. How it went is published to "/home/device/otaReport" once the
+	device is connected again.
+
+	Compressed images are much faster to transfer - build the sketch, then
+		gzip -9 -k sketch.ino.bin
+	and serve the .gz file from any machine on the network, e.g.
+		cd build && python3 -m http.server 8000
+	and publish "http://<your-pc>:8000/sketch.ino.bin.gz".
+	python's server ignores Range requests so after a dropped connection the download
+	starts over (the part already written is skipped) - servers like nginx resume it.
+*/
+#include "ESPHelper.h"
+
+#define UPDATE_TOPIC "/home/device/update"
+#define REPORT_TOPIC "/home/device/otaReport"
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+void setup() {
+	Serial.begin(115200);
+
+	myESP.enableHTTPUpdate(UPDATE_TOPIC);
+	myESP.publishOTAReport(REPORT_TOPIC);
+
+	//follow the download on the serial port
+	myESP.setOTACallback([](uint8_t event, const otaReport &report){
+		if(event == OTA_EVENT_PROGRESS){
+			Serial.print(report.received);
+			Serial.print(" / ");
+			Serial.println(report.size);
+		}
+		else if(event == OTA_EVENT_ERROR){
+			Serial.print("update failed: ");
+			Serial.println(report.error);
+		}
+	});
+
+	myESP.begin();
+}
+
+void loop(){
+	myESP.loop();
+	yield();
+}
@@ -0,0 +1,88 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	This is the button demo done with an interrupt instead of polling. Every edge
+	on the button pin is queued from the interrupt handler (with the time it happened)
+	and ESPHelper publishes it on the next loop() - even presses that happen while
+	ESPHelper is reconnecting are published once the connection is back.
+	The time from edge to publish and any lost edges are printed every 10 seconds.
+*/
+#include "ESPHelper.h"
+
+#define TOPIC "/your/mqtt/topic"
+
+#define BUTTON_PIN 0	//button on pin 0 with pull-up resistor (pulled low on press)
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+int8_t buttonEvent;
+unsigned long lastReport = 0;
+
+//runs on every edge of the button pin - keep it short and only queue the event here
+void ICACHE_RAM_ATTR buttonISR(){
+	if(digitalRead(BUTTON_PIN) == LOW){
+		myESP.queueEvent(buttonEvent, "1");
+	}
+	else{
+		myESP.queueEvent(buttonEvent, "0");
+	}
+}
+
+void setup() {
+	Serial.begin(115200);
+
+	//room for 16 edges while the network is busy, button state is retained
+	myESP.enableEvents(16);
+	buttonEvent = myESP.addEventTopic(TOPIC, true);
+
+	myESP.begin();
+
+	pinMode(BUTTON_PIN, INPUT);
+	attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonISR, CHANGE);
+}
+
+void loop(){
+	myESP.loop();
+
+	if(millis() - lastReport >= 10000){
+		lastReport = millis();
+
+		eventStats stats = myESP.getEventStats();
+		Serial.print("events: ");
+		Serial.print(stats.published);
+		Serial.print(" published, ");
+		Serial.print(stats.failed);
+		Serial.print(" failed publishes, ");
+		Serial.print(stats.overflows);
+		Serial.print(" lost, max latency (us): ");
+		Serial.println(stats.maxLatency);
+	}
+
+	yield();
+}
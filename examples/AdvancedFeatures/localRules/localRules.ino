@@ -0,0 +1,65 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	This is a demo of the local rule engine. The rules in data/rules.json (upload them
+	with the ESP8266 Sketch Data Upload tool) make the button on GPIO0 toggle the relay
+	on GPIO12, let "on"/"off" messages switch the relay, and turn a fan on when the
+	temperature gets too high - all on the device, so they keep working when the
+	broker can't be reached.
+*/
+#include "ESPHelper.h"
+
+#define RULES_FILE "/rules.json"
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+void setup() {
+	Serial.begin(115200);
+
+	if(!myESP.loadRules(RULES_FILE)){
+		Serial.println("Could not load the rules");
+	}
+
+	myESP.addSubscription("/home/relay");
+	myESP.addSubscription("/home/temperature");
+	myESP.begin();
+}
+
+void loop(){
+	myESP.loop();
+
+	//print how often each rule fired every 10 seconds
+	static unsigned long lastPrint = 0;
+	if(millis() - lastPrint > 10000){
+		lastPrint = millis();
+		myESP.getRules()->printTo(Serial);
+	}
+
+	yield();
+}
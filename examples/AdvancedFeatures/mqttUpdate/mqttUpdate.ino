@@ -0,0 +1,83 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Receive firmware updates over MQTT - no extra server or open port on the device.
+
+	The image is published in numbered chunks to "/home/device/firmware" and the device
+	answers on "/home/device/firmware/status" with acks, the chunk it needs next when one
+	was lost, and "done" before it reboots into the new firmware. How it went (including
+	the transfer rate and how many chunks had to be sent again) is published to
+	"/home/device/otaReport" once the device is connected again.
+
+	Chunk messages have to fit in the MQTT client's buffer, so this uses the built in
+	client with a 2k arena (512 byte chunks). send_firmware.py in this folder does the
+	sending - to try it against a broker on your own machine:
+		mosquitto -v
+		pip install paho-mqtt
+		python3 send_firmware.py <broker-ip> /home/device/firmware build/mqttUpdate.ino.bin
+	Stop the script half way and run it again - the device tells it where to carry on.
+*/
+#include "ESPHelper.h"
+
+#define FIRMWARE_TOPIC "/home/device/firmware"
+#define STATUS_TOPIC "/home/device/firmware/status"
+#define REPORT_TOPIC "/home/device/otaReport"
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+ESPHelperMQTT mqtt(2048);
+
+void setup() {
+	Serial.begin(115200);
+
+	myESP.setTransport(mqtt);
+	myESP.enableMQTTUpdate(FIRMWARE_TOPIC, STATUS_TOPIC);
+	myESP.publishOTAReport(REPORT_TOPIC);
+
+	//follow the transfer on the serial port
+	myESP.setOTACallback([](uint8_t event, const otaReport &report){
+		if(event == OTA_EVENT_PROGRESS){
+			Serial.print(report.received);
+			Serial.print(" / ");
+			Serial.print(report.size);
+			Serial.print("  resent: ");
+			Serial.println(report.retransmissions);
+		}
+		else if(event == OTA_EVENT_ERROR){
+			Serial.print("update failed: ");
+			Serial.println(report.error);
+		}
+	});
+
+	myESP.begin();
+}
+
+void loop(){
+	myESP.loop();
+	yield();
+}
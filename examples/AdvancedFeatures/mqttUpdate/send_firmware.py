@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+#    Copyright (c) 2018 ItKindaWorks All right reserved.
+#    github.com/ItKindaWorks
+#
+#    This file is part of ESPHelper (GPL v3 or later, see the .ino in this folder)
+#
+# Sends a firmware image to a device running ESPHelper::enableMQTTUpdate().
+#   python3 send_firmware.py <broker> <update topic> <image.bin> [chunk size] [window]
+# The status topic is "<update topic>/status". Chunks are streamed up to [window] ahead
+# of the last ack and the sender rewinds whenever the device reports a missing chunk.
+
+import hashlib
+import struct
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+
+def main():
+    if len(sys.argv) < 4:
+        print("usage: send_firmware.py <broker> <update topic> <image.bin> [chunk size] [window]")
+        sys.exit(1)
+    broker, topic, path = sys.argv[1:4]
+    chunk_size = int(sys.argv[4]) if len(sys.argv) > 4 else 512
+    window = int(sys.argv[5]) if len(sys.argv) > 5 else 16
+
+    image = open(path, "rb").read()
+    chunks = (len(image) + chunk_size - 1) // chunk_size
+    md5 = hashlib.md5(image).hexdigest()
+
+    # acked - window base, everything before it is written
+    # rewind - chunk the device asked for with "missing", until the sender goes back to it
+    state = {"acked": 0, "rewind": None, "result": None}
+    changed = threading.Condition()
+
+    def on_message(client, userdata, msg):
+        words = msg.payload.decode().split()
+        with changed:
+            if words[0] == "ack":
+                state["acked"] = max(state["acked"], int(words[1]))
+            elif words[0] == "missing":
+                state["acked"] = max(state["acked"], int(words[1]))
+                state["rewind"] = int(words[1])
+            else:
+                state["result"] = " ".join(words)
+            changed.notify()
+
+    # paho-mqtt 2 wants the callback version spelled out
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION1)
+    else:
+        client = mqtt.Client()
+    client.on_message = on_message
+    client.connect(broker)
+    client.subscribe(topic + "/status")
+    client.loop_start()
+    time.sleep(0.5)
+
+    start = time.time()
+    client.publish(topic, "B%d %d %s" % (len(image), chunk_size, md5))
+    sent_to = 0
+    resent = 0
+    while state["result"] is None:
+        with changed:
+            # only a request for a missing chunk sends anything again - an ack
+            # just lets the window move on
+            if state["rewind"] is not None:
+                if state["rewind"] < sent_to:
+                    resent += sent_to - state["rewind"]
+                    sent_to = state["rewind"]
+                state["rewind"] = None
+        while sent_to < min(state["acked"] + window, chunks):
+            data = image[sent_to * chunk_size:(sent_to + 1) * chunk_size]
+            client.publish(topic, b"C" + struct.pack(">I", sent_to) + data)
+            sent_to += 1
+        with changed:
+            changed.wait(1.0)
+        print("\r%d / %d chunks" % (state["acked"], chunks), end="", flush=True)
+
+    elapsed = time.time() - start
+    print("\n%s - %d bytes in %.1fs (%.0f bytes/s), %d chunks sent again"
+          % (state["result"], len(image), elapsed, len(image) / elapsed, resent))
+    client.loop_stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,68 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	This is a demo of the MQTT-SN fast path. A vibration reading is sent 100 times a
+	second as a single UDP datagram to an MQTT-SN gateway (e.g. the Eclipse Paho
+	MQTT-SN gateway running next to the broker) while the normal MQTT connection
+	keeps handling everything else. The topic id must be predefined on the gateway.
+*/
+#include "ESPHelper.h"
+
+#define VIBRATION_TOPIC "/your/mqtt/vibration"
+#define VIBRATION_TOPIC_ID 1	//predefined topic id for VIBRATION_TOPIC on the gateway
+#define SAMPLE_INTERVAL 10		//ms between readings
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+unsigned long lastSample = 0;
+
+void setup() {
+	Serial.begin(115200);
+
+	myESP.begin();
+
+	//the gateway runs on the MQTT host here (port 10000) - pass a host and port to use another one.
+	//QoS -1 publishes don't need a gateway connection, pass false as the third argument to skip it
+	myESP.enableMQTTSN();
+	myESP.addMQTTSNTopic(VIBRATION_TOPIC, VIBRATION_TOPIC_ID);
+}
+
+void loop(){
+	myESP.loop();
+
+	if(millis() - lastSample >= SAMPLE_INTERVAL){
+		lastSample = millis();
+
+		int16_t reading = analogRead(A0);
+		//fire and forget (QoS -1)
+		myESP.publishSN(VIBRATION_TOPIC, (const uint8_t*)&reading, sizeof(reading));
+	}
+
+	yield();
+}
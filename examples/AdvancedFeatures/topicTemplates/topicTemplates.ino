@@ -0,0 +1,85 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	A relay whose topics are built from templates instead of Strings. "{device}" in each
+	template is replaced by the OTA hostname once begin() runs, so the same sketch can
+	be flashed to several devices (home/porch/relay, home/garage/relay, ...) and the
+	topics are only ever built once, into a fixed buffer.
+	Send "1" or "0" to home/<hostname>/relay, the state is echoed to home/<hostname>/relay/status.
+*/
+#include "ESPHelper.h"
+
+#define HOSTNAME "porch"
+
+#define RELAY_PIN 12
+
+//the topics - lengths and placeholders are worked out at compile time
+constexpr topicTemplate relayTemplate = makeTopic("home/{device}/relay");
+constexpr topicTemplate statusTemplate = makeTopic("home/{device}/relay/status");
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+int8_t relayTopic;
+int8_t statusTopic;
+
+void callback(char* topic, uint8_t* payload, unsigned int length) {
+	if(length == 0){return;}
+
+	if(payload[0] == '1'){
+		digitalWrite(RELAY_PIN, HIGH);
+		myESP.publishTopic(statusTopic, "1", true);
+	}
+	else if(payload[0] == '0'){
+		digitalWrite(RELAY_PIN, LOW);
+		myESP.publishTopic(statusTopic, "0", true);
+	}
+}
+
+void setup() {
+	Serial.begin(115200);
+	pinMode(RELAY_PIN, OUTPUT);
+
+	myESP.OTA_enable();
+	myESP.OTA_setHostname(HOSTNAME);
+
+	relayTopic = myESP.addTopic(relayTemplate);
+	statusTopic = myESP.addTopic(statusTemplate);
+
+	myESP.begin();
+	myESP.setCallback(callback);
+
+	//the topics are expanded now so they can be subscribed to
+	myESP.subscribeTopic(relayTopic);
+	Serial.println(myESP.getTopic(relayTopic));
+}
+
+void loop(){
+	myESP.loop();
+	yield();
+}
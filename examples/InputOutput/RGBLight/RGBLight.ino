@@ -342,15 +342,19 @@ void callback(char* topic, byte* payload, unsigned int length) {
 	//convert topic to string to make it easier to work with
 	String topicStr = topic; 
 
-	char newPayload[40];
-	memcpy(newPayload, payload, length);
-	newPayload[length] = '\0';
+	if(length == 0){return;}
+
+	//the values after the leading letter are comma separated - read them
+	//straight out of the payload without copying it
+	ESPHelperTokenizer fields(&payload[1], length - 1, ',');
 
 	//handle HSB updates
 	if(payload[0] == 'h'){
-		nextState.hue = atof(&newPayload[1]);
-		nextState.saturation = atof(&newPayload[7]);
-		nextState.brightness = atof(&newPayload[13]);
+		float hue, saturation, brightness;
+		if(!fields.nextFloat(hue) || !fields.nextFloat(saturation) || !fields.nextFloat(brightness)){return;}
+		nextState.hue = hue;
+		nextState.saturation = saturation;
+		nextState.brightness = brightness;
 
 		nextState.updateType = HSB;
 		nextState.fadePeriod = 2100;
@@ -361,9 +365,8 @@ void callback(char* topic, byte* payload, unsigned int length) {
 
 	//handle RGB updates
 	else if (payload[0] == 'r'){
-		int newRed = atoi(&newPayload[1]);
-		int newGreen = atoi(&newPayload[5]);
-		int newBlue = atoi(&newPayload[9]);
+		int32_t newRed, newGreen, newBlue;
+		if(!fields.nextInt(newRed) || !fields.nextInt(newGreen) || !fields.nextInt(newBlue)){return;}
 
 		nextState.red = newRed;
 		nextState.green = newGreen;
@@ -392,7 +395,9 @@ void callback(char* topic, byte* payload, unsigned int length) {
 
 
 	//package up status message reply and send it back out to the status topic
-	strcpy(statusString, newPayload);
+	if(length >= sizeof(statusString)){return;}
+	memcpy(statusString, payload, length);
+	statusString[length] = '\0';
 	myESP.publish(statusTopic, statusString, true);
 }
 
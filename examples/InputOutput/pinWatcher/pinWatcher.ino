@@ -0,0 +1,61 @@
+/*    
+    Copyright (c) 2018 ItKindaWorks All right reserved.
+    github.com/ItKindaWorks
+
+    This file is part of ESPHelper
+
+    ESPHelper is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    ESPHelper is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	This is a demo of the GPIO watcher. ESPHelper samples the pins in the
+	background, debounces them and publishes every change - there is no
+	pin reading or debouncing left in loop().
+	A button on pin 0 publishes "pressed" when it goes low (nothing on release),
+	and a door switch on pin 4 publishes its latest state ("open"/"closed", retained).
+*/
+#include "ESPHelper.h"
+
+#define BUTTON_TOPIC "/your/mqtt/button"
+#define DOOR_TOPIC "/your/mqtt/door"
+
+#define BUTTON_PIN 0	//button on pin 0 (pulled low on press)
+#define DOOR_PIN 4		//reed switch to ground on pin 4
+
+//set this info for your own network
+netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
+					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
+					.mqttPass = "YOUR MQTT PASSWORD", 	//can be blank
+					.mqttPort = 1883,					//default port for MQTT is 1883 - only chance if needed.
+					.ssid = "YOUR SSID", 
+					.pass = "YOUR NETWORK PASS"};
+
+ESPHelper myESP(&homeNet);
+
+void setup() {
+	Serial.begin(115200);
+
+	//button - 30ms debounce, only the press (low) is published
+	myESP.watchPin(BUTTON_PIN, BUTTON_TOPIC, 0, 30, NULL, "pressed");
+
+	//door - internal pull-up, retained, and only the latest state if it bounced around while disconnected
+	myESP.watchPin(DOOR_PIN, DOOR_TOPIC, WATCH_PULLUP | WATCH_COALESCE | WATCH_RETAIN, 100, "open", "closed");
+
+	myESP.begin();
+}
+
+void loop(){
+	myESP.loop();
+	yield();
+}
@@ -22,10 +22,12 @@
 	This is a simple program that periodically (10 seconds) reads a ds18b20 temperature
 	sensor and publishes the result to an MQTT topic. Change the Topic/Hostname/OTA Password 
 	and network settings to match your system.
+	ESPHelper runs the sensor itself: the conversion (up to 750ms) is started and read
+	from ESPHelper's loop() without waiting for it, so MQTT and OTA keep running meanwhile.
 */
 
 #include "ESPHelper.h"
-#include <Metro.h>
+#include "ESPHelperDS18B20.h"
 #include <OneWire.h>
 #include <DallasTemperature.h>
 
@@ -41,17 +43,16 @@ char* hostnameStr = NETWORK_HOSTNAME;
 const int wireBus = ONE_WIRE_BUS;
 const int blinkPin = BLINK_PIN;
 
-
-//the current temperature
-float currentTemp = 0;
-
-//timer to set how often the sensor should publish to mqtt (in ms)
-Metro publishTimer = Metro(10000);
+//how often the sensor should be read and published (in ms)
+const uint32_t publishInterval = 10000;
 
 //ds18b20 variables
 OneWire oneWire(ONE_WIRE_BUS);
 DallasTemperature sensors(&oneWire);
 
+//the first sensor on the bus in C
+ESPHelperDS18B20 tempSensor(sensors, 0);
+
 //set this info for your own network
 netInfo homeNet = {	.mqttHost = "YOUR MQTT-IP",			//can be blank if not using MQTT
 					.mqttUser = "YOUR MQTT USERNAME", 	//can be blank
@@ -75,45 +76,11 @@ void setup() {
 	//start ESPHelper
 	myESP.begin();
 
-	//start the dallas temperature sensor library
-	sensors.begin();
-	delay(500);	
+	//read the temperature every 10 seconds and publish it (1 decimal, retained)
+	myESP.addSensor(tempSensor, tempTopic, publishInterval, 1, true);
 }
 
 void loop(){
-	
-
-	while(1){
-		if(myESP.loop() == FULL_CONNECTION){
-
-			//only read/publish the temperature if the timer is up
-			if(publishTimer.check()){
-
-				sensors.requestTemperatures(); // Send the command to get temperatures
-				currentTemp = sensors.getTempCByIndex(0);	//get the temperature
-
-				//convert the float to a string
-				char temperature[10];
-				dtostrf(currentTemp,4,1,temperature);
-
-				//publish to mqtt
-				myESP.publish(tempTopic,temperature, true);	
-			}
-		}
-
-		yield();
-	}
-	
+	myESP.loop();
+	yield();
 }
-
-
-void callback(char* topic, uint8_t* payload, unsigned int length) {
-
-}
-
-
-
-
-
-
-
@@ -0,0 +1,82 @@
+/*
+Arduino.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Just enough of the Arduino core to build ESPHelperText and the String
+// baseline of textBenchmark.cpp on a PC - not used by the library itself.
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+
+// heap allocated like the core's String (which formats with itoa/dtostrf),
+// counting its allocations
+class String {
+
+  public:
+
+    static unsigned long allocations;
+
+    String(const char* str = "") { copy(str, strlen(str)); }
+    explicit String(int value) { char buf[12]; copy(buf, snprintf(buf, sizeof(buf), "%d", value)); }
+    String(float value, unsigned char decimals) {
+      char buf[33];
+      copy(buf, snprintf(buf, sizeof(buf), "%.*f", decimals, value));
+    }
+    String(const String &other) { copy(other._buf, other._len); }
+    ~String() { free(_buf); }
+
+    String& operator=(const String &other) {
+      if (this != &other) {
+        free(_buf);
+        copy(other._buf, other._len);
+      }
+      return *this;
+    }
+
+    const char* c_str() const { return _buf; }
+    unsigned int length() const { return _len; }
+    long toInt() const { return atol(_buf); }
+    float toFloat() const { return (float)atof(_buf); }
+
+  private:
+
+    void copy(const char* str, size_t length) {
+      _buf = (char*)malloc(length + 1);
+      memcpy(_buf, str, length);
+      _buf[length] = '\0';
+      _len = length;
+      allocations++;
+    }
+
+    char* _buf;
+    unsigned int _len;
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+textBenchmark.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Host benchmark of ESPHelperText / ESPHelperTokenizer against the String,
+// copy-and-atof way the examples used to format and parse payloads.
+// Build and run from this directory with plain g++:
+//   g++ -O2 -std=gnu++11 -I. -I../../src textBenchmark.cpp ../../src/ESPHelperText.cpp -o textBenchmark
+//   ./textBenchmark [iterations]
+// Absolute times are the PC's - the ratios and the heap allocations per operation
+// are what carries over to the ESP8266.
+
+#include <Arduino.h>
+#include <chrono>
+#include "ESPHelperText.h"
+
+unsigned long String::allocations = 0;
+
+#define PAYLOADS 64
+
+static char hsbPayloads[PAYLOADS][20];
+static char rgbPayloads[PAYLOADS][20];
+static char jsonPayloads[PAYLOADS][48];
+
+// results go here so the compiler can't drop the work
+static volatile long sink = 0;
+
+
+// run [op] [iterations] times and print ns per call and heap allocations per call
+template <typename Op>
+static double measure(const char* name, unsigned long iterations, Op op) {
+  unsigned long allocations = String::allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++)
+    op(i);
+  auto end = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+  printf("  %-34s %8.1f ns/op  %5.2f allocs/op\n", name, ns,
+         (double)(String::allocations - allocations) / iterations);
+  return ns;
+}
+
+
+static void compare(double baseline, double helper) {
+  printf("  %-34s %8.2fx\n\n", "speedup", baseline / helper);
+}
+
+
+int main(int argc, char** argv) {
+  unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+  for (int i = 0; i < PAYLOADS; i++) {
+    snprintf(hsbPayloads[i], sizeof(hsbPayloads[i]), "h%.3f,%.3f,%.3f",
+             (i % 100) / 100.0, ((i * 7) % 100) / 100.0, ((i * 13) % 100) / 100.0);
+    snprintf(rgbPayloads[i], sizeof(rgbPayloads[i]), "r%03d,%03d,%03d",
+             (i * 4) % 256, (i * 9) % 256, (i * 17) % 256);
+    snprintf(jsonPayloads[i], sizeof(jsonPayloads[i]), "{\"on\":true,\"level\":%d,\"name\":\"lamp\"}", i * 3);
+  }
+
+  // both sides have to agree before their times mean anything
+  for (int i = 0; i < PAYLOADS; i++) {
+    ESPHelperTokenizer hsb((const uint8_t*)hsbPayloads[i] + 1, strlen(hsbPayloads[i]) - 1);
+    float h = 0, s = 0, b = 0;
+    if (!hsb.nextFloat(h) || !hsb.nextFloat(s) || !hsb.nextFloat(b) ||
+        fabsf(h - atof(&hsbPayloads[i][1])) > 0.001f || fabsf(s - atof(&hsbPayloads[i][7])) > 0.001f ||
+        fabsf(b - atof(&hsbPayloads[i][13])) > 0.001f) {
+      printf("tokenizer disagrees with atof on \"%s\"\n", hsbPayloads[i]);
+      return 1;
+    }
+
+    ESPHelperTokenizer rgb((const uint8_t*)rgbPayloads[i] + 1, strlen(rgbPayloads[i]) - 1);
+    int32_t r = 0, g = 0, bl = 0;
+    if (!rgb.nextInt(r) || !rgb.nextInt(g) || !rgb.nextInt(bl) || r != atoi(&rgbPayloads[i][1]) ||
+        g != atoi(&rgbPayloads[i][5]) || bl != atoi(&rgbPayloads[i][9])) {
+      printf("tokenizer disagrees with atoi on \"%s\"\n", rgbPayloads[i]);
+      return 1;
+    }
+
+    int32_t level = 0;
+    if (!ESPHelperText::jsonInt((const uint8_t*)jsonPayloads[i], strlen(jsonPayloads[i]), "level", level) ||
+        level != i * 3) {
+      printf("jsonInt misread \"%s\"\n", jsonPayloads[i]);
+      return 1;
+    }
+  }
+
+  printf("%lu iterations\n\n", iterations);
+  double base, helper;
+
+  printf("format int\n");
+  base = measure("String(value)", iterations, [](unsigned long i) {
+    String text((int)(i * 7919) - 500000);
+    sink += text.length();
+  });
+  helper = measure("ESPHelperText::formatInt", iterations, [](unsigned long i) {
+    char text[12];
+    sink += ESPHelperText::formatInt((int32_t)(i * 7919) - 500000, text, sizeof(text));
+  });
+  compare(base, helper);
+
+  printf("format float (2 decimals)\n");
+  base = measure("String(value, 2)", iterations, [](unsigned long i) {
+    String text((i % 100000) * 0.37f - 1000.0f, 2);
+    sink += text.length();
+  });
+  helper = measure("ESPHelperText::formatFloat", iterations, [](unsigned long i) {
+    char text[16];
+    sink += ESPHelperText::formatFloat((i % 100000) * 0.37f - 1000.0f, 2, text, sizeof(text));
+  });
+  compare(base, helper);
+
+  // RGBLight's "h0.500,0.250,0.750": copied into a buffer and atof at fixed offsets
+  printf("parse \"h0.500,0.250,0.750\"\n");
+  base = measure("copy + atof", iterations, [](unsigned long i) {
+    const char* payload = hsbPayloads[i % PAYLOADS];
+    unsigned int length = strlen(payload);
+    char newPayload[40];
+    memcpy(newPayload, payload, length);
+    newPayload[length] = '\0';
+    float h = atof(&newPayload[1]);
+    float s = atof(&newPayload[7]);
+    float b = atof(&newPayload[13]);
+    sink += (long)((h + s + b) * 100);
+  });
+  helper = measure("ESPHelperTokenizer::nextFloat", iterations, [](unsigned long i) {
+    const char* payload = hsbPayloads[i % PAYLOADS];
+    ESPHelperTokenizer fields((const uint8_t*)payload + 1, strlen(payload) - 1);
+    float h = 0, s = 0, b = 0;
+    fields.nextFloat(h);
+    fields.nextFloat(s);
+    fields.nextFloat(b);
+    sink += (long)((h + s + b) * 100);
+  });
+  compare(base, helper);
+
+  printf("parse \"r255,050,000\"\n");
+  base = measure("copy + atoi", iterations, [](unsigned long i) {
+    const char* payload = rgbPayloads[i % PAYLOADS];
+    unsigned int length = strlen(payload);
+    char newPayload[40];
+    memcpy(newPayload, payload, length);
+    newPayload[length] = '\0';
+    sink += atoi(&newPayload[1]) + atoi(&newPayload[5]) + atoi(&newPayload[9]);
+  });
+  helper = measure("ESPHelperTokenizer::nextInt", iterations, [](unsigned long i) {
+    const char* payload = rgbPayloads[i % PAYLOADS];
+    ESPHelperTokenizer fields((const uint8_t*)payload + 1, strlen(payload) - 1);
+    int32_t r = 0, g = 0, b = 0;
+    fields.nextInt(r);
+    fields.nextInt(g);
+    fields.nextInt(b);
+    sink += r + g + b;
+  });
+  compare(base, helper);
+
+  printf("JSON field \"level\"\n");
+  base = measure("String(payload) + strstr/atoi", iterations, [](unsigned long i) {
+    String payload(jsonPayloads[i % PAYLOADS]);
+    const char* at = strstr(payload.c_str(), "\"level\":");
+    sink += at != NULL ? atoi(at + 8) : 0;
+  });
+  helper = measure("ESPHelperText::jsonInt", iterations, [](unsigned long i) {
+    const char* payload = jsonPayloads[i % PAYLOADS];
+    int32_t level = 0;
+    ESPHelperText::jsonInt((const uint8_t*)payload, strlen(payload), "level", level);
+    sink += level;
+  });
+  compare(base, helper);
+
+  return 0;
+}
@@ -25,6 +25,7 @@ Refactoring by Suren Khorenyan
 #include "ESPHelper.h"
 #include <WiFiClientSecure.h>
 #include "ESPHelperFS.h"
+#include "ESPHelperWebConfig.h"
 
 
 
@@ -190,6 +191,45 @@ void ESPHelper::init(const char *ssid,
   _currentNet.willQoS = willQoS;
   _currentNet.willRetain = willRetain;
 
+  // every inbound message goes through mqttReceive
+  _transport->setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+    mqttReceive(topic, payload, length);
+  });
+  _transport->setPingCallback([this](uint32_t elapsedMicros) {
+    recordRTT(elapsedMicros);
+  });
+
+  // rules publish like the user would (they are evaluated whether or not the broker is there)
+  _rules.setPublisher([this](const char* topic, const char* payload) {
+    publish(topic, payload);
+  });
+
+  // pin changes are published like the user would
+  _gpio.setPublisher([this](const char* topic, const char* payload, bool retain) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retain, 0);
+  });
+
+  _sensors.setPublisher([this](const char* topic, const char* payload, bool retain) {
+    publish(topic, payload, retain);
+  });
+
+  _aggregate.setPublisher([this](const char* topic, const char* payload, bool retain) {
+    publish(topic, payload, retain);
+  });
+
+  _httpUpdate.setMonitor(&_otaMonitor);
+
+  _mqttUpdate.setMonitor(&_otaMonitor);
+  _mqttUpdate.setPublisher([this](const char* topic, const char* payload, bool retain) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retain, 0);
+  });
+
+  // messages from broker clients reach the callback like ones from a remote broker
+  _broker.setLocalCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+    if (isSubscribed(topic))
+      mqttReceive(topic, payload, length);
+  });
+
   // validate various bits of network/MQTT info
   validateConfig();
 }
@@ -317,6 +357,7 @@ bool ESPHelper::begin(){
     uint8_t mac[6];
     WiFi.macAddress(mac);
     _clientName += macToStr(mac);
+    expandTopics();
 
     // set the Wi-Fi mode to station and begin the Wi-Fi (connect using either ssid or ssid/pass)
     WiFi.mode(WIFI_STA);
@@ -325,40 +366,34 @@ bool ESPHelper::begin(){
     else
       WiFi.begin(_currentNet.ssid);
 
-    // as long as an MQTT IP has been set create an instance of PubSub for client
-    if (_mqttSet) {
-      // make MQTT client use either the secure or non-secure wifi client depending on the setting
-      if (_useSecureClient)
-        client = PubSubClient(_currentNet.mqttHost, _currentNet.mqttPort, wifiClientSecure);
-      else
-        client = PubSubClient(_currentNet.mqttHost, _currentNet.mqttPort, wifiClient);
-
-      // set the MQTT message callback if needed
-      if (_mqttCallbackSet)
-        client.setCallback(_mqttCallback);
-    } else {
-      // define a dummy instance of MQTT so that it is instantiated if no MQTT ip is set
-      // make MQTT client use either the secure or non-secure wifi client depending on the setting
-      // (this shouldnt be needed if making a dummy connection since the idea would be that there wont be MQTT in this case)
-      if (_useSecureClient)
-        client = PubSubClient("192.0.2.0", _currentNet.mqttPort, wifiClientSecure);
-      else
-        client = PubSubClient("192.0.2.0", _currentNet.mqttPort, wifiClient);
-    }
+    // point the MQTT transport at the broker (or a dummy one if no MQTT ip is set)
+    setupTransport();
+
+    // a report left by an update before the reboot is published once connected
+    _otaMonitor.restore();
 
     // OTA event handlers
-    ArduinoOTA.onStart([]() {/* ota start code */});
+    ArduinoOTA.onStart([this]() {
+      enterMaintenance();
+      _otaMonitor.start(OTA_SOURCE_ARDUINO, 0);
+    });
     ArduinoOTA.onEnd([this]() {
+      _otaMonitor.finish(true);
       // on OTA end we disconnect from Wi-Fi cleanly before restarting.
       safeApDisconnect();
     });
-    ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {/* ota progress code */});
-    ArduinoOTA.onError([](ota_error_t error) {/* ota error code */});
+    ArduinoOTA.onProgress([this](unsigned int progress, unsigned int total) {
+      _otaMonitor.progress(progress, total);
+    });
+    ArduinoOTA.onError([this](ota_error_t error) {
+      _otaMonitor.finish(false, error);
+      exitMaintenance();
+    });
 
     // initially attempt to connect to Wi-Fi when we begin
     // (but only block for 2 seconds before timing out)
     int timeout = 0;  // counter for begin connection attempts
-    while (((!client.connected() && _mqttSet) || WiFi.status() != WL_CONNECTED) && timeout < 200 ) {
+    while (((!_transport->connected() && _mqttSet) || WiFi.status() != WL_CONNECTED) && timeout < 200 ) {
     // max 2 seconds before timeout
       reconnect();
       delay(10);
@@ -381,7 +416,7 @@ bool ESPHelper::begin(){
 void ESPHelper::end(){
   ESPHelperFS::end();
   OTA_disable();
-  client.disconnect();
+  _transport->disconnect();
   safeApDisconnect();
   _connectionStatus = NO_CONNECTION;
 }
@@ -402,11 +437,10 @@ netInfo ESPHelper::loadConfigFile(const char* filename) {
     if (configLoader.begin()) {
       // attempt to load a configuration
       configLoaded = configLoader.loadNetworkConfig();
-      // if no config loaded (either from corruption or no file),
-      // create a new config and close the FS
+      // if no config loaded (either from corruption or no file) loadNetworkConfig
+      // has already written the defaults - close the FS and load those next time round
       if (!configLoaded) {
-        // debugPrintln("Could not load config - generating new config and restarting...");  // Debug Print
-        configLoader.createConfig(filename);
+        // debugPrintln("Could not load config - generated new config, retrying...");  // Debug Print
         configLoader.end();
         // debugPrintln("Config File loading failed. Retrying...");  // Debug Print
       } else {
@@ -446,13 +480,63 @@ void ESPHelper::useSecureClient(const char* fingerprint) {
   if (setConnectionStatus() == FULL_CONNECTION)
     _connectionStatus = WIFI_ONLY;
 
+  // flag use of secure client
+  _useSecureClient = true;
+
   // if use of secure connection is set retroactivly (after begin)
-  // then re-instantiate client
+  // then re-setup the transport
   if (_hasBegun)
-    client = PubSubClient(_currentNet.mqttHost, _currentNet.mqttPort, wifiClientSecure);
+    setupTransport();
+}
 
-  // flag use of secure client
-  _useSecureClient = true;
+// replace the MQTT client ESPHelper talks to the broker with
+// (defaults to PubSubClient - see ESPHelperTransport / ESPHelperMQTT)
+void ESPHelper::setTransport(ESPHelperTransport &transport) {
+  if (_hasBegun) {
+    _transport->disconnect();
+    if (setConnectionStatus() == FULL_CONNECTION)
+      _connectionStatus = WIFI_ONLY;
+  }
+
+  _transport = &transport;
+
+  // callbacks and stream settings are applied straight away so they work
+  // whether or not the system has already been started
+  _transport->setCallback([this](char* topic, uint8_t* payload, unsigned int length) {
+    mqttReceive(topic, payload, length);
+  });
+  _transport->setPingCallback([this](uint32_t elapsedMicros) {
+    recordRTT(elapsedMicros);
+  });
+  if (_streamCallbackSet)
+    _transport->setStreamCallback(_streamCallback);
+  if (_streamThreshold > 0)
+    _transport->setStreamThreshold(_streamThreshold);
+  if (_keepAliveMax > 0)
+    _transport->setKeepAlive(_keepAlive);
+
+  if (_hasBegun)
+    setupTransport();
+}
+
+// the transport currently in use
+ESPHelperTransport* ESPHelper::getTransport() {
+  return _transport;
+}
+
+// give the transport the Wi-Fi client and broker to use
+void ESPHelper::setupTransport() {
+  // make MQTT client use either the secure or non-secure wifi client depending on the setting
+  if (_useSecureClient)
+    _transport->setClient(wifiClientSecure);
+  else
+    _transport->setClient(wifiClient);
+
+  // (the dummy server shouldnt be needed since the idea would be that there wont be MQTT in this case)
+  if (_mqttSet)
+    _transport->setServer(_currentNet.mqttHost, _currentNet.mqttPort);
+  else
+    _transport->setServer("192.0.2.0", _currentNet.mqttPort);
 }
 
 // enables and sets up broadcast mode rather than station mode. This allows users to create a network from the ESP
@@ -472,6 +556,9 @@ void ESPHelper::broadcastMode(const char* ssid, const char* password, const IPAd
   _broadcastIP = ip;
   strcpy(_broadcastSSID, ssid);
   strcpy(_broadcastPASS, password);
+
+  if (_brokerEnabled)
+    _broker.begin(_brokerPort);
 }
 
 // disable broadcast mode and reset to station mode
@@ -479,6 +566,7 @@ void ESPHelper::broadcastMode(const char* ssid, const char* password, const IPAd
 void ESPHelper::disableBroadcast() {
   // disconnect from any previous wifi networks (max timeout of 2 seconds)
   safeApDisconnect();
+  _broker.end();
   _connectionStatus = NO_CONNECTION;
   begin();
 }
@@ -487,9 +575,49 @@ void ESPHelper::disableBroadcast() {
 // true on: network / server connected
 // false on: network or server disconnected
 int ESPHelper::loop(){
+  // local rules watch their inputs even without a network (but not while an update runs)
+  if (!_maintenance) {
+    _rules.loop();
+    _sensors.loop();
+    _aggregate.loop();
+  }
+  if (_connectionStatus == FULL_CONNECTION) {
+    if (_shadow)
+      _shadow->loop();
+    sendOTAReport();
+    if (_mqttUpdateTopic != NULL)
+      runMQTTUpdate();
+  }
+
+  // an update asked for over MQTT is started here rather than inside the MQTT client
+  if (_httpUpdateRequested) {
+    _httpUpdateRequested = false;
+    startHTTPUpdate(_httpUpdateURL, _httpUpdateMD5[0] != '\0' ? _httpUpdateMD5 : NULL);
+  }
+
+  int status = networkLoop();
+  publishEvents();
+  return status;
+}
+
+// everything that touches Wi-Fi, the MQTT client and the other network services
+int ESPHelper::networkLoop() {
+  if (_httpUpdate.isRunning())
+    runHTTPUpdate();
+
+  // an update is running - it gets the whole loop
+  if (_maintenance) {
+    ArduinoOTA.handle();
+    return _connectionStatus;
+  }
+
   if (_ssidSet) {
+    // a connection that was up just dropped - the link may not like the keepalive
+    if (_connectionStatus == FULL_CONNECTION && _mqttSet && !_transport->connected())
+      adaptKeepAlive(true);
+
     // check for good connections and attempt a reconnect if needed
-    if ( ((_mqttSet && !client.connected()) || setConnectionStatus() < WIFI_ONLY)
+    if ( ((_mqttSet && !_transport->connected()) || setConnectionStatus() < WIFI_ONLY)
           && _connectionStatus != BROADCAST) {
       reconnect();
     }
@@ -498,7 +626,33 @@ int ESPHelper::loop(){
     if (_connectionStatus >= BROADCAST) {
       // run the MQTT loop if we have a full connection
       if (_connectionStatus == FULL_CONNECTION)
-        client.loop();
+        _transport->loop();
+
+      // clients of the embedded broker (only while broadcasting)
+      if (_connectionStatus == BROADCAST)
+        _broker.loop();
+
+      // MQTT-SN gateway replies and keepalive (needs a station connection)
+      if (_connectionStatus >= WIFI_ONLY)
+        _mqttsn.loop();
+
+      // round trip probe and keepalive growth on a quiet link
+      if (_connectionStatus == FULL_CONNECTION) {
+        if (_rttInterval > 0 && millis() - _rttLastProbe >= _rttInterval)
+          probeRTT();
+        if (_keepAliveMax > 0 && millis() - _connectedSince >= RTT_STABLE_PERIODS * _keepAlive * 1000UL) {
+          adaptKeepAlive(false);
+          _connectedSince = millis();
+        }
+      }
+
+      // run any handlers that the MQTT loop queued up
+      dispatchInbound();
+
+      // send the per-topic report if it is due
+      if (_statsTopic != NULL && _connectionStatus == FULL_CONNECTION
+          && millis() - _lastStatsReport >= _statsInterval)
+        reportTopicStats();
 
       // run the heartbeat - why?
       // heartbeat();
@@ -524,9 +678,9 @@ int ESPHelper::loop(){
 bool ESPHelper::subscribe(const char* topic, int qos) {
   if (_connectionStatus == FULL_CONNECTION) {
     // set the return value to the output of subscribe
-    bool returnVal = client.subscribe(topic, qos);
+    bool returnVal = _transport->subscribe(topic, qos);
     // loop MQTT client
-    client.loop();
+    _transport->loop();
     return returnVal;
   }
   // if not fully connected return false
@@ -558,14 +712,127 @@ bool ESPHelper::addSubscription(const char* topic) {
   return subscribed;
 }
 
-// loops through the list of subscriptions and attempts to subscribe to all topics
+// add a topic to the list of subscriptions and keep the last value received on it.
+// [maxLength] bytes are reserved for the value in the cache arena (longer values are cut short)
+// returns the handle to read the value with or -1 if there is no free
+// subscription slot or not enough room left in the cache
+int8_t ESPHelper::addCachedSubscription(const char* topic, uint16_t maxLength) {
+  for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+    if (_subscriptions[i].isUsed)
+      continue;
+
+    // reuse the space of a previously removed cached subscription if it is big enough,
+    // otherwise take new space from the end of the arena (+1 for the null terminator)
+    if (_subscriptions[i].cacheCapacity < maxLength + 1) {
+      if (_valueCacheUsed + maxLength + 1 > VALUE_CACHE_SIZE)
+        continue;
+      _subscriptions[i].cacheOffset = _valueCacheUsed;
+      _subscriptions[i].cacheCapacity = maxLength + 1;
+      _valueCacheUsed += maxLength + 1;
+    }
+    if (!_valueCache)
+      _valueCache.reset(new char[VALUE_CACHE_SIZE]);
+
+    _subscriptions[i].topic = topic;
+    _subscriptions[i].isUsed = true;
+    _subscriptions[i].cached = true;
+    _subscriptions[i].cacheLength = 0;
+    _subscriptions[i].cacheSeq = 0;
+    _valueCache[_subscriptions[i].cacheOffset] = '\0';
+
+    subscribe(topic, _qos);
+    return i;
+  }
+  return -1;
+}
+
+// find the handle of a subscription in the list (-1 if it isn't there)
+int8_t ESPHelper::findSubscription(const char* topic) {
+  for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+    if (_subscriptions[i].isUsed && strcmp(_subscriptions[i].topic, topic) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// last value received on a cached subscription (null terminated, "" until one arrives)
+const char* ESPHelper::getCachedValue(int8_t handle) {
+  if (handle < 0 || handle >= MAX_SUBSCRIPTIONS || !_subscriptions[handle].cached)
+    return "";
+  return &_valueCache[_subscriptions[handle].cacheOffset];
+}
+
+// length of the cached value (0 if there is none)
+uint16_t ESPHelper::getCachedLength(int8_t handle) {
+  if (handle < 0 || handle >= MAX_SUBSCRIPTIONS || !_subscriptions[handle].cached)
+    return 0;
+  return _subscriptions[handle].cacheLength;
+}
+
+// change counter of a cached value - compare with the last seen
+// number to know whether the value changed (0 = nothing received yet)
+uint32_t ESPHelper::getCachedSequence(int8_t handle) {
+  if (handle < 0 || handle >= MAX_SUBSCRIPTIONS || !_subscriptions[handle].cached)
+    return 0;
+  return _subscriptions[handle].cacheSeq;
+}
+
+// copy an inbound message into the cache of every cached subscription it matches
+void ESPHelper::updateValueCache(const char* topic, const uint8_t* payload, unsigned int length) {
+  for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+    subscription &sub = _subscriptions[i];
+    if (!sub.isUsed || !sub.cached || !topicMatches(sub.topic, topic))
+      continue;
+
+    if (length > (unsigned int)sub.cacheCapacity - 1)
+      length = sub.cacheCapacity - 1;
+    char* value = &_valueCache[sub.cacheOffset];
+    memcpy(value, payload, length);
+    value[length] = '\0';
+    sub.cacheLength = length;
+    sub.cacheSeq++;
+  }
+}
+
+// after a reconnect give the broker a moment to send the retained values of the
+// cached subscriptions so they are there as soon as reconnect() returns
+void ESPHelper::primeValueCache() {
+  unsigned long start = millis();
+  while (millis() - start < VALUE_CACHE_PRIME_TIMEOUT) {
+    bool missing = false;
+    for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+      if (_subscriptions[i].isUsed && _subscriptions[i].cached && _subscriptions[i].cacheSeq == 0) {
+        missing = true;
+        break;
+      }
+    }
+    if (!missing || !_transport->loop())
+      return;
+    yield();
+  }
+}
+
+// subscribes to every topic in the list of subscriptions
+// (in a single SUBSCRIBE packet if the transport supports it)
 void ESPHelper::resubscribe() {
+  if (_connectionStatus != FULL_CONNECTION)
+    return;
+
+  const char* topics[MAX_SUBSCRIPTIONS];
+  uint8_t qos[MAX_SUBSCRIPTIONS];
+  uint8_t count = 0;
   for(int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
     if (_subscriptions[i].isUsed) {
-      subscribe(_subscriptions[i].topic, _qos);
-      yield();
+      topics[count] = _subscriptions[i].topic;
+      qos[count] = _qos;
+      count++;
     }
   }
+
+  if (count > 0) {
+    _transport->subscribe(topics, qos, count);
+    _transport->loop();
+  }
 }
 
 // attempts to remove a topic from the topic list
@@ -583,10 +850,12 @@ bool ESPHelper::removeSubscription(const char* topic) {
       String subStr = _subscriptions[i].topic;
       if (subStr.equals(topicStr)) {
         // reset the used flag to false
+        // (cache space stays reserved for the slot so it can be reused)
         _subscriptions[i].isUsed = false;
+        _subscriptions[i].cached = false;
 
         // unsubscribe
-        client.unsubscribe(_subscriptions[i].topic);
+        _transport->unsubscribe(_subscriptions[i].topic);
         returnVal = true;
         break;
       }
@@ -599,7 +868,7 @@ bool ESPHelper::removeSubscription(const char* topic) {
 // manually unsubscribes from a topic
 // (This is basically just a wrapper for the pubsubclient function)
 bool ESPHelper::unsubscribe(const char* topic) {
-  return client.unsubscribe(topic);
+  return _transport->unsubscribe(topic);
 }
 
 // publish to a specified topic
@@ -609,21 +878,663 @@ void ESPHelper::publish(const char* topic, const char* payload) {
 
 // publish to a specified topic with a given retain level
 void ESPHelper::publish(const char* topic, const char* payload, bool retain) {
-  client.publish(topic, payload, retain);
+  publish(topic, (const uint8_t*)payload, strlen(payload), retain, 0);
+}
+
+// publish a binary payload of [length] bytes. QoS above 0 needs a transport
+// that supports it (ESPHelperMQTT) - PubSubClient always publishes at QoS 0
+bool ESPHelper::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain, uint8_t qos) {
+  _rules.onMessage(topic, payload, length);
+  bool result;
+  if (_connectionStatus == BROADCAST && _broker.isRunning())
+    result = _broker.publish(topic, payload, length, retain, qos);
+  else
+    result = _transport->publish(topic, payload, length, retain, qos);
+  if (_topicStats.isEnabled())
+    _topicStats.recordOut(topic, length);
+  return result;
+}
+
+// start publishing a payload of [length] bytes that is written in pieces with
+// writePayload() and finished with endPublish() - the payload never has to be in memory at once
+bool ESPHelper::beginPublish(const char* topic, unsigned int length, bool retain) {
+  if (_topicStats.isEnabled())
+    _topicStats.recordOut(topic, length);
+  return _transport->beginPublish(topic, length, retain);
+}
+
+size_t ESPHelper::writePayload(const uint8_t* buf, size_t size) {
+  return _transport->writePayload(buf, size);
+}
+
+bool ESPHelper::endPublish() {
+  return _transport->endPublish();
+}
+
+// Print that writes into the streaming publish started with beginPublish()
+class PayloadPrint : public Print {
+  public:
+    PayloadPrint(ESPHelper &helper) : _helper(helper) {}
+    size_t write(uint8_t b) { return _helper.writePayload(&b, 1); }
+    size_t write(const uint8_t* buf, size_t size) { return _helper.writePayload(buf, size); }
+  private:
+    ESPHelper &_helper;
+};
+
+// publish a CBOR payload built by [build] (called with the writer to fill).
+// Payloads up to CBOR_STACK_SIZE bytes are built on the stack and published like any
+// other, bigger ones are sized with a counting pass and then encoded straight into
+// a streaming publish - [build] must write the same items both times
+bool ESPHelper::publishCBOR(const char* topic, std::function<void(ESPHelperCBORWriter&)> build,
+                            bool retain, uint8_t qos) {
+  uint8_t buf[CBOR_STACK_SIZE];
+  ESPHelperCBORWriter writer(buf, sizeof(buf));
+  build(writer);
+  if (writer.ok())
+    return publish(topic, buf, writer.length(), retain, qos);
+
+  // streaming publishes go straight to the MQTT client (QoS 0)
+  if (!beginPublish(topic, writer.length(), retain))
+    return false;
+  PayloadPrint out(*this);
+  ESPHelperCBORWriter streamWriter(out);
+  build(streamWriter);
+  return endPublish() && streamWriter.ok();
+}
+
+// publish over UDP to an MQTT-SN gateway alongside the normal MQTT connection.
+// [gatewayHost] defaults to the MQTT host of the current network. With [connect]
+// a connection is kept up so QoS 0 works, otherwise only QoS -1 can be used
+// true on: UDP socket open
+bool ESPHelper::enableMQTTSN(const char* gatewayHost, uint16_t port, bool connect) {
+  if (gatewayHost == NULL)
+    gatewayHost = _currentNet.mqttHost;
+  if (!_mqttsn.begin(gatewayHost, port))
+    return false;
+
+  // the gateway connects to the broker on our behalf so it needs
+  // a client id that differs from the one of the MQTT connection
+  if (connect) {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    char clientId[MQTTSN_CLIENT_ID_SIZE];
+    snprintf(clientId, sizeof(clientId), "SN-%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    _mqttsn.connect(clientId);
+  }
+  return true;
+}
+
+void ESPHelper::disableMQTTSN() {
+  _mqttsn.end();
+}
+
+// map a topic name to the id it is predefined as on the gateway
+bool ESPHelper::addMQTTSNTopic(const char* topic, uint16_t topicId) {
+  return _mqttsn.addTopic(topic, topicId);
+}
+
+// publish a predefined topic over MQTT-SN at QoS -1 (fire and forget) or 0
+// true on: datagram sent (see ESPHelperMQTTSN::publish)
+bool ESPHelper::publishSN(const char* topic, const uint8_t* payload, unsigned int length, int8_t qos) {
+  if (_connectionStatus < WIFI_ONLY)
+    return false;
+  bool result = _mqttsn.publish(topic, payload, length, qos);
+  if (_topicStats.isEnabled())
+    _topicStats.recordOut(topic, length);
+  return result;
+}
+
+bool ESPHelper::publishSN(uint16_t topicId, const uint8_t* payload, unsigned int length, int8_t qos) {
+  if (_connectionStatus < WIFI_ONLY)
+    return false;
+  return _mqttsn.publish(topicId, payload, length, qos);
+}
+
+// the MQTT-SN client for its counters and settings
+ESPHelperMQTTSN* ESPHelper::getMQTTSN() {
+  return &_mqttsn;
 }
 
 // set the callback function for MQTT
 void ESPHelper::setMQTTCallback(MQTT_CALLBACK_SIGNATURE) {
   _mqttCallback = callback;
 
-  // only set the callback if using MQTT AND the system has already been started.
-  // Otherwise just save it for later
-  if(_hasBegun && _mqttSet)
-    client.setCallback(_mqttCallback);
-
+  // the transport always calls mqttReceive (set in setTransport),
+  // which passes messages on once a callback is set
   _mqttCallbackSet = true;
 }
 
+// entry point for every message the MQTT client receives. With the inbound queue
+// enabled the message is only copied here and the callback runs later from loop()
+void ESPHelper::mqttReceive(char* topic, uint8_t* payload, unsigned int length) {
+  // loopback probes end here and never reach the callback
+  if (_rttTopic != NULL && strcmp(topic, _rttTopic) == 0) {
+    if (_rttProbeOutstanding && length == sizeof(_rttProbeSent)
+        && memcmp(payload, &_rttProbeSent, length) == 0) {
+      _rtt.addSample(micros() - _rttProbeSent);
+      _rttProbeOutstanding = false;
+    }
+    return;
+  }
+
+  updateValueCache(topic, payload, length);
+  _rules.onMessage(topic, payload, length);
+  if (_topicStats.isEnabled())
+    _topicStats.recordIn(statsKey(topic), length);
+
+  // desired state is applied here and not passed on to the callback
+  if (_shadow && _shadow->isDesiredTopic(topic)) {
+    _shadow->applyDesired(payload, length);
+    return;
+  }
+
+  // firmware chunks go straight to flash
+  if (_mqttUpdateTopic != NULL && strcmp(topic, _mqttUpdateTopic) == 0) {
+    _mqttUpdate.handle(payload, length);
+    return;
+  }
+
+  // "<url>" or "<url> <md5>" - the update starts on the next loop()
+  if (_httpUpdateTopic != NULL && strcmp(topic, _httpUpdateTopic) == 0) {
+    ESPHelperTokenizer fields(payload, length, ' ');
+    const char* field;
+    size_t fieldLength;
+    if (fields.next(field, fieldLength) && fieldLength > 0 && fieldLength < sizeof(_httpUpdateURL)) {
+      memcpy(_httpUpdateURL, field, fieldLength);
+      _httpUpdateURL[fieldLength] = '\0';
+      _httpUpdateMD5[0] = '\0';
+      if (fields.next(field, fieldLength) && fieldLength == 32) {
+        memcpy(_httpUpdateMD5, field, fieldLength);
+        _httpUpdateMD5[fieldLength] = '\0';
+      }
+      _httpUpdateRequested = true;
+    }
+    return;
+  }
+
+  // a message too big for a queue slot runs the callback straight away rather than being lost
+  if (_inbound.isEnabled() && _inbound.fits(topic, length))
+    _inbound.push(topic, payload, length);
+  else
+    runCallback(topic, payload, length);
+}
+
+// run queued handlers until the queue is empty or the budget for this loop is used up
+// (at least one message is always dispatched so a slow handler can't stall the queue)
+void ESPHelper::dispatchInbound() {
+  uint32_t start = micros();
+  inboundMessage msg;
+
+  while (_inbound.pop(msg)) {
+    runCallback(msg.topic, msg.payload, msg.length);
+
+    if (micros() - start >= _inboundBudget)
+      break;
+  }
+}
+
+// start queueing events from interrupt handlers into a ring of [slots] events.
+// loop() publishes them once connected (or to the embedded broker while broadcasting)
+// true on: ring allocated
+// false on: allocation failed
+bool ESPHelper::enableEvents(uint8_t slots) {
+  return _events.begin(slots);
+}
+
+// stop accepting events (anything still queued is lost)
+void ESPHelper::disableEvents() {
+  _events.end();
+}
+
+// register the topic events with the returned id are published to - the topic is
+// not copied so it must stay valid. -1 if EVENT_TOPICS topics are already registered
+int8_t ESPHelper::addEventTopic(const char* topic, bool retain) {
+  return _events.addTopic(topic, retain);
+}
+
+// queue up to EVENT_DATA_SIZE bytes for [topicId] - safe to call from an interrupt handler
+// true on: event queued
+// false on: events not enabled, unknown topic id or ring full (see getEventStats)
+bool ICACHE_RAM_ATTR ESPHelper::queueEvent(uint8_t topicId, const uint8_t* data, uint8_t length) {
+  return _events.push(topicId, data, length);
+}
+
+bool ICACHE_RAM_ATTR ESPHelper::queueEvent(uint8_t topicId, const char* data) {
+  uint8_t length = 0;
+  while (data[length] != '\0' && length < EVENT_DATA_SIZE)
+    length++;
+  return _events.push(topicId, (const uint8_t*)data, length);
+}
+
+eventStats ESPHelper::getEventStats() {
+  return _events.getStats();
+}
+
+// publish [highPayload] / [lowPayload] to [topic] whenever [pin] settles on a new level
+// for [debounceMs]. A NULL payload skips that edge. [flags] are WATCH_PULLUP,
+// WATCH_COALESCE and WATCH_RETAIN. The topic and payloads are not copied
+// returns the index of the pin in getPinWatcher() or -1 if WATCH_PINS pins are watched
+int8_t ESPHelper::watchPin(uint8_t pin, const char* topic, uint8_t flags, uint16_t debounceMs,
+                           const char* highPayload, const char* lowPayload) {
+  return _gpio.watch(pin, topic, flags, debounceMs, highPayload, lowPayload);
+}
+
+void ESPHelper::unwatchPins() {
+  _gpio.clear();
+}
+
+// the pin watcher for its counters and states
+ESPHelperGPIO* ESPHelper::getPinWatcher() {
+  return &_gpio;
+}
+
+// start a measurement of [sensor] every [intervalMs] from loop() and publish the
+// reading to [topic] (NULL to not publish) once the sensor has it. Conversions never
+// block loop(). The sensor and topic are not copied
+// returns a handle for getSensorValue() or -1 if MAX_SENSORS are added or the sensor failed to start
+int8_t ESPHelper::addSensor(ESPHelperSensor &sensor, const char* topic, uint32_t intervalMs,
+                            uint8_t decimals, bool retain) {
+  return _sensors.add(sensor, topic, intervalMs, decimals, retain);
+}
+
+// called with the handle and value of every reading
+void ESPHelper::setSensorCallback(std::function<void(int8_t, float)> callback) {
+  _sensors.setCallback(callback);
+}
+
+// last reading of the sensor (NAN before the first one)
+float ESPHelper::getSensorValue(int8_t handle) {
+  if (handle < 0)
+    return NAN;
+  return _sensors.getValue(handle);
+}
+
+// the sensor scheduler for its counters
+ESPHelperSensors* ESPHelper::getSensors() {
+  return &_sensors;
+}
+
+// collect samples for [topic] and publish "min,max,mean,last,count" every [windowMs]
+// instead of every sample. Values are kept with [decimals] places in fixed point.
+// The topic is not copied
+// returns a handle for addSample() or -1 if MAX_SERIES series exist
+int8_t ESPHelper::addSeries(const char* topic, uint32_t windowMs, uint8_t decimals) {
+  return _aggregate.add(topic, windowMs, decimals);
+}
+
+bool ESPHelper::addSample(int8_t series, float value) {
+  return _aggregate.addSample(series, value);
+}
+
+// same as above but looks the series up by its topic
+bool ESPHelper::addSample(const char* topic, float value) {
+  return _aggregate.addSample(_aggregate.find(topic), value);
+}
+
+// the last closed window of a series (fixed point values, count 0 before the first one)
+seriesWindow ESPHelper::getSeriesWindow(int8_t series) {
+  if (series < 0)
+    return seriesWindow();
+  return _aggregate.getWindow(series);
+}
+
+// the aggregation stage for its series
+ESPHelperAggregate* ESPHelper::getAggregate() {
+  return &_aggregate;
+}
+
+// register a topic template (see makeTopic) - TOPIC_DEVICE is replaced by the device
+// prefix once begin() has run. Returns the handle to use with getTopic/publishTopic/subscribeTopic
+// or -1 if there is no room for it
+int8_t ESPHelper::addTopic(const topicTemplate &topic) {
+  int8_t handle = _topics.add(topic);
+
+  // begin() had nothing to expand if this is the first template
+  if (handle >= 0 && _hasBegun && !_topics.isExpanded()) {
+    expandTopics();
+    if (_topics.get(handle) == NULL)
+      return -1;
+  }
+  return handle;
+}
+
+// use [prefix] in topic templates instead of the OTA hostname / MQTT client name
+// (must be called before begin())
+void ESPHelper::setTopicPrefix(const char* prefix) {
+  _topicPrefix = prefix;
+}
+
+// expanded topic for a handle (NULL before begin() or if it did not fit)
+const char* ESPHelper::getTopic(int8_t handle) {
+  return _topics.get(handle);
+}
+
+bool ESPHelper::publishTopic(int8_t handle, const char* payload, bool retain) {
+  const char* topic = _topics.get(handle);
+  if (topic == NULL || payload == NULL)
+    return false;
+  return publish(topic, (const uint8_t*)payload, strlen(payload), retain, 0);
+}
+
+bool ESPHelper::publishTopic(int8_t handle, const uint8_t* payload, unsigned int length, bool retain, uint8_t qos) {
+  const char* topic = _topics.get(handle);
+  if (topic == NULL)
+    return false;
+  return publish(topic, payload, length, retain, qos);
+}
+
+// subscribe to an expanded topic (topics never move so no copy is needed)
+bool ESPHelper::subscribeTopic(int8_t handle) {
+  const char* topic = _topics.get(handle);
+  if (topic == NULL)
+    return false;
+  return addSubscription(topic);
+}
+
+// keep the fields of getShadow() in sync: changes are published to [reportedTopic] as
+// deltas from loop() (everything after each reconnect) and documents on [desiredTopic]
+// are applied to the fields (desired state should be published retained so it is
+// delivered after a reboot). Either topic can be NULL
+// true on: shadow enabled (and desired topic subscribed)
+// false on: no topics or no free subscription slot
+bool ESPHelper::enableShadow(const char* reportedTopic, const char* desiredTopic, bool retain) {
+  if (!getShadow()->begin(reportedTopic, desiredTopic, retain))
+    return false;
+  if (desiredTopic != NULL && !addSubscription(desiredTopic)) {
+    _shadow->end();
+    return false;
+  }
+  return true;
+}
+
+void ESPHelper::disableShadow() {
+  if (!_shadow)
+    return;
+  if (_shadow->isEnabled() && _shadow->getDesiredTopic() != NULL)
+    removeSubscription(_shadow->getDesiredTopic());
+  _shadow->end();
+}
+
+// called with the handle of every field a desired document changed
+void ESPHelper::setShadowCallback(std::function<void(int8_t)> callback) {
+  getShadow()->setCallback(callback);
+}
+
+// the shadow's fields (add, set and get them here) - the first call allocates the shadow
+ESPHelperShadow* ESPHelper::getShadow() {
+  if (!_shadow) {
+    _shadow.reset(new ESPHelperShadow);
+    _shadow->setPublisher([this](const char* topic, const char* payload, bool retain) {
+      return publish(topic, (const uint8_t*)payload, strlen(payload), retain, 0);
+    });
+  }
+  return _shadow.get();
+}
+
+// publish the report of the last firmware update to [topic] - after the reboot of a
+// successful update on the first full connection, right away for a failed one.
+// The payload is a line of comma separated values (see ESPHelperOTAMonitor::formatReport)
+void ESPHelper::publishOTAReport(const char* topic, bool retain) {
+  _otaReportTopic = topic;
+  _otaReportRetain = retain;
+}
+
+// called on every OTA start, progress update, end and error with the report so far
+void ESPHelper::setOTACallback(std::function<void(uint8_t, const otaReport&)> callback) {
+  _otaMonitor.setCallback(callback);
+}
+
+// the running or last finished update (including one from before the reboot)
+otaReport ESPHelper::getOTAReport() {
+  return _otaMonitor.getReport();
+}
+
+// the monitor every update reports to (for updates that come in some other way)
+ESPHelperOTAMonitor* ESPHelper::getOTAMonitor() {
+  return &_otaMonitor;
+}
+
+// pause everything that competes with an OTA upload for heap and sockets while it runs:
+// the MQTT connection (and its buffers), the embedded broker and, if given, [webConfig].
+// The local rules, sensors and aggregates are not run meanwhile and the maintenance
+// callback should pause the application's own periodic work.
+// If the update fails it is all started again (MQTT through the normal reconnect).
+// On by default
+void ESPHelper::setOTAMaintenance(bool enable, ESPHelperWebConfig* webConfig) {
+  _otaMaintenance = enable;
+  _maintenanceWebConfig = webConfig;
+}
+
+// called with true when an update starts and false if it failed and everything resumes
+void ESPHelper::setMaintenanceCallback(std::function<void(bool)> callback) {
+  _maintenanceCallback = callback;
+  _maintenanceCallbackSet = true;
+}
+
+bool ESPHelper::inMaintenance() {
+  return _maintenance;
+}
+
+void ESPHelper::enterMaintenance() {
+  if (!_otaMaintenance || _maintenance)
+    return;
+  _maintenance = true;
+
+  if (_maintenanceCallbackSet)
+    _maintenanceCallback(true);
+  if (_maintenanceWebConfig != NULL)
+    _maintenanceWebConfig->pause();
+
+  // broker clients and retained messages are dropped, not kept for later
+  _broker.end();
+  if (_mqttSet) {
+    _transport->disconnect();
+    _transport->releaseBuffers();
+  }
+  if (_connectionStatus == FULL_CONNECTION)
+    _connectionStatus = WIFI_ONLY;
+}
+
+void ESPHelper::exitMaintenance() {
+  if (!_maintenance)
+    return;
+  _maintenance = false;
+
+  if (_connectionStatus == BROADCAST && _brokerEnabled)
+    _broker.begin(_brokerPort);
+  if (_maintenanceWebConfig != NULL)
+    _maintenanceWebConfig->resume();
+  if (_maintenanceCallbackSet)
+    _maintenanceCallback(false);
+}
+
+// download and install the firmware image at [url] (plain http, gzip compressed images
+// are fine). It runs from loop() in maintenance mode (see setOTAMaintenance), resumes
+// after dropped connections and reboots into the new firmware when it is done.
+// The result goes into the OTA report like an ArduinoOTA update
+// true on: download started
+// false on: an update is already running or the URL is not usable
+bool ESPHelper::startHTTPUpdate(const char* url, const char* md5) {
+  if (_httpUpdate.isRunning() || _otaMonitor.isRunning())
+    return false;
+
+  enterMaintenance();
+  if (!_httpUpdate.begin(url, md5)) {
+    exitMaintenance();
+    return false;
+  }
+  return true;
+}
+
+// start an update whenever "<url>" or "<url> <md5>" is published to [commandTopic]
+// true on: topic subscribed
+bool ESPHelper::enableHTTPUpdate(const char* commandTopic) {
+  if (!addSubscription(commandTopic))
+    return false;
+  _httpUpdateTopic = commandTopic;
+  return true;
+}
+
+// the HTTP updater (state, bytes written, error of a failed update)
+ESPHelperHTTPUpdate* ESPHelper::getHTTPUpdate() {
+  return &_httpUpdate;
+}
+
+void ESPHelper::runHTTPUpdate() {
+  uint8_t state = _httpUpdate.loop();
+  if (state == HTTP_UPDATE_DONE) {
+    // same as the end of an ArduinoOTA update
+    safeApDisconnect();
+    ESP.restart();
+  }
+  else if (state == HTTP_UPDATE_FAILED)
+    exitMaintenance();
+}
+
+// take firmware updates published in chunks to [updateTopic] - acks, requests for
+// missing chunks and the result go to [statusTopic] and the device reboots into the new
+// image once every chunk is written and the MD5 (if one was sent) matches.
+// MQTT stays connected while it runs, so the client's buffer has to take a whole
+// chunk message - ESPHelperMQTT's arena fits 512 byte chunks. The rate and
+// retransmissions go into the OTA report
+// true on: topic subscribed
+bool ESPHelper::enableMQTTUpdate(const char* updateTopic, const char* statusTopic) {
+  if (!addSubscription(updateTopic))
+    return false;
+  _mqttUpdateTopic = updateTopic;
+  _mqttUpdate.setStatusTopic(statusTopic);
+  return true;
+}
+
+// the MQTT updater (state, bytes written, retransmissions, error of a failed update)
+ESPHelperMQTTUpdate* ESPHelper::getMQTTUpdate() {
+  return &_mqttUpdate;
+}
+
+void ESPHelper::runMQTTUpdate() {
+  if (_mqttUpdate.loop() == MQTT_UPDATE_DONE) {
+    // "done" has been published - close cleanly so it gets out before the reboot
+    _transport->disconnect();
+    safeApDisconnect();
+    ESP.restart();
+  }
+}
+
+// publish a pending OTA report (it stays pending until it could be sent)
+void ESPHelper::sendOTAReport() {
+  if (_otaReportTopic == NULL || !_otaMonitor.isPending())
+    return;
+
+  char report[128];
+  if (_otaMonitor.formatReport(report, sizeof(report)) < 0
+      || publish(_otaReportTopic, (const uint8_t*)report, strlen(report), _otaReportRetain, 0))
+    _otaMonitor.clearPending();
+}
+
+// fill in the device prefix of every topic template: the prefix from setTopicPrefix(),
+// else the OTA hostname (without the version OTA_setHostnameWithVersion adds), else the client name
+void ESPHelper::expandTopics() {
+  const char* prefix = _topicPrefix;
+  size_t length = 0;
+  if (prefix == NULL && _hostname[0] != '\0') {
+    prefix = _hostname;
+    const char* version = strstr(_hostname, "---v");
+    length = version != NULL ? (size_t)(version - _hostname) : strlen(_hostname);
+  }
+  else if (prefix == NULL) {
+    prefix = _clientName.c_str();
+    length = _clientName.length();
+  }
+  else
+    length = strlen(prefix);
+
+  _topics.expand(prefix, length);
+}
+
+// publish everything the interrupt handlers and the pin watcher queued
+// (it waits while there is nowhere to publish to)
+void ESPHelper::publishEvents() {
+  if (_connectionStatus != FULL_CONNECTION && !(_connectionStatus == BROADCAST && _broker.isRunning()))
+    return;
+
+  _gpio.flush();
+  if (!_events.isEnabled())
+    return;
+
+  // an event only leaves the ring once it is published - after a failure the rest
+  // waits for the next loop()
+  isrEvent event;
+  while (_events.peek(event)) {
+    const char* topic = _events.getTopic(event.topicId);
+    if (!publish(topic, event.data, event.length, _events.getRetain(event.topicId), 0)) {
+      _events.recordFailed();
+      return;
+    }
+    _events.pop();
+    _events.recordPublished(micros() - event.timestamp);
+  }
+}
+
+// time a single run of the user callback
+void ESPHelper::runCallback(char* topic, uint8_t* payload, unsigned int length) {
+  if (!_mqttCallbackSet)
+    return;
+
+  uint32_t start = micros();
+  _mqttCallback(topic, payload, length);
+  uint32_t elapsed = micros() - start;
+
+  _inbound.recordHandler(elapsed);
+  if (_topicStats.isEnabled())
+    _topicStats.recordHandler(statsKey(topic), elapsed);
+}
+
+// set the function that receives payloads too large for the MQTT client's buffer.
+// It is called once per chunk (straight from the socket, never queued) with the topic,
+// the offset of the chunk in the payload, the chunk, its length and the total payload length
+void ESPHelper::setMQTTStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE) {
+  _streamCallback = callback;
+  _streamCallbackSet = true;
+  _transport->setStreamCallback(_streamCallback);
+}
+
+// stream every PUBLISH packet larger than [packetSize] bytes instead of only
+// the ones that don't fit in the MQTT client
+void ESPHelper::setStreamThreshold(uint32_t packetSize) {
+  _streamThreshold = packetSize;
+  _transport->setStreamThreshold(packetSize);
+}
+
+// start copying inbound messages into a ring of [slots] messages instead of
+// running the callback inside the MQTT loop. [policy] decides what to drop when it is full.
+// Messages too big for a slot (INBOUND_TOPIC_SIZE / INBOUND_PAYLOAD_SIZE) still run
+// the callback inside the MQTT loop
+// true on: queue allocated
+// false on: queue could not be allocated (callback keeps running inline)
+bool ESPHelper::enableInboundQueue(uint8_t slots, uint8_t policy) {
+  return _inbound.begin(slots, policy);
+}
+
+// go back to running the callback inside the MQTT loop
+// (anything still queued is dispatched first)
+void ESPHelper::disableInboundQueue() {
+  inboundMessage msg;
+  while (_inbound.pop(msg))
+    runCallback(msg.topic, msg.payload, msg.length);
+  _inbound.end();
+}
+
+// set how long (in microseconds) loop() may spend running queued handlers
+void ESPHelper::setInboundBudget(uint32_t budgetMicros) {
+  _inboundBudget = budgetMicros;
+}
+
+// return the queue / handler counters
+inboundStats ESPHelper::getInboundStats() {
+  return _inbound.getStats();
+}
+
 // legacy funtion - here for compatibility.
 // Sets the callback function for MQTT (see function above)
 bool ESPHelper::setCallback(MQTT_CALLBACK_SIGNATURE) {
@@ -674,7 +1585,7 @@ void ESPHelper::reconnect() {
       // attempt to connect to MQTT when we finally get connected to Wi-Fi
       if (_mqttSet) {
         static int timeout = 0;  // allow a max of 5 MQTT connection attempts before timing out
-        if (!client.connected() && timeout < 5) {
+        if (!_transport->connected() && timeout < 5) {
           // debugPrint("Attemping MQTT connection");  // Debug Print
           int connected = 0;
 
@@ -688,7 +1599,7 @@ void ESPHelper::reconnect() {
             // debugPrintln(String("\t Will QOS: " + String(_currentNet.willQoS)));  // Debug Print
             // debugPrintln(String("\t Will Retain?: " + String(_currentNet.willRetain)));  // Debug Print
             // debugPrintln(String("\t Will Message: " + String(_currentNet.willMessage)));  // Debug Print
-            connected = client.connect((char*) _clientName.c_str(),
+            connected = _transport->connect((char*) _clientName.c_str(),
                                        _currentNet.mqttUser,
                                        _currentNet.mqttPass,
                                        _currentNet.willTopic,
@@ -705,7 +1616,9 @@ void ESPHelper::reconnect() {
             // debugPrintln(String("\t Will QOS: " + String(_currentNet.willQoS)));  // Debug Print
             // debugPrintln(String("\t Will Retain?: " + String(_currentNet.willRetain)));  // Debug Print
             // debugPrintln(String("\t Will Message: " + String(_currentNet.willMessage)));  // Debug Print
-            connected = client.connect((char*) _clientName.c_str(),
+            connected = _transport->connect((char*) _clientName.c_str(),
+                                       NULL,
+                                       NULL,
                                        _currentNet.willTopic,
                                        (int) _currentNet.willQoS,
                                        _currentNet.willRetain,
@@ -715,13 +1628,15 @@ void ESPHelper::reconnect() {
             // debugPrintln(String("\t Client Name: " + String(_clientName.c_str())));  // Debug Print
             // debugPrintln(String("\t User Name: " + String(_currentNet.mqttUser)));  // Debug Print
             // debugPrintln(String("\t Password: " + String(_currentNet.mqttPass)));  // Debug Print
-            connected = client.connect((char*) _clientName.c_str(),
+            connected = _transport->connect((char*) _clientName.c_str(),
                                        _currentNet.mqttUser,
-                                       _currentNet.mqttPass);
+                                       _currentNet.mqttPass,
+                                       NULL, 0, false, NULL);
           } else {
             // debugPrintln(" - Using default");  // Debug Print
             // debugPrintln(String("\t Client Name: " + String(_clientName.c_str())));  // Debug Print
-            connected = client.connect((char*) _clientName.c_str());
+            connected = _transport->connect((char*) _clientName.c_str(),
+                                            NULL, NULL, NULL, 0, false, NULL);
           }
 
           // if connected, subscribe to the topic(s) we want to be notified about
@@ -740,7 +1655,14 @@ void ESPHelper::reconnect() {
             }
 
             _connectionStatus = FULL_CONNECTION;
+            _connectedSince = millis();
             resubscribe();
+            if (_shadow)
+              _shadow->markAll();
+            _mqttUpdate.resume();
+            if (_rttTopic != NULL)
+              _transport->subscribe(_rttTopic, 0);
+            primeValueCache();
             timeout = 0;
           } else {
             // debugPrintln(" -- Failed");  // Debug Print
@@ -749,7 +1671,7 @@ void ESPHelper::reconnect() {
         }
 
         // if we still can't connect to MQTT after 10 attempts increment the try count
-        if (timeout >= 5 && !client.connected()) {
+        if (timeout >= 5 && !_transport->connected()) {
           timeout = 0;
           tryCount++;
           if (tryCount == 20) {
@@ -781,7 +1703,7 @@ int ESPHelper::setConnectionStatus() {
       returnVal = WIFI_ONLY;
 
       // if MQTT is connected as well then set the status to full connection
-      if (client.connected())
+      if (_transport->connected())
         returnVal = FULL_CONNECTION;
     }
   } else {
@@ -877,9 +1799,9 @@ void ESPHelper::updateNetwork() {
   // debugPrintln("\tSetting new MQTT server");  // Debug Print
   // setup the MQTT broker info
   if (_mqttSet)
-    client.setServer(_currentNet.mqttHost, _currentNet.mqttPort);
+    _transport->setServer(_currentNet.mqttHost, _currentNet.mqttPort);
   else
-    client.setServer("192.0.2.0", 1883);
+    _transport->setServer("192.0.2.0", 1883);
 
   // debugPrintln("\tDone - Ready for next reconnect attempt");  // Debug Print
 }
@@ -1033,12 +1955,257 @@ void ESPHelper::setHopping(bool canHop) {
 }
 
 // DEBUG ONLY - print the subscribed topics list to the serial line
+// (followed by the per-topic stats if they are enabled)
 void ESPHelper::listSubscriptions() {
   for(int i = 0; i < MAX_SUBSCRIPTIONS; i++){
     if(_subscriptions[i].isUsed){
       // debugPrintln(_subscriptions[i].topic);  // Debug Print
     }
   }
+  #ifdef DEBUG
+    printTopicStats(Serial);
+  #endif
+}
+
+// start counting messages, bytes and handler time per topic in a table of [entries] topics
+// true on: table allocated
+// false on: table could not be allocated
+bool ESPHelper::enableTopicStats(uint8_t entries) {
+  return _topicStats.begin(entries);
+}
+
+// stop counting and free the table (also stops the periodic report)
+void ESPHelper::disableTopicStats() {
+  _topicStats.end();
+  _statsTopic = NULL;
+}
+
+// number of topics in the stats table
+uint8_t ESPHelper::getTopicStatsCount() {
+  return _topicStats.count();
+}
+
+// counters for one topic (NULL past the end of the table)
+const topicStats* ESPHelper::getTopicStats(uint8_t index) {
+  return _topicStats.get(index);
+}
+
+// write the stats table to [out] (Serial, a file, a web client...)
+// one line per topic: topic,msgsIn,bytesIn,msgsOut,bytesOut,msSinceLastSeen,handlerMicros,maxHandlerMicros
+void ESPHelper::printTopicStats(Print &out) {
+  _topicStats.printTo(out);
+}
+
+// publish the stats table to [topic] every [intervalMs] (one message per tracked topic
+// in the printTopicStats line format). A NULL topic stops the report.
+void ESPHelper::publishTopicStats(const char* topic, uint32_t intervalMs) {
+  _statsTopic = topic;
+  _statsInterval = intervalMs;
+  _lastStatsReport = millis();
+}
+
+// true if any subscription matches [topic]
+bool ESPHelper::isSubscribed(const char* topic) {
+  for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+    if (_subscriptions[i].isUsed && topicMatches(_subscriptions[i].topic, topic))
+      return true;
+  }
+  return false;
+}
+
+// inbound messages are counted against the first subscription they match
+// so wildcard subscriptions show up as one entry
+const char* ESPHelper::statsKey(const char* topic) {
+  for (int i = 0; i < MAX_SUBSCRIPTIONS; i++) {
+    if (_subscriptions[i].isUsed && topicMatches(_subscriptions[i].topic, topic))
+      return _subscriptions[i].topic;
+  }
+  return topic;
+}
+
+// measure the broker round trip every [intervalMs]. Without [loopbackTopic] a PINGREQ
+// is timed (transports that support ping(), e.g. ESPHelperMQTT - their keepalive pings
+// are always timed). With it a probe message is published to the topic and timed
+// until it comes back (works with any transport, the topic should be unique to the device)
+// true on: probe set up
+// false on: zero interval, or no loopback topic and a transport that can't ping
+bool ESPHelper::enableRTTProbe(uint32_t intervalMs, const char* loopbackTopic) {
+  if (intervalMs == 0)
+    return false;
+  if (loopbackTopic == NULL && !_transport->canPing())
+    return false;
+
+  disableRTTProbe();
+  _rttInterval = intervalMs;
+  _rttTopic = loopbackTopic;
+  _rttLastProbe = millis();
+  if (_rttTopic != NULL && _connectionStatus == FULL_CONNECTION)
+    _transport->subscribe(_rttTopic, 0);
+  return true;
+}
+
+void ESPHelper::disableRTTProbe() {
+  if (_rttTopic != NULL && _connectionStatus == FULL_CONNECTION)
+    _transport->unsubscribe(_rttTopic);
+  _rttInterval = 0;
+  _rttTopic = NULL;
+  _rttProbeOutstanding = false;
+}
+
+// round trip percentiles over the last RTT_WINDOW samples (microseconds)
+rttStats ESPHelper::getRTTStats() {
+  rttStats stats = _rtt.getStats();
+  stats.keepAlive = _keepAlive;
+  return stats;
+}
+
+// let the keepalive follow the link between [minSeconds] and [maxSeconds]
+// (it takes effect on the next connection, 0/0 stops adapting it).
+// true on: keepalive adapting (or stopped with 0/0)
+// false on: the transport can't set the keepalive (only e.g. ESPHelperMQTT can)
+bool ESPHelper::setAdaptiveKeepAlive(uint16_t minSeconds, uint16_t maxSeconds) {
+  if (maxSeconds > 0 && !_transport->canSetKeepAlive())
+    return false;
+
+  _keepAliveMin = minSeconds > 0 ? minSeconds : 1;
+  _keepAliveMax = maxSeconds;
+  if (_keepAliveMax == 0)
+    return true;
+
+  if (_keepAlive < _keepAliveMin)
+    _keepAlive = _keepAliveMin;
+  if (_keepAlive > _keepAliveMax)
+    _keepAlive = _keepAliveMax;
+  _transport->setKeepAlive(_keepAlive);
+  return true;
+}
+
+// every PINGRESP the transport times (a ping probe is done once one arrives)
+void ESPHelper::recordRTT(uint32_t elapsedMicros) {
+  _rtt.addSample(elapsedMicros);
+  if (_rttTopic == NULL)
+    _rttProbeOutstanding = false;
+}
+
+// start the next probe - a probe still outstanding by now counts as lost
+void ESPHelper::probeRTT() {
+  _rttLastProbe = millis();
+  if (_rttProbeOutstanding)
+    _rtt.addTimeout();
+
+  if (_rttTopic != NULL) {
+    _rttProbeSent = micros();
+    _rttProbeOutstanding = _transport->publish(_rttTopic, (const uint8_t*)&_rttProbeSent,
+                                               sizeof(_rttProbeSent), false, 0);
+  } else {
+    _rttProbeOutstanding = _transport->ping();
+  }
+}
+
+// keepalive for the next connection: halved when a connection is lost (NAT boxes
+// dropping idle connections), a quarter longer after RTT_STABLE_PERIODS quiet periods,
+// but never below RTT_KEEPALIVE_FACTOR x the p99 round trip
+void ESPHelper::adaptKeepAlive(bool connectionLost) {
+  if (_keepAliveMax == 0)
+    return;
+
+  uint32_t next = connectionLost ? _keepAlive / 2 : _keepAlive + (_keepAlive + 3) / 4;
+  uint32_t rttFloor = ((uint64_t)_rtt.percentile(99) * RTT_KEEPALIVE_FACTOR + 999999) / 1000000;
+
+  if (next < _keepAliveMin)
+    next = _keepAliveMin;
+  if (next < rttFloor)
+    next = rttFloor;
+  if (next > _keepAliveMax)
+    next = _keepAliveMax;
+
+  if (next != _keepAlive) {
+    _keepAlive = next;
+    _transport->setKeepAlive(_keepAlive);
+  }
+}
+
+// replace the local rules with the ones in a JSON file (format in ESPHelperRules.h)
+// true on: all rules compiled
+// false on: file missing / unreadable or a bad rule (no rules are active then)
+bool ESPHelper::loadRules(const char* filename) {
+  if (!ESPHelperFS::begin())
+    return false;
+  bool loaded = ESPHelperFS::loadRules(filename, _rules);
+  ESPHelperFS::end();
+  return loaded;
+}
+
+void ESPHelper::clearRules() {
+  _rules.clear();
+}
+
+// the rule table with its counters
+ESPHelperRules* ESPHelper::getRules() {
+  return &_rules;
+}
+
+// run an MQTT broker on [port] whenever the device is in broadcastMode() so devices
+// that join its access point can talk to each other and to this one. publish() goes
+// to the broker while broadcasting and client messages matching this device's
+// subscriptions reach the MQTT callback
+// true on: broker enabled (and started if already broadcasting)
+// false on: broker could not be started
+bool ESPHelper::enableBroker(uint16_t port) {
+  _brokerEnabled = true;
+  _brokerPort = port;
+  if (_connectionStatus == BROADCAST)
+    return _broker.begin(port);
+  return true;
+}
+
+void ESPHelper::disableBroker() {
+  _brokerEnabled = false;
+  _broker.end();
+}
+
+// the broker for its counters
+ESPHelperBroker* ESPHelper::getBroker() {
+  return &_broker;
+}
+
+// publish the stats table (the report itself is not counted)
+void ESPHelper::reportTopicStats() {
+  char line[INBOUND_TOPIC_SIZE + 96];
+  for (uint8_t i = 0; i < _topicStats.count(); i++) {
+    _topicStats.formatEntry(i, line, sizeof(line));
+    _transport->publish(_statsTopic, (const uint8_t*)line, strlen(line), false, 0);
+    yield();
+  }
+  _lastStatsReport = millis();
+}
+
+// check whether a topic matches a subscription filter (supports the + and # wildcards)
+bool ESPHelper::topicMatches(const char* filter, const char* topic) {
+  while (*filter && *topic) {
+    if (*filter == '#')
+      return true;
+
+    if (*filter == '+') {
+      // skip one whole level of the topic
+      while (*topic && *topic != '/')
+        topic++;
+      filter++;
+      continue;
+    }
+
+    if (*filter != *topic)
+      return false;
+    filter++;
+    topic++;
+  }
+
+  // "a/#" also matches "a" itself and "a/+" matches an empty last level
+  if (*filter == '/' && filter[1] == '#' && filter[2] == '\0')
+    return true;
+  if (*filter == '+' && filter[1] == '\0')
+    return true;
+  return *filter == *topic || (*filter == '#' && filter[1] == '\0');
 }
 
 // enable the connection heartbeat on a given pin
@@ -33,10 +33,33 @@ Refactoring by Suren Khorenyan
 #include <ArduinoOTA.h>
 #include <PubSubClient.h>
 #include <WiFiClientSecure.h>
+#include <memory>
 #include "sharedData.h"
+#include "ESPHelperInbound.h"
+#include "ESPHelperTransport.h"
+#include "ESPHelperPubSub.h"
+#include "ESPHelperMQTT.h"
+#include "ESPHelperMQTTSN.h"
+#include "ESPHelperStats.h"
+#include "ESPHelperRTT.h"
+#include "ESPHelperRules.h"
+#include "ESPHelperBroker.h"
+#include "ESPHelperEvents.h"
+#include "ESPHelperGPIO.h"
+#include "ESPHelperSensor.h"
+#include "ESPHelperAggregate.h"
+#include "ESPHelperCBOR.h"
+#include "ESPHelperText.h"
+#include "ESPHelperTopics.h"
+#include "ESPHelperShadow.h"
+#include "ESPHelperOTAMonitor.h"
+#include "ESPHelperHTTPUpdate.h"
+#include "ESPHelperMQTTUpdate.h"
 
 #include <Metro.h>
 
+class ESPHelperWebConfig;
+
 // #define DEBUG
 
 #ifdef DEBUG
@@ -154,17 +177,122 @@ class ESPHelper {
 
     bool subscribe(const char* topic, int qos);
     bool addSubscription(const char* topic);
+    int8_t addCachedSubscription(const char* topic, uint16_t maxLength);
+    int8_t findSubscription(const char* topic);
+    const char* getCachedValue(int8_t handle);
+    uint16_t getCachedLength(int8_t handle);
+    uint32_t getCachedSequence(int8_t handle);
     bool removeSubscription(const char* topic);
     bool unsubscribe(const char* topic);
 
     void publish(const char* topic, const char* payload);
     void publish(const char* topic, const char* payload, bool retain);
+    bool publish(const char* topic,
+                 const uint8_t* payload,
+                 unsigned int length,
+                 bool retain,
+                 uint8_t qos = 0);
+
+    bool beginPublish(const char* topic, unsigned int length, bool retain);
+    size_t writePayload(const uint8_t* buf, size_t size);
+    bool endPublish();
+    bool publishCBOR(const char* topic, std::function<void(ESPHelperCBORWriter&)> build,
+                     bool retain = false, uint8_t qos = 0);
+
+    // UDP publishing through an MQTT-SN gateway (see ESPHelperMQTTSN)
+    bool enableMQTTSN(const char* gatewayHost = NULL, uint16_t port = MQTTSN_PORT, bool connect = true);
+    void disableMQTTSN();
+    bool addMQTTSNTopic(const char* topic, uint16_t topicId);
+    bool publishSN(const char* topic, const uint8_t* payload, unsigned int length, int8_t qos = -1);
+    bool publishSN(uint16_t topicId, const uint8_t* payload, unsigned int length, int8_t qos = -1);
+    ESPHelperMQTTSN* getMQTTSN();
 
     bool setCallback(MQTT_CALLBACK_SIGNATURE);
     void setMQTTCallback(MQTT_CALLBACK_SIGNATURE);
 
     void setWifiCallback(void (*callback)());
 
+    // swap the MQTT client (see ESPHelperTransport)
+    void setTransport(ESPHelperTransport &transport);
+    ESPHelperTransport* getTransport();
+
+    // defer the MQTT callback out of the MQTT loop (see ESPHelperInbound)
+    bool enableInboundQueue(uint8_t slots = INBOUND_QUEUE_SLOTS, uint8_t policy = DROP_NEWEST);
+    void disableInboundQueue();
+    void setInboundBudget(uint32_t budgetMicros);
+    inboundStats getInboundStats();
+
+    // receive payloads too large for the MQTT client in chunks (see ESPHelperStreamClient)
+    void setMQTTStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE);
+    void setStreamThreshold(uint32_t packetSize);
+
+    // publish from interrupt handlers (see ESPHelperEvents)
+    bool enableEvents(uint8_t slots = EVENT_QUEUE_SLOTS);
+    void disableEvents();
+    int8_t addEventTopic(const char* topic, bool retain = false);
+    bool queueEvent(uint8_t topicId, const uint8_t* data, uint8_t length);
+    bool queueEvent(uint8_t topicId, const char* data);
+    eventStats getEventStats();
+
+    // publish debounced input changes (see ESPHelperGPIO)
+    int8_t watchPin(uint8_t pin,
+                    const char* topic,
+                    uint8_t flags = 0,
+                    uint16_t debounceMs = WATCH_DEBOUNCE,
+                    const char* highPayload = "1",
+                    const char* lowPayload = "0");
+    void unwatchPins();
+    ESPHelperGPIO* getPinWatcher();
+
+    // sensors measured in the background of loop() (see ESPHelperSensor)
+    int8_t addSensor(ESPHelperSensor &sensor,
+                     const char* topic,
+                     uint32_t intervalMs,
+                     uint8_t decimals = 1,
+                     bool retain = false);
+    void setSensorCallback(std::function<void(int8_t, float)> callback);
+    float getSensorValue(int8_t handle);
+    ESPHelperSensors* getSensors();
+
+    // min/max/mean/last/count of a series published once per window (see ESPHelperAggregate)
+    int8_t addSeries(const char* topic, uint32_t windowMs, uint8_t decimals = 2);
+    bool addSample(int8_t series, float value);
+    bool addSample(const char* topic, float value);
+    seriesWindow getSeriesWindow(int8_t series);
+    ESPHelperAggregate* getAggregate();
+
+    // topics built from templates like makeTopic("home/{device}/status") and used by handle
+    int8_t addTopic(const topicTemplate &topic);
+    void setTopicPrefix(const char* prefix);
+    const char* getTopic(int8_t handle);
+    bool publishTopic(int8_t handle, const char* payload, bool retain = false);
+    bool publishTopic(int8_t handle, const uint8_t* payload, unsigned int length, bool retain, uint8_t qos = 0);
+    bool subscribeTopic(int8_t handle);
+
+    // device state reported as deltas and set from desired state (see ESPHelperShadow)
+    bool enableShadow(const char* reportedTopic, const char* desiredTopic, bool retain = false);
+    void disableShadow();
+    void setShadowCallback(std::function<void(int8_t)> callback);
+    ESPHelperShadow* getShadow();
+
+    // OTA progress/throughput/errors (see ESPHelperOTAMonitor)
+    void publishOTAReport(const char* topic, bool retain = false);
+    void setOTACallback(std::function<void(uint8_t, const otaReport&)> callback);
+    otaReport getOTAReport();
+    ESPHelperOTAMonitor* getOTAMonitor();
+    void setOTAMaintenance(bool enable, ESPHelperWebConfig* webConfig = NULL);
+    void setMaintenanceCallback(std::function<void(bool)> callback);
+    bool inMaintenance();
+
+    // pull a firmware image over HTTP (see ESPHelperHTTPUpdate)
+    bool startHTTPUpdate(const char* url, const char* md5 = NULL);
+    bool enableHTTPUpdate(const char* commandTopic);
+    ESPHelperHTTPUpdate* getHTTPUpdate();
+
+    // receive a firmware image in chunks over MQTT (see ESPHelperMQTTUpdate)
+    bool enableMQTTUpdate(const char* updateTopic, const char* statusTopic);
+    ESPHelperMQTTUpdate* getMQTTUpdate();
+
     void reconnect();
 
     // manually disconnect and reconnecting to network/mqtt using current values
@@ -206,6 +334,32 @@ class ESPHelper {
 
     void listSubscriptions();
 
+    static bool topicMatches(const char* filter, const char* topic);
+
+    // per-topic traffic and handler time (see ESPHelperStats)
+    bool enableTopicStats(uint8_t entries = TOPIC_STATS_SIZE);
+    void disableTopicStats();
+    uint8_t getTopicStatsCount();
+    const topicStats* getTopicStats(uint8_t index);
+    void printTopicStats(Print &out);
+    void publishTopicStats(const char* topic, uint32_t intervalMs);
+
+    // broker round trip time and keepalive (see ESPHelperRTT)
+    bool enableRTTProbe(uint32_t intervalMs = RTT_PROBE_INTERVAL, const char* loopbackTopic = NULL);
+    void disableRTTProbe();
+    rttStats getRTTStats();
+    bool setAdaptiveKeepAlive(uint16_t minSeconds, uint16_t maxSeconds);
+
+    // local reactions to messages and inputs (see ESPHelperRules)
+    bool loadRules(const char* filename);
+    void clearRules();
+    ESPHelperRules* getRules();
+
+    // MQTT broker for clients of broadcastMode() (see ESPHelperBroker)
+    bool enableBroker(uint16_t port = 1883);
+    void disableBroker();
+    ESPHelperBroker* getBroker();
+
     void enableHeartbeat(int16_t pin);
     void disableHeartbeat();
     void heartbeat();
@@ -244,12 +398,36 @@ class ESPHelper {
     bool checkParams();
 
     void resubscribe();
+    void primeValueCache();
+    void updateValueCache(const char* topic, const uint8_t* payload, unsigned int length);
+
+    int networkLoop();
+    void publishEvents();
+
+    void mqttReceive(char* topic, uint8_t* payload, unsigned int length);
+    void dispatchInbound();
+    void runCallback(char* topic, uint8_t* payload, unsigned int length);
+    const char* statsKey(const char* topic);
+    bool isSubscribed(const char* topic);
+    void reportTopicStats();
+    void recordRTT(uint32_t elapsedMicros);
+    void probeRTT();
+    void adaptKeepAlive(bool connectionLost);
 
     int setConnectionStatus();
 
+    void setupTransport();
+    void expandTopics();
+    void sendOTAReport();
+    void enterMaintenance();
+    void exitMaintenance();
+    void runHTTPUpdate();
+    void runMQTTUpdate();
+
     netInfo _currentNet;
 
-    PubSubClient client;
+    ESPHelperPubSub _pubSub;
+    ESPHelperTransport *_transport = &_pubSub;
 
     Metro reconnectMetro = Metro(500);
 
@@ -266,6 +444,15 @@ class ESPHelper {
     std::function<void(char*, uint8_t*, unsigned int)> _mqttCallback;
     bool _mqttCallbackSet = false;
 
+    std::function<void(char*, unsigned int, uint8_t*, unsigned int, unsigned int)> _streamCallback;
+    bool _streamCallbackSet = false;
+    uint32_t _streamThreshold = 0;
+
+    ESPHelperMQTTSN _mqttsn;
+
+    ESPHelperInbound _inbound;
+    uint32_t _inboundBudget = INBOUND_DISPATCH_BUDGET;
+
     int _connectionStatus = NO_CONNECTION;
 
     // AP mode variables
@@ -299,7 +486,64 @@ class ESPHelper {
 
     subscription _subscriptions[MAX_SUBSCRIPTIONS];
 
-    char _hostname[64];
+    ESPHelperStats _topicStats;
+    const char* _statsTopic = NULL;
+    uint32_t _statsInterval = 0;
+    unsigned long _lastStatsReport = 0;
+
+    ESPHelperRules _rules;
+
+    ESPHelperEvents _events;
+    ESPHelperGPIO _gpio;
+    ESPHelperSensors _sensors;
+    ESPHelperAggregate _aggregate;
+
+    ESPHelperTopics _topics;
+    const char* _topicPrefix = NULL;
+
+    // only allocated once the shadow is used (getShadow / enableShadow)
+    std::unique_ptr<ESPHelperShadow> _shadow;
+
+    ESPHelperOTAMonitor _otaMonitor;
+    const char* _otaReportTopic = NULL;
+    bool _otaReportRetain = false;
+
+    bool _otaMaintenance = true;
+    bool _maintenance = false;
+    ESPHelperWebConfig* _maintenanceWebConfig = NULL;
+    std::function<void(bool)> _maintenanceCallback;
+    bool _maintenanceCallbackSet = false;
+
+    ESPHelperHTTPUpdate _httpUpdate;
+    const char* _httpUpdateTopic = NULL;
+    char _httpUpdateURL[HTTP_UPDATE_URL_SIZE];
+    char _httpUpdateMD5[33];
+    bool _httpUpdateRequested = false;
+
+    ESPHelperMQTTUpdate _mqttUpdate;
+    const char* _mqttUpdateTopic = NULL;
+
+    ESPHelperBroker _broker;
+    bool _brokerEnabled = false;
+    uint16_t _brokerPort = 1883;
+
+    ESPHelperRTT _rtt;
+    uint32_t _rttInterval = 0;
+    const char* _rttTopic = NULL;
+    unsigned long _rttLastProbe = 0;
+    uint32_t _rttProbeSent = 0;
+    bool _rttProbeOutstanding = false;
+
+    uint16_t _keepAlive = MQTT_KEEPALIVE;
+    uint16_t _keepAliveMin = 0;
+    uint16_t _keepAliveMax = 0;
+    unsigned long _connectedSince = 0;
+
+    // only allocated by the first addCachedSubscription()
+    std::unique_ptr<char[]> _valueCache;
+    uint16_t _valueCacheUsed = 0;
+
+    char _hostname[64] = "";
 
     int _qos = DEFAULT_QOS;
 
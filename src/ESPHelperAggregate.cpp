@@ -0,0 +1,189 @@
+/*
+ESPHelperAggregate.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperAggregate.h"
+
+
+static const uint32_t powersOf10[SERIES_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+
+ESPHelperAggregate::ESPHelperAggregate() {
+}
+
+
+// start a series published to [topic] every [windowMs]. [decimals] is the fixed point
+// precision (values must stay within +-2^31 / 10^decimals). The topic is not copied
+// returns the index of the series or -1 if MAX_SERIES series exist
+int8_t ESPHelperAggregate::add(const char* topic, uint32_t windowMs, uint8_t decimals) {
+  if (_count == MAX_SERIES || topic == NULL || windowMs == 0)
+    return -1;
+
+  aggregateSeries &series = _series[_count];
+  series = aggregateSeries();
+  series.topic = topic;
+  series.window = windowMs;
+  series.decimals = decimals > SERIES_MAX_DECIMALS ? SERIES_MAX_DECIMALS : decimals;
+  series.windowStart = millis();
+  restart(series);
+  return _count++;
+}
+
+
+// index of the series for [topic] or -1
+int8_t ESPHelperAggregate::find(const char* topic) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (strcmp(_series[i].topic, topic) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+void ESPHelperAggregate::clear() {
+  _count = 0;
+}
+
+
+// add a sample (rounded to the series' decimals)
+// true on: sample counted
+// false on: no such series
+bool ESPHelperAggregate::addSample(int8_t index, float value) {
+  if (index < 0 || index >= _count)
+    return false;
+
+  float scaled = value * powersOf10[_series[index].decimals];
+  return addScaledSample(index, (int32_t)(scaled + (scaled >= 0 ? 0.5f : -0.5f)));
+}
+
+
+// add a sample that is already scaled by 10^decimals (no float math at all)
+bool ESPHelperAggregate::addScaledSample(int8_t index, int32_t value) {
+  if (index < 0 || index >= _count)
+    return false;
+
+  aggregateSeries &series = _series[index];
+  if (series.count == 0 || value < series.min)
+    series.min = value;
+  if (series.count == 0 || value > series.max)
+    series.max = value;
+  series.last = value;
+  series.sum += value;
+  series.count++;
+  return true;
+}
+
+
+// the function windows are published with (topic, payload, retain)
+void ESPHelperAggregate::setPublisher(std::function<void(const char*, const char*, bool)> publisher) {
+  _publisher = publisher;
+  _publisherSet = true;
+}
+
+
+// close and publish the windows that are over
+void ESPHelperAggregate::loop() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < _count; i++) {
+    aggregateSeries &series = _series[i];
+    if (now - series.windowStart < series.window)
+      continue;
+
+    // stay on the window grid even if loop() was late
+    series.windowStart += series.window;
+    if (now - series.windowStart >= series.window)
+      series.windowStart = now;
+    close(series);
+  }
+}
+
+
+uint8_t ESPHelperAggregate::count() {
+  return _count;
+}
+
+
+// series at [index] (settings, running window and last closed window) or NULL
+const aggregateSeries* ESPHelperAggregate::get(uint8_t index) {
+  if (index >= _count)
+    return NULL;
+  return &_series[index];
+}
+
+
+// the last window that closed for the series at [index] (count is 0 if there was none)
+seriesWindow ESPHelperAggregate::getWindow(uint8_t index) {
+  if (index >= _count)
+    return seriesWindow();
+  return _series[index].closed;
+}
+
+
+// write a window as "min,max,mean,last,count"
+// returns the length written (or -1 if it did not fit)
+int ESPHelperAggregate::formatWindow(const seriesWindow &window, uint8_t decimals, char* buf, size_t size) {
+  const int32_t values[4] = {window.min, window.max, window.mean, window.last};
+  size_t pos = 0;
+
+  for (uint8_t i = 0; i < 4; i++) {
+    int len = ESPHelperText::formatFixed(values[i], decimals, &buf[pos], size - pos);
+    if (len < 0 || pos + len + 1 >= size)
+      return -1;
+    pos += len;
+    buf[pos++] = ',';
+  }
+
+  int len = ESPHelperText::formatUInt(window.count, &buf[pos], size - pos);
+  return len < 0 ? -1 : pos + len;
+}
+
+
+void ESPHelperAggregate::close(aggregateSeries &series) {
+  if (series.count == 0)
+    return;
+
+  // mean rounded to the nearest step
+  int64_t half = series.count / 2;
+  int64_t mean = (series.sum >= 0 ? series.sum + half : series.sum - half) / (int64_t)series.count;
+
+  series.closed.min = series.min;
+  series.closed.max = series.max;
+  series.closed.mean = (int32_t)mean;
+  series.closed.last = series.last;
+  series.closed.count = series.count;
+  series.windows++;
+  restart(series);
+
+  if (_publisherSet) {
+    char payload[80];
+    if (formatWindow(series.closed, series.decimals, payload, sizeof(payload)) > 0)
+      _publisher(series.topic, payload, false);
+  }
+}
+
+
+void ESPHelperAggregate::restart(aggregateSeries &series) {
+  series.min = 0;
+  series.max = 0;
+  series.last = 0;
+  series.sum = 0;
+  series.count = 0;
+}
@@ -0,0 +1,72 @@
+/*
+ESPHelperAggregate.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_AGGREGATE_H
+#define ESPHELPER_AGGREGATE_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+#include "ESPHelperText.h"
+
+
+// Downsamples fast sensor readings into one message per window.
+// Every series keeps min, max, sum, last and count of the samples pushed to it in
+// fixed point (value * 10^decimals), so adding a sample is a few integer operations.
+// When the window is over loop() publishes "min,max,mean,last,count" to the series
+// topic (e.g. "20.50,22.10,21.31,21.90,600") and starts the next window.
+// Windows without samples are not published.
+class ESPHelperAggregate {
+
+  public:
+
+    ESPHelperAggregate();
+
+    int8_t add(const char* topic, uint32_t windowMs, uint8_t decimals);
+    int8_t find(const char* topic);
+    void clear();
+
+    bool addSample(int8_t index, float value);
+    bool addScaledSample(int8_t index, int32_t value);
+
+    void setPublisher(std::function<void(const char*, const char*, bool)> publisher);
+
+    void loop();
+
+    uint8_t count();
+    const aggregateSeries* get(uint8_t index);
+    seriesWindow getWindow(uint8_t index);
+
+    static int formatWindow(const seriesWindow &window, uint8_t decimals, char* buf, size_t size);
+
+  private:
+
+    void close(aggregateSeries &series);
+    void restart(aggregateSeries &series);
+
+    aggregateSeries _series[MAX_SERIES];
+    uint8_t _count = 0;
+
+    std::function<void(const char*, const char*, bool)> _publisher;
+    bool _publisherSet = false;
+};
+
+#endif
@@ -0,0 +1,591 @@
+/*
+ESPHelperBroker.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperBroker.h"
+#include "ESPHelper.h"
+
+
+ESPHelperBroker::ESPHelperBroker() {
+}
+
+
+// allocate the client slots and retained arena and start listening on [port]
+// true on: broker running
+// false on: allocation failed
+bool ESPHelperBroker::begin(uint16_t port) {
+  end();
+
+  _clients.reset(new brokerClient[BROKER_CLIENTS]);
+  _retained.reset(new uint8_t[BROKER_RETAINED_SIZE]);
+  _server.reset(new WiFiServer(port));
+  if (!_clients || !_retained || !_server) {
+    end();
+    return false;
+  }
+
+  _retainedUsed = 0;
+  _stats = brokerStats();
+  _server->begin();
+  _server->setNoDelay(true);
+  return true;
+}
+
+
+// disconnect every client and release all memory (retained messages are lost)
+void ESPHelperBroker::end() {
+  if (_clients) {
+    for (uint8_t i = 0; i < BROKER_CLIENTS; i++)
+      _clients[i].client.stop();
+  }
+  if (_server)
+    _server->stop();
+
+  _server.reset();
+  _clients.reset();
+  _retained.reset();
+  _retainedUsed = 0;
+}
+
+
+bool ESPHelperBroker::isRunning() {
+  return _server.get() != NULL;
+}
+
+
+// accept new clients, handle whatever the connected ones have sent and drop the silent ones
+void ESPHelperBroker::loop() {
+  if (!_server)
+    return;
+
+  accept();
+
+  uint8_t connected = 0;
+  for (uint8_t i = 0; i < BROKER_CLIENTS; i++) {
+    brokerClient &c = _clients[i];
+    if (!c.client.connected()) {
+      if (c.active)
+        drop(c);
+      continue;
+    }
+
+    readClient(c);
+
+    // clients get MQTT_CONNECT_TIMEOUT to send CONNECT and 1.5x their keepalive after that
+    unsigned long limit = c.active ? c.keepAlive * 1500UL : MQTT_CONNECT_TIMEOUT;
+    if (limit > 0 && millis() - c.lastIn > limit)
+      drop(c);
+
+    if (c.active)
+      connected++;
+  }
+  _stats.clients = connected;
+}
+
+
+// publish from this device - routed to the subscribed clients and kept if [retain] is set
+// (not handed to the local callback)
+// true on: message routed
+// false on: broker not running or the topic contains wildcards
+bool ESPHelperBroker::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain, uint8_t qos) {
+  if (!_server || topic == NULL || topic[0] == '\0' || strpbrk(topic, "+#") != NULL)
+    return false;
+
+  if (retain)
+    storeRetained(topic, payload, length);
+  route(topic, payload, length, qos > 1 ? 1 : qos);
+  return true;
+}
+
+
+// every message published by a client is also passed to this callback
+// (the payload may be null terminated in place like with the regular MQTT callback)
+void ESPHelperBroker::setLocalCallback(MQTT_CALLBACK_SIGNATURE) {
+  _localCallback = callback;
+  _localCallbackSet = true;
+}
+
+
+brokerStats ESPHelperBroker::getStats() {
+  _stats.retainedUsed = _retainedUsed;
+  return _stats;
+}
+
+
+// bytes allocated in begin() for each client slot
+size_t ESPHelperBroker::clientMemory() {
+  return sizeof(brokerClient);
+}
+
+
+// hand a new connection the first free slot (or turn it away when all are taken)
+void ESPHelperBroker::accept() {
+  WiFiClient incoming = _server->available();
+  if (!incoming)
+    return;
+
+  for (uint8_t i = 0; i < BROKER_CLIENTS; i++) {
+    brokerClient &c = _clients[i];
+    if (c.client.connected())
+      continue;
+
+    c.client = incoming;
+    c.active = false;
+    c.keepAlive = 0;
+    c.lastIn = millis();
+    c.packetId = 0;
+    c.rxState = RX_TYPE;
+    c.subCount = 0;
+    return;
+  }
+
+  _stats.refused++;
+  incoming.stop();
+}
+
+
+// read whatever the client has sent so far - never waits for the rest of a packet
+void ESPHelperBroker::readClient(brokerClient &c) {
+  int avail;
+  while ((avail = c.client.available()) > 0) {
+    switch (c.rxState) {
+
+      case RX_TYPE:
+        c.rxHeader = c.client.read();
+        c.rxRemaining = 0;
+        c.rxLengthBytes = 0;
+        c.rxPos = 0;
+        c.rxState = RX_LENGTH;
+        break;
+
+      case RX_LENGTH: {
+        uint8_t b = c.client.read();
+        c.rxRemaining |= (uint32_t)(b & 0x7F) << (7 * c.rxLengthBytes++);
+        if (b & 0x80) {
+          if (c.rxLengthBytes == 4) {
+            drop(c);
+            return;
+          }
+          break;
+        }
+
+        if (c.rxRemaining > BROKER_PACKET_SIZE) {
+          _stats.dropped++;
+          c.rxState = RX_DISCARD;
+        }
+        else if (c.rxRemaining == 0) {
+          c.rxState = RX_TYPE;
+          handlePacket(c);
+        }
+        else
+          c.rxState = RX_BODY;
+        break;
+      }
+
+      case RX_BODY: {
+        uint32_t want = c.rxRemaining - c.rxPos;
+        int got = c.client.read(&c.rx[c.rxPos], (size_t)avail < want ? avail : want);
+        if (got <= 0)
+          return;
+        c.rxPos += got;
+        if (c.rxPos == c.rxRemaining) {
+          c.rxState = RX_TYPE;
+          handlePacket(c);
+        }
+        break;
+      }
+
+      case RX_DISCARD: {
+        uint8_t scratch[64];
+        uint32_t want = c.rxRemaining - c.rxPos;
+        if (want > sizeof(scratch))
+          want = sizeof(scratch);
+        int got = c.client.read(scratch, (size_t)avail < want ? avail : want);
+        if (got <= 0)
+          return;
+        c.rxPos += got;
+        if (c.rxPos == c.rxRemaining)
+          c.rxState = RX_TYPE;
+        break;
+      }
+    }
+  }
+}
+
+
+void ESPHelperBroker::handlePacket(brokerClient &c) {
+  uint8_t type = c.rxHeader & 0xF0;
+  c.lastIn = millis();
+
+  // nothing but CONNECT is allowed before the client is accepted
+  if (!c.active && type != MQTT_CONNECT) {
+    drop(c);
+    return;
+  }
+
+  switch (type) {
+    case MQTT_CONNECT:
+      handleConnect(c, c.rx, c.rxRemaining);
+      break;
+
+    case MQTT_PUBLISH:
+      handlePublish(c, c.rx, c.rxRemaining);
+      break;
+
+    case MQTT_PUBREL:
+      if (c.rxRemaining >= 2)
+        sendPacket(c, MQTT_PUBCOMP, c.rx[0], c.rx[1]);
+      break;
+
+    case MQTT_SUBSCRIBE:
+      handleSubscribe(c, c.rx, c.rxRemaining);
+      break;
+
+    case MQTT_UNSUBSCRIBE:
+      handleUnsubscribe(c, c.rx, c.rxRemaining);
+      break;
+
+    case MQTT_PINGREQ: {
+      uint8_t resp[2] = {MQTT_PINGRESP, 0};
+      c.client.write(resp, 2);
+      break;
+    }
+
+    case MQTT_DISCONNECT:
+      drop(c);
+      break;
+
+    default:
+      // PUBACK/PUBREC/PUBCOMP - deliveries are not retried so there is nothing to clear
+      break;
+  }
+}
+
+
+// accept MQTT 3.1 and 3.1.1 clients. Sessions are always clean and will messages,
+// user names and passwords are ignored
+void ESPHelperBroker::handleConnect(brokerClient &c, uint8_t* body, uint32_t length) {
+  if (c.active || length < 10) {
+    _stats.refused++;
+    drop(c);
+    return;
+  }
+
+  uint16_t nameLen = (body[0] << 8) | body[1];
+  if (nameLen + 6u > length) {
+    _stats.refused++;
+    drop(c);
+    return;
+  }
+
+  uint8_t level = body[2 + nameLen];
+  uint16_t keepAlive = (body[4 + nameLen] << 8) | body[5 + nameLen];
+
+  if (level != 3 && level != 4) {
+    sendPacket(c, MQTT_CONNACK, 0, 1);    // unacceptable protocol version
+    _stats.refused++;
+    drop(c);
+    return;
+  }
+
+  c.active = true;
+  c.keepAlive = keepAlive;
+  c.subCount = 0;
+  sendPacket(c, MQTT_CONNACK, 0, 0);
+}
+
+
+void ESPHelperBroker::handlePublish(brokerClient &c, uint8_t* body, uint32_t length) {
+  uint8_t qos = (c.rxHeader >> 1) & 0x03;
+  bool retain = c.rxHeader & 0x01;
+  if (length < 2 || qos == 3) {
+    drop(c);
+    return;
+  }
+
+  uint16_t topicLen = (body[0] << 8) | body[1];
+  uint32_t pos = 2 + topicLen;
+  uint16_t packetId = 0;
+  if (qos > 0) {
+    if (pos + 2 > length) {
+      drop(c);
+      return;
+    }
+    packetId = (body[pos] << 8) | body[pos + 1];
+    pos += 2;
+  }
+  if (topicLen == 0 || pos > length) {
+    drop(c);
+    return;
+  }
+
+  // slide the topic over its length bytes so it can be null terminated where it lies
+  memmove(body, body + 2, topicLen);
+  body[topicLen] = '\0';
+  char* topic = (char*)body;
+  if (strpbrk(topic, "+#") != NULL) {
+    drop(c);
+    return;
+  }
+
+  uint8_t* payload = body + pos;
+  unsigned int payloadLen = length - pos;
+  _stats.messagesIn++;
+
+  if (retain)
+    storeRetained(topic, payload, payloadLen);
+
+  // QoS 2 is acknowledged as such but delivered onwards at QoS 1
+  if (qos == 1)
+    sendPacket(c, MQTT_PUBACK, packetId >> 8, packetId & 0xFF);
+  else if (qos == 2)
+    sendPacket(c, MQTT_PUBREC, packetId >> 8, packetId & 0xFF);
+
+  route(topic, payload, payloadLen, qos > 1 ? 1 : qos);
+
+  if (_localCallbackSet)
+    _localCallback(topic, payload, payloadLen);
+}
+
+
+void ESPHelperBroker::handleSubscribe(brokerClient &c, uint8_t* body, uint32_t length) {
+  if (length < 5) {
+    drop(c);
+    return;
+  }
+
+  // SUBACK return codes - a SUBSCRIBE with more filters than this is refused
+  uint8_t ack[4 + 32];
+  int8_t slots[32];
+  uint8_t count = 0;
+
+  uint32_t pos = 2;
+  while (pos < length) {
+    if (pos + 3 > length || count == sizeof(slots)) {
+      drop(c);
+      return;
+    }
+    uint16_t len = (body[pos] << 8) | body[pos + 1];
+    pos += 2;
+    if (pos + len + 1 > length) {
+      drop(c);
+      return;
+    }
+    const char* filter = (const char*)&body[pos];
+    uint8_t qos = body[pos + len] & 0x03;
+    pos += len + 1;
+
+    // replace an existing filter, otherwise take the next free one
+    int8_t slot = -1;
+    if (len > 0 && len < INBOUND_TOPIC_SIZE) {
+      for (uint8_t i = 0; i < c.subCount; i++) {
+        if (strncmp(c.subs[i], filter, len) == 0 && c.subs[i][len] == '\0') {
+          slot = i;
+          break;
+        }
+      }
+      if (slot < 0 && c.subCount < BROKER_SUBSCRIPTIONS)
+        slot = c.subCount++;
+    }
+
+    if (slot >= 0) {
+      memcpy(c.subs[slot], filter, len);
+      c.subs[slot][len] = '\0';
+      c.subQoS[slot] = qos > 1 ? 1 : qos;
+      ack[4 + count] = c.subQoS[slot];
+    }
+    else
+      ack[4 + count] = 0x80;
+    slots[count++] = slot;
+  }
+
+  ack[0] = MQTT_SUBACK;
+  ack[1] = 2 + count;
+  ack[2] = body[0];
+  ack[3] = body[1];
+  c.client.write(ack, 4 + count);
+
+  // retained messages follow the SUBACK
+  for (uint8_t i = 0; i < count; i++) {
+    if (slots[i] >= 0)
+      sendRetained(c, c.subs[slots[i]], c.subQoS[slots[i]]);
+  }
+}
+
+
+void ESPHelperBroker::handleUnsubscribe(brokerClient &c, uint8_t* body, uint32_t length) {
+  if (length < 4) {
+    drop(c);
+    return;
+  }
+
+  uint32_t pos = 2;
+  while (pos + 2 <= length) {
+    uint16_t len = (body[pos] << 8) | body[pos + 1];
+    pos += 2;
+    if (pos + len > length)
+      break;
+    const char* filter = (const char*)&body[pos];
+    pos += len;
+
+    for (uint8_t i = 0; i < c.subCount; i++) {
+      if (strncmp(c.subs[i], filter, len) == 0 && c.subs[i][len] == '\0') {
+        c.subCount--;
+        if (i != c.subCount) {
+          memcpy(c.subs[i], c.subs[c.subCount], INBOUND_TOPIC_SIZE);
+          c.subQoS[i] = c.subQoS[c.subCount];
+        }
+        break;
+      }
+    }
+  }
+
+  sendPacket(c, MQTT_UNSUBACK, body[0], body[1]);
+}
+
+
+void ESPHelperBroker::drop(brokerClient &c) {
+  c.client.stop();
+  c.active = false;
+  c.subCount = 0;
+  c.rxState = RX_TYPE;
+}
+
+
+// deliver a message once to every client with a matching filter, at the lower of the
+// publish QoS and the best QoS granted to the client's matching filters
+void ESPHelperBroker::route(const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos) {
+  for (uint8_t i = 0; i < BROKER_CLIENTS; i++) {
+    brokerClient &c = _clients[i];
+    if (!c.active)
+      continue;
+
+    int8_t best = -1;
+    for (uint8_t s = 0; s < c.subCount; s++) {
+      if ((int8_t)c.subQoS[s] > best && ESPHelper::topicMatches(c.subs[s], topic))
+        best = c.subQoS[s];
+    }
+    if (best >= 0)
+      sendPublish(c, topic, payload, length, qos < best ? qos : best, false);
+  }
+}
+
+
+void ESPHelperBroker::sendPublish(brokerClient &c, const char* topic, const uint8_t* payload,
+                                  unsigned int length, uint8_t qos, bool retain) {
+  size_t topicLen = strlen(topic);
+  uint32_t remaining = 2 + topicLen + (qos > 0 ? 2 : 0) + length;
+
+  // fixed header, topic and packet id go out in one write when the topic fits
+  uint8_t head[5 + 2 + INBOUND_TOPIC_SIZE + 2];
+  uint8_t n = 0;
+  head[n++] = MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0);
+  do {
+    uint8_t b = remaining & 0x7F;
+    remaining >>= 7;
+    if (remaining > 0)
+      b |= 0x80;
+    head[n++] = b;
+  } while (remaining > 0);
+  head[n++] = topicLen >> 8;
+  head[n++] = topicLen & 0xFF;
+
+  if (topicLen <= INBOUND_TOPIC_SIZE) {
+    memcpy(&head[n], topic, topicLen);
+    n += topicLen;
+  }
+  else {
+    c.client.write(head, n);
+    c.client.write((const uint8_t*)topic, topicLen);
+    n = 0;
+  }
+
+  if (qos > 0) {
+    if (++c.packetId == 0)
+      c.packetId = 1;
+    head[n++] = c.packetId >> 8;
+    head[n++] = c.packetId & 0xFF;
+  }
+
+  if (n > 0)
+    c.client.write(head, n);
+  if (length > 0)
+    c.client.write(payload, length);
+  _stats.messagesOut++;
+}
+
+
+// four byte packets (CONNACK, PUBACK, PUBREC, PUBCOMP, UNSUBACK)
+void ESPHelperBroker::sendPacket(brokerClient &c, uint8_t header, uint8_t b1, uint8_t b2) {
+  uint8_t packet[4] = {header, 2, b1, b2};
+  c.client.write(packet, 4);
+}
+
+
+// replace the retained message for [topic] - an empty payload just removes it
+void ESPHelperBroker::storeRetained(const char* topic, const uint8_t* payload, unsigned int length) {
+  size_t topicLen = strlen(topic);
+
+  uint16_t pos = 0;
+  while (pos < _retainedUsed) {
+    uint16_t tl = (_retained[pos] << 8) | _retained[pos + 1];
+    uint16_t pl = (_retained[pos + 2] << 8) | _retained[pos + 3];
+    uint16_t size = 4 + tl + 1 + pl;
+    if (tl == topicLen && memcmp(&_retained[pos + 4], topic, tl) == 0) {
+      memmove(&_retained[pos], &_retained[pos + size], _retainedUsed - pos - size);
+      _retainedUsed -= size;
+      break;
+    }
+    pos += size;
+  }
+
+  if (length == 0)
+    return;
+
+  uint32_t size = 4 + topicLen + 1 + length;
+  if (_retainedUsed + size > BROKER_RETAINED_SIZE) {
+    _stats.dropped++;
+    return;
+  }
+
+  uint8_t* entry = &_retained[_retainedUsed];
+  entry[0] = topicLen >> 8;
+  entry[1] = topicLen & 0xFF;
+  entry[2] = length >> 8;
+  entry[3] = length & 0xFF;
+  memcpy(&entry[4], topic, topicLen);
+  entry[4 + topicLen] = '\0';
+  memcpy(&entry[5 + topicLen], payload, length);
+  _retainedUsed += size;
+}
+
+
+void ESPHelperBroker::sendRetained(brokerClient &c, const char* filter, uint8_t qos) {
+  uint16_t pos = 0;
+  while (pos < _retainedUsed) {
+    uint16_t tl = (_retained[pos] << 8) | _retained[pos + 1];
+    uint16_t pl = (_retained[pos + 2] << 8) | _retained[pos + 3];
+    const char* topic = (const char*)&_retained[pos + 4];
+    if (ESPHelper::topicMatches(filter, topic))
+      sendPublish(c, topic, &_retained[pos + 5 + tl], pl, qos, true);
+    pos += 4 + tl + 1 + pl;
+  }
+}
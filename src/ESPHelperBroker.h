@@ -0,0 +1,109 @@
+/*
+ESPHelperBroker.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_BROKER_H
+#define ESPHELPER_BROKER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <memory>
+#include "sharedData.h"
+#include "ESPHelperMQTT.h"
+
+
+// Small MQTT 3.1.1 broker for devices that join the access point of broadcastMode().
+// Serves up to BROKER_CLIENTS clients with clean sessions only: QoS 0/1 (QoS 2
+// publishes are acknowledged and delivered at QoS 1, QoS 1 deliveries are not
+// retried), retained messages in a fixed arena and + / # wildcard subscriptions.
+// Client slots are allocated in begin() and every packet is parsed in place in
+// its client's buffer, so routing a message allocates nothing.
+class ESPHelperBroker {
+
+  public:
+
+    ESPHelperBroker();
+
+    bool begin(uint16_t port = 1883);
+    void end();
+
+    bool isRunning();
+    void loop();
+
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retain, uint8_t qos);
+
+    void setLocalCallback(MQTT_CALLBACK_SIGNATURE);
+
+    brokerStats getStats();
+    static size_t clientMemory();
+
+  private:
+
+    struct brokerClient {
+      WiFiClient client;
+      bool active = false;          // CONNECT accepted
+      uint16_t keepAlive = 0;
+      unsigned long lastIn = 0;
+      uint16_t packetId = 0;
+      uint8_t rxState = 0;
+      uint8_t rxHeader = 0;
+      uint8_t rxLengthBytes = 0;
+      uint32_t rxRemaining = 0;
+      uint32_t rxPos = 0;
+      uint8_t subCount = 0;
+      uint8_t subQoS[BROKER_SUBSCRIPTIONS];
+      char subs[BROKER_SUBSCRIPTIONS][INBOUND_TOPIC_SIZE];
+      uint8_t rx[BROKER_PACKET_SIZE + 1];   // +1 so payloads can be null terminated in place
+    };
+
+    enum rxState {RX_TYPE, RX_LENGTH, RX_BODY, RX_DISCARD};
+
+    void accept();
+    void readClient(brokerClient &c);
+    void handlePacket(brokerClient &c);
+    void handleConnect(brokerClient &c, uint8_t* body, uint32_t length);
+    void handlePublish(brokerClient &c, uint8_t* body, uint32_t length);
+    void handleSubscribe(brokerClient &c, uint8_t* body, uint32_t length);
+    void handleUnsubscribe(brokerClient &c, uint8_t* body, uint32_t length);
+    void drop(brokerClient &c);
+
+    void route(const char* topic, const uint8_t* payload, unsigned int length, uint8_t qos);
+    void sendPublish(brokerClient &c, const char* topic, const uint8_t* payload,
+                     unsigned int length, uint8_t qos, bool retain);
+    void sendPacket(brokerClient &c, uint8_t header, uint8_t b1, uint8_t b2);
+
+    void storeRetained(const char* topic, const uint8_t* payload, unsigned int length);
+    void sendRetained(brokerClient &c, const char* filter, uint8_t qos);
+
+    std::unique_ptr<WiFiServer> _server;
+    std::unique_ptr<brokerClient[]> _clients;
+
+    // retained messages: [u16 topic length][u16 payload length][topic][0][payload] ...
+    std::unique_ptr<uint8_t[]> _retained;
+    uint16_t _retainedUsed = 0;
+
+    std::function<void(char*, uint8_t*, unsigned int)> _localCallback;
+    bool _localCallbackSet = false;
+
+    brokerStats _stats;
+};
+
+#endif
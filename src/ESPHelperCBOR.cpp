@@ -0,0 +1,495 @@
+/*
+ESPHelperCBOR.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperCBOR.h"
+
+
+// CBOR major types (upper three bits of the initial byte)
+#define CBOR_MAJOR_UINT   0
+#define CBOR_MAJOR_NEGINT 1
+#define CBOR_MAJOR_BYTES  2
+#define CBOR_MAJOR_TEXT   3
+#define CBOR_MAJOR_ARRAY  4
+#define CBOR_MAJOR_MAP    5
+#define CBOR_MAJOR_TAG    6
+
+// initial bytes of the simple values and floats
+#define CBOR_SIMPLE_FALSE 0xF4
+#define CBOR_SIMPLE_TRUE  0xF5
+#define CBOR_SIMPLE_NULL  0xF6
+#define CBOR_FLOAT16      0xF9
+#define CBOR_FLOAT32      0xFA
+#define CBOR_FLOAT64      0xFB
+
+
+// counting only - nothing is written
+ESPHelperCBORWriter::ESPHelperCBORWriter() {
+}
+
+
+ESPHelperCBORWriter::ESPHelperCBORWriter(uint8_t* buf, size_t size) : _buf(buf), _size(size) {
+}
+
+
+ESPHelperCBORWriter::ESPHelperCBORWriter(Print &out) : _out(&out) {
+}
+
+
+void ESPHelperCBORWriter::addUInt(uint32_t value) {
+  writeHead(CBOR_MAJOR_UINT, value);
+}
+
+
+void ESPHelperCBORWriter::addInt(int32_t value) {
+  if (value >= 0)
+    writeHead(CBOR_MAJOR_UINT, value);
+  else
+    writeHead(CBOR_MAJOR_NEGINT, (uint32_t)(-1 - value));
+}
+
+
+// single precision float (5 bytes)
+void ESPHelperCBORWriter::addFloat(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint8_t item[5] = {CBOR_FLOAT32, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16),
+                     (uint8_t)(bits >> 8), (uint8_t)bits};
+  write(item, sizeof(item));
+}
+
+
+void ESPHelperCBORWriter::addBool(bool value) {
+  uint8_t item = value ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE;
+  write(&item, 1);
+}
+
+
+void ESPHelperCBORWriter::addNull() {
+  uint8_t item = CBOR_SIMPLE_NULL;
+  write(&item, 1);
+}
+
+
+void ESPHelperCBORWriter::addString(const char* str) {
+  addString(str, strlen(str));
+}
+
+
+void ESPHelperCBORWriter::addString(const char* str, size_t length) {
+  writeHead(CBOR_MAJOR_TEXT, length);
+  write((const uint8_t*)str, length);
+}
+
+
+void ESPHelperCBORWriter::addBytes(const uint8_t* data, size_t length) {
+  writeHead(CBOR_MAJOR_BYTES, length);
+  write(data, length);
+}
+
+
+// an array of [count] items - add them next
+void ESPHelperCBORWriter::beginArray(size_t count) {
+  writeHead(CBOR_MAJOR_ARRAY, count);
+}
+
+
+// a map of [pairs] key/value pairs - add key, value, key, value... next
+void ESPHelperCBORWriter::beginMap(size_t pairs) {
+  writeHead(CBOR_MAJOR_MAP, pairs);
+}
+
+
+// the encoded payload (NULL when writing to a Print or only counting)
+const uint8_t* ESPHelperCBORWriter::data() {
+  return _buf;
+}
+
+
+// bytes written so far (or that would have been if they had fit)
+size_t ESPHelperCBORWriter::length() {
+  return _length;
+}
+
+
+// false if the buffer was too small or the Print didn't take everything
+bool ESPHelperCBORWriter::ok() {
+  return _ok;
+}
+
+
+// initial byte plus the shortest argument that holds [value]
+void ESPHelperCBORWriter::writeHead(uint8_t major, uint32_t value) {
+  uint8_t head[5];
+  size_t len;
+
+  major <<= 5;
+  if (value < 24) {
+    head[0] = major | value;
+    len = 1;
+  }
+  else if (value <= 0xFF) {
+    head[0] = major | 24;
+    head[1] = value;
+    len = 2;
+  }
+  else if (value <= 0xFFFF) {
+    head[0] = major | 25;
+    head[1] = value >> 8;
+    head[2] = value;
+    len = 3;
+  }
+  else {
+    head[0] = major | 26;
+    head[1] = value >> 24;
+    head[2] = value >> 16;
+    head[3] = value >> 8;
+    head[4] = value;
+    len = 5;
+  }
+  write(head, len);
+}
+
+
+void ESPHelperCBORWriter::write(const uint8_t* data, size_t length) {
+  if (_out != NULL) {
+    if (_out->write(data, length) != length)
+      _ok = false;
+  }
+  else if (_buf != NULL) {
+    if (_length + length <= _size)
+      memcpy(&_buf[_length], data, length);
+    else
+      _ok = false;
+  }
+  _length += length;
+}
+
+
+
+ESPHelperCBORReader::ESPHelperCBORReader(const uint8_t* data, size_t length) : _data(data), _length(length) {
+}
+
+
+// type of the next item (CBOR_END after the last one)
+uint8_t ESPHelperCBORReader::peekType() {
+  if (_pos >= _length)
+    return CBOR_END;
+
+  uint8_t initial = _data[_pos];
+  uint8_t info = initial & 0x1F;
+  if (info == 31)
+    return CBOR_INVALID;
+
+  switch (initial >> 5) {
+    case CBOR_MAJOR_UINT:   return CBOR_UINT;
+    case CBOR_MAJOR_NEGINT: return CBOR_NEGINT;
+    case CBOR_MAJOR_BYTES:  return CBOR_BYTES;
+    case CBOR_MAJOR_TEXT:   return CBOR_TEXT;
+    case CBOR_MAJOR_ARRAY:  return CBOR_ARRAY;
+    case CBOR_MAJOR_MAP:    return CBOR_MAP;
+    case CBOR_MAJOR_TAG:    return CBOR_TAG;
+  }
+
+  if (initial == CBOR_SIMPLE_FALSE || initial == CBOR_SIMPLE_TRUE)
+    return CBOR_BOOL;
+  if (initial == CBOR_SIMPLE_NULL)
+    return CBOR_NULL;
+  if (initial == CBOR_FLOAT16 || initial == CBOR_FLOAT32 || initial == CBOR_FLOAT64)
+    return CBOR_FLOAT;
+  return CBOR_INVALID;
+}
+
+
+bool ESPHelperCBORReader::readUInt(uint32_t &value) {
+  return readHeadOf(CBOR_MAJOR_UINT, value);
+}
+
+
+// unsigned or negative integer that fits in an int32_t
+bool ESPHelperCBORReader::readInt(int32_t &value) {
+  size_t start = _pos;
+  uint8_t major, info;
+  uint32_t arg;
+  if (!readHead(major, info, arg))
+    return false;
+
+  if (major == CBOR_MAJOR_UINT && arg <= 0x7FFFFFFF) {
+    value = arg;
+    return true;
+  }
+  if (major == CBOR_MAJOR_NEGINT && arg <= 0x7FFFFFFF) {
+    value = -1 - (int32_t)arg;
+    return true;
+  }
+  _pos = start;
+  return false;
+}
+
+
+// any float (half, single or double) or integer as a float
+bool ESPHelperCBORReader::readFloat(float &value) {
+  if (_pos >= _length)
+    return false;
+
+  uint8_t initial = _data[_pos];
+  const uint8_t* p = &_data[_pos + 1];
+
+  if (initial == CBOR_FLOAT16 && _pos + 3 <= _length) {
+    uint16_t half = (p[0] << 8) | p[1];
+    uint16_t exponent = (half >> 10) & 0x1F;
+    uint16_t mantissa = half & 0x3FF;
+    float result;
+    if (exponent == 0)
+      result = ldexp(mantissa, -24);
+    else if (exponent == 31)
+      result = mantissa == 0 ? INFINITY : NAN;
+    else
+      result = ldexp(mantissa + 1024, exponent - 25);
+    value = (half & 0x8000) ? -result : result;
+    _pos += 3;
+    return true;
+  }
+  if (initial == CBOR_FLOAT32 && _pos + 5 <= _length) {
+    uint32_t bits = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    memcpy(&value, &bits, sizeof(value));
+    _pos += 5;
+    return true;
+  }
+  if (initial == CBOR_FLOAT64 && _pos + 9 <= _length) {
+    uint64_t bits = 0;
+    for (uint8_t i = 0; i < 8; i++)
+      bits = (bits << 8) | p[i];
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    value = d;
+    _pos += 9;
+    return true;
+  }
+
+  int32_t i;
+  if (readInt(i)) {
+    value = i;
+    return true;
+  }
+  return false;
+}
+
+
+bool ESPHelperCBORReader::readBool(bool &value) {
+  if (_pos >= _length || (_data[_pos] != CBOR_SIMPLE_FALSE && _data[_pos] != CBOR_SIMPLE_TRUE))
+    return false;
+  value = _data[_pos++] == CBOR_SIMPLE_TRUE;
+  return true;
+}
+
+
+bool ESPHelperCBORReader::readNull() {
+  if (_pos >= _length || _data[_pos] != CBOR_SIMPLE_NULL)
+    return false;
+  _pos++;
+  return true;
+}
+
+
+// text string - [str] points into the payload and is NOT null terminated
+bool ESPHelperCBORReader::readString(const char* &str, size_t &length) {
+  size_t start = _pos;
+  uint32_t len;
+  if (!readHeadOf(CBOR_MAJOR_TEXT, len))
+    return false;
+  if (len > _length - _pos) {
+    _pos = start;
+    return false;
+  }
+  str = (const char*)&_data[_pos];
+  length = len;
+  _pos += len;
+  return true;
+}
+
+
+bool ESPHelperCBORReader::readBytes(const uint8_t* &data, size_t &length) {
+  size_t start = _pos;
+  uint32_t len;
+  if (!readHeadOf(CBOR_MAJOR_BYTES, len))
+    return false;
+  if (len > _length - _pos) {
+    _pos = start;
+    return false;
+  }
+  data = &_data[_pos];
+  length = len;
+  _pos += len;
+  return true;
+}
+
+
+// start of an array - its [count] items follow
+bool ESPHelperCBORReader::readArray(size_t &count) {
+  uint32_t value;
+  if (!readHeadOf(CBOR_MAJOR_ARRAY, value))
+    return false;
+  count = value;
+  return true;
+}
+
+
+// start of a map - [pairs] keys and values follow
+bool ESPHelperCBORReader::readMap(size_t &pairs) {
+  uint32_t value;
+  if (!readHeadOf(CBOR_MAJOR_MAP, value))
+    return false;
+  pairs = value;
+  return true;
+}
+
+
+// right after readMap(): move to the value of the text key [key] among the next [pairs]
+// true on: the value of [key] is the next item
+// false on: no such key (the reader is then past the map) or malformed payload
+bool ESPHelperCBORReader::findKey(const char* key, size_t pairs) {
+  size_t keyLen = strlen(key);
+  for (size_t i = 0; i < pairs; i++) {
+    const char* str;
+    size_t len;
+    if (peekType() == CBOR_TEXT) {
+      if (!readString(str, len))
+        return false;
+      if (len == keyLen && memcmp(str, key, len) == 0)
+        return true;
+    }
+    else if (!skip())
+      return false;
+
+    if (!skip())
+      return false;
+  }
+  return false;
+}
+
+
+// step over the next item including everything inside it
+bool ESPHelperCBORReader::skip() {
+  return skipItem(0);
+}
+
+
+bool ESPHelperCBORReader::atEnd() {
+  return _pos >= _length;
+}
+
+
+// bytes consumed so far
+size_t ESPHelperCBORReader::position() {
+  return _pos;
+}
+
+
+// initial byte and its argument (not for floats/simple values with a payload)
+bool ESPHelperCBORReader::readHead(uint8_t &major, uint8_t &info, uint32_t &value) {
+  if (_pos >= _length)
+    return false;
+
+  uint8_t initial = _data[_pos];
+  major = initial >> 5;
+  info = initial & 0x1F;
+
+  uint8_t extra;
+  if (info < 24)
+    extra = 0;
+  else if (info == 24)
+    extra = 1;
+  else if (info == 25)
+    extra = 2;
+  else if (info == 26)
+    extra = 4;
+  else
+    return false;   // 64 bit arguments and indefinite lengths
+
+  if (_pos + 1 + extra > _length)
+    return false;
+
+  value = extra == 0 ? info : 0;
+  for (uint8_t i = 1; i <= extra; i++)
+    value = (value << 8) | _data[_pos + i];
+  _pos += 1 + extra;
+  return true;
+}
+
+
+// argument of the next item if it has major type [major] (reader unchanged otherwise)
+bool ESPHelperCBORReader::readHeadOf(uint8_t major, uint32_t &value) {
+  size_t start = _pos;
+  uint8_t itemMajor, info;
+  if (!readHead(itemMajor, info, value) || itemMajor != major) {
+    _pos = start;
+    return false;
+  }
+  return true;
+}
+
+
+bool ESPHelperCBORReader::skipItem(uint8_t depth) {
+  if (depth > CBOR_MAX_DEPTH || _pos >= _length)
+    return false;
+
+  uint8_t initial = _data[_pos];
+  if (initial == CBOR_FLOAT16 || initial == CBOR_FLOAT32 || initial == CBOR_FLOAT64) {
+    float value;
+    return readFloat(value);
+  }
+
+  uint8_t major, info;
+  uint32_t value;
+  if (!readHead(major, info, value))
+    return false;
+
+  switch (major) {
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+      if (value > _length - _pos)
+        return false;
+      _pos += value;
+      return true;
+
+    case CBOR_MAJOR_ARRAY:
+      for (uint32_t i = 0; i < value; i++) {
+        if (!skipItem(depth + 1))
+          return false;
+      }
+      return true;
+
+    case CBOR_MAJOR_MAP:
+      for (uint32_t i = 0; i < value; i++) {
+        if (!skipItem(depth + 1) || !skipItem(depth + 1))
+          return false;
+      }
+      return true;
+
+    case CBOR_MAJOR_TAG:
+      return skipItem(depth + 1);
+
+    default:
+      // integers and simple values are just the head
+      return true;
+  }
+}
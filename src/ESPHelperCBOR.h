@@ -0,0 +1,112 @@
+/*
+ESPHelperCBOR.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_CBOR_H
+#define ESPHELPER_CBOR_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+
+
+// CBOR (RFC 7049) encoder for compact binary payloads.
+// Writes into a caller's buffer, straight to a Print, or only counts the bytes
+// (to size a streaming publish - see ESPHelper::publishCBOR). Nothing is allocated.
+// Arrays and maps are announced with their item count and then filled with that
+// many items (maps take a key and a value per pair).
+// Past the end of the buffer nothing more is written but length() keeps counting,
+// so ok() tells if the payload fit and length() how much room it needed.
+class ESPHelperCBORWriter {
+
+  public:
+
+    ESPHelperCBORWriter();
+    ESPHelperCBORWriter(uint8_t* buf, size_t size);
+    ESPHelperCBORWriter(Print &out);
+
+    void addUInt(uint32_t value);
+    void addInt(int32_t value);
+    void addFloat(float value);
+    void addBool(bool value);
+    void addNull();
+    void addString(const char* str);
+    void addString(const char* str, size_t length);
+    void addBytes(const uint8_t* data, size_t length);
+    void beginArray(size_t count);
+    void beginMap(size_t pairs);
+
+    const uint8_t* data();
+    size_t length();
+    bool ok();
+
+  private:
+
+    void writeHead(uint8_t major, uint32_t value);
+    void write(const uint8_t* data, size_t length);
+
+    uint8_t* _buf = NULL;
+    size_t _size = 0;
+    Print* _out = NULL;
+    size_t _length = 0;
+    bool _ok = true;
+};
+
+
+// Zero copy CBOR decoder for inbound payloads (e.g. in the MQTT callback).
+// Items are read in order. Strings and byte strings are returned as pointers into
+// the payload (not null terminated) so nothing is copied.
+// Indefinite length items are not supported and read as CBOR_INVALID.
+class ESPHelperCBORReader {
+
+  public:
+
+    ESPHelperCBORReader(const uint8_t* data, size_t length);
+
+    uint8_t peekType();
+
+    bool readUInt(uint32_t &value);
+    bool readInt(int32_t &value);
+    bool readFloat(float &value);
+    bool readBool(bool &value);
+    bool readNull();
+    bool readString(const char* &str, size_t &length);
+    bool readBytes(const uint8_t* &data, size_t &length);
+    bool readArray(size_t &count);
+    bool readMap(size_t &pairs);
+
+    bool findKey(const char* key, size_t pairs);
+    bool skip();
+
+    bool atEnd();
+    size_t position();
+
+  private:
+
+    bool readHead(uint8_t &major, uint8_t &info, uint32_t &value);
+    bool readHeadOf(uint8_t major, uint32_t &value);
+    bool skipItem(uint8_t depth);
+
+    const uint8_t* _data;
+    size_t _length;
+    size_t _pos = 0;
+};
+
+#endif
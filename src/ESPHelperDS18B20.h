@@ -0,0 +1,74 @@
+/*
+ESPHelperDS18B20.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_DS18B20_H
+#define ESPHELPER_DS18B20_H
+
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include "ESPHelperSensor.h"
+
+
+// DS18B20 (or any DallasTemperature sensor) for ESPHelper::addSensor().
+// The conversion runs in the sensor (up to 750ms at 12 bits) while loop() keeps going.
+// Header only so the OneWire and DallasTemperature libraries are only needed by
+// sketches that include this file.
+class ESPHelperDS18B20 : public ESPHelperSensor {
+
+  public:
+
+    // [index] picks the sensor on the bus, [fahrenheit] reports in F instead of C
+    ESPHelperDS18B20(DallasTemperature &sensors, uint8_t index = 0, bool fahrenheit = false)
+      : _sensors(sensors), _index(index), _fahrenheit(fahrenheit) {}
+
+    bool begin() {
+      _sensors.begin();
+      _sensors.setWaitForConversion(false);
+      return true;
+    }
+
+    bool startConversion() {
+      _sensors.requestTemperatures();
+      return true;
+    }
+
+    bool isReady() {
+      return _sensors.isConversionComplete();
+    }
+
+    bool read(float &value) {
+      float c = _sensors.getTempCByIndex(_index);
+      if (c == DEVICE_DISCONNECTED_C)
+        return false;
+      value = _fahrenheit ? DallasTemperature::toFahrenheit(c) : c;
+      return true;
+    }
+
+  private:
+
+    DallasTemperature &_sensors;
+    uint8_t _index;
+    bool _fahrenheit;
+};
+
+#endif
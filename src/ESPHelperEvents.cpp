@@ -0,0 +1,169 @@
+/*
+ESPHelperEvents.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperEvents.h"
+
+
+ESPHelperEvents::ESPHelperEvents() {
+}
+
+
+// allocate a ring of [slots] events (anything still queued is lost, topics are kept)
+// true on: ring ready
+// false on: zero slots requested or allocation failed
+bool ESPHelperEvents::begin(uint8_t slots) {
+  end();
+  if (slots == 0 || slots == 255)
+    return false;
+
+  // one slot stays empty to tell a full ring from an empty one
+  _slots.reset(new isrEvent[slots + 1]);
+  if (!_slots)
+    return false;
+  _size = slots + 1;
+  return true;
+}
+
+
+void ESPHelperEvents::end() {
+  _size = 0;
+  _slots.reset();
+  _head = 0;
+  _tail = 0;
+}
+
+
+bool ESPHelperEvents::isEnabled() {
+  return _size > 0;
+}
+
+
+// register a topic events can be published to - the topic is not copied and
+// must stay valid. Returns the id to pass to push() or -1 if the table is full
+int8_t ESPHelperEvents::addTopic(const char* topic, bool retain) {
+  if (topic == NULL || _topicCount == EVENT_TOPICS)
+    return -1;
+  _topics[_topicCount] = topic;
+  _retain[_topicCount] = retain;
+  return _topicCount++;
+}
+
+
+const char* ESPHelperEvents::getTopic(uint8_t topicId) {
+  if (topicId >= _topicCount)
+    return NULL;
+  return _topics[topicId];
+}
+
+
+bool ESPHelperEvents::getRetain(uint8_t topicId) {
+  return topicId < _topicCount && _retain[topicId];
+}
+
+
+// queue an event of up to EVENT_DATA_SIZE bytes (safe to call from an interrupt handler)
+// true on: event queued
+// false on: ring full (counted as an overflow), not enabled or unknown topic id
+bool ICACHE_RAM_ATTR ESPHelperEvents::push(uint8_t topicId, const uint8_t* data, uint8_t length) {
+  if (_size == 0 || topicId >= _topicCount)
+    return false;
+
+  // no % here - the division helper may not be in IRAM
+  uint8_t next = _tail + 1;
+  if (next == _size)
+    next = 0;
+  if (next == _head) {
+    _overflows++;
+    return false;
+  }
+
+  isrEvent &event = _slots[_tail];
+  event.timestamp = micros();
+  event.topicId = topicId;
+  if (length > EVENT_DATA_SIZE)
+    length = EVENT_DATA_SIZE;
+  for (uint8_t i = 0; i < length; i++)
+    event.data[i] = data[i];
+  event.length = length;
+
+  __sync_synchronize();
+  _tail = next;
+  _queued++;
+  return true;
+}
+
+
+// copy out the oldest event - it keeps its slot until pop()
+// true on: [event] filled in
+// false on: ring empty
+bool ESPHelperEvents::peek(isrEvent &event) {
+  if (_size == 0 || _head == _tail)
+    return false;
+
+  __sync_synchronize();
+  event = _slots[_head];
+  return true;
+}
+
+
+// free the slot of the oldest event (once it has been published)
+void ESPHelperEvents::pop() {
+  if (_size == 0 || _head == _tail)
+    return;
+
+  __sync_synchronize();
+  _head = (_head + 1) % _size;
+}
+
+
+void ESPHelperEvents::recordPublished(uint32_t latencyMicros) {
+  _stats.published++;
+  _stats.lastLatency = latencyMicros;
+  if (latencyMicros > _stats.maxLatency)
+    _stats.maxLatency = latencyMicros;
+}
+
+
+void ESPHelperEvents::recordFailed() {
+  _stats.failed++;
+}
+
+
+uint8_t ESPHelperEvents::count() {
+  if (_size == 0)
+    return 0;
+  return (_tail + _size - _head) % _size;
+}
+
+
+eventStats ESPHelperEvents::getStats() {
+  _stats.queued = _queued;
+  _stats.overflows = _overflows;
+  return _stats;
+}
+
+
+void ESPHelperEvents::resetStats() {
+  _queued = 0;
+  _overflows = 0;
+  _stats = eventStats();
+}
@@ -0,0 +1,81 @@
+/*
+ESPHelperEvents.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_EVENTS_H
+#define ESPHELPER_EVENTS_H
+
+#include <Arduino.h>
+#include <memory>
+#include "sharedData.h"
+
+
+// Ring of small events queued from interrupt handlers and published later from loop().
+// push() lives in IRAM, never allocates and only moves the tail, while the loop side
+// only moves the head, so no interrupts have to be disabled on either side.
+// Each event is stamped with micros() when it is queued so the time to publish can be
+// measured, and events that don't fit are counted as overflows.
+// Only one producer is supported: call push() from interrupt handlers of the same
+// level (or from normal code with interrupts disabled).
+class ESPHelperEvents {
+
+  public:
+
+    ESPHelperEvents();
+
+    bool begin(uint8_t slots);
+    void end();
+
+    bool isEnabled();
+
+    int8_t addTopic(const char* topic, bool retain);
+    const char* getTopic(uint8_t topicId);
+    bool getRetain(uint8_t topicId);
+
+    bool push(uint8_t topicId, const uint8_t* data, uint8_t length);
+
+    bool peek(isrEvent &event);
+    void pop();
+    void recordPublished(uint32_t latencyMicros);
+    void recordFailed();
+
+    uint8_t count();
+
+    eventStats getStats();
+    void resetStats();
+
+  private:
+
+    std::unique_ptr<isrEvent[]> _slots;
+    uint8_t _size = 0;
+    volatile uint8_t _head = 0;
+    volatile uint8_t _tail = 0;
+
+    const char* _topics[EVENT_TOPICS];
+    bool _retain[EVENT_TOPICS];
+    uint8_t _topicCount = 0;
+
+    volatile uint32_t _queued = 0;
+    volatile uint32_t _overflows = 0;
+    eventStats _stats;
+};
+
+#endif
@@ -88,8 +88,8 @@ void ESPHelperFS::printFSinfo() {
 }
 
 
-//load the file from FS into var buf
-bool ESPHelperFS::loadFile(const char* filename, std::unique_ptr<char[]> &buf) {
+//load the file from FS into var buf (null terminated, at most maxSize bytes)
+bool ESPHelperFS::loadFile(const char* filename, std::unique_ptr<char[]> &buf, size_t maxSize) {
 
   // FSdebugPrint("Opening File: ");  // FS Debug print
   // FSdebugPrintln(filename);  // FS Debug print
@@ -107,18 +107,19 @@ bool ESPHelperFS::loadFile(const char* filename, std::unique_ptr<char[]> &buf) {
   size_t size = configFile.size();
   // FSdebugPrint("JSON File Size: ");  // FS Debug print
   // FSdebugPrintln(size);  // FS Debug print
-  if (size > JSON_SIZE) { 
+  if (size > maxSize) { 
     // FSdebugPrintln("JSON File too large - returning");   // FS Debug print
     return false;
   }
 
   // Allocate a buffer to store contents of the file.
-  std::unique_ptr<char[]> newBuf(new char[size]);
+  std::unique_ptr<char[]> newBuf(new char[size + 1]);
 
   // We don't use String here because ArduinoJson library requires the input
   // buffer to be mutable. If you don't use ArduinoJson, you may as well
   // use configFile.readString instead.
   configFile.readBytes(newBuf.get(), size);
+  newBuf[size] = '\0';
 
   // move the contents of newBuf into buf
   buf = std::move(newBuf);
@@ -132,37 +133,43 @@ bool ESPHelperFS::loadFile(const char* filename, std::unique_ptr<char[]> &buf) {
 }
 
 
-int8_t ESPHelperFS::validateConfig(const char* filename) {
-  
-  //create a buffer for the file data
-  std::unique_ptr<char[]> buf(new char[JSON_SIZE]);
-  loadFile(filename, buf);
-  StaticJsonBuffer<JSON_SIZE> jsonBuffer;
-  JsonObject& json = jsonBuffer.parseObject(buf.get());
-  if (json.size() == 0) {
-    // FSdebugPrintln("JSON File is empty");  // FS Debug print
-    return NO_CONFIG;
-  }
+// read [filename] into [buf] and parse it with [jsonBuffer] - the file is read and parsed
+// once and everything else (checking the keys, copying them out, writing a new config on
+// top of the old one) works on that one document.
+// Returns one of validateStates, [json] is set unless the state is NO_CONFIG or CONFIG_TOO_BIG
+int8_t ESPHelperFS::parseConfig(const char* filename,
+                                std::unique_ptr<char[]> &buf,
+                                StaticJsonBuffer<JSON_SIZE> &jsonBuffer,
+                                JsonObject* &json) {
+  json = NULL;
+  if (!loadFile(filename, buf))
+    return SPIFFS.exists(filename) ? CONFIG_TOO_BIG : NO_CONFIG;
+
+  json = &jsonBuffer.parseObject(buf.get());
 
   // return false if the file could not be parsed
-  if (!json.success()) {
+  if (!json->success()) {
     // FSdebugPrintln("JSON File corrupt");  // FS Debug print
     return CANNOT_PARSE;
   }
+  if (json->size() == 0) {
+    // FSdebugPrintln("JSON File is empty");  // FS Debug print
+    return NO_CONFIG;
+  }
 
   // check to make sure all netInfo keys exist
-  if ( !(json.containsKey("ssid") 
-      && json.containsKey("networkPass") 
-      && json.containsKey("mqttIP") 
-      && json.containsKey("mqttUSER")
-      && json.containsKey("mqttPASS")
-      && json.containsKey("mqttPORT")
-      && json.containsKey("hostname")
-      && json.containsKey("OTA_Password")
-      && json.containsKey("willTopic")
-      && json.containsKey("willMessage")
-      && json.containsKey("willQoS")
-      && json.containsKey("willRetain")) ) {
+  if ( !(json->containsKey("ssid") 
+      && json->containsKey("networkPass") 
+      && json->containsKey("mqttIP") 
+      && json->containsKey("mqttUSER")
+      && json->containsKey("mqttPASS")
+      && json->containsKey("mqttPORT")
+      && json->containsKey("hostname")
+      && json->containsKey("OTA_Password")
+      && json->containsKey("willTopic")
+      && json->containsKey("willMessage")
+      && json->containsKey("willQoS")
+      && json->containsKey("willRetain")) ) {
 
     // FSdebugPrintln("Config incomplete");  // FS Debug print
     return INCOMPLETE;
@@ -171,36 +178,51 @@ int8_t ESPHelperFS::validateConfig(const char* filename) {
 }
 
 
+int8_t ESPHelperFS::validateConfig(const char* filename) {
+  std::unique_ptr<char[]> buf;
+  StaticJsonBuffer<JSON_SIZE> jsonBuffer;
+  JsonObject* json;
+  return parseConfig(filename, buf, jsonBuffer, json);
+}
+
+
 bool ESPHelperFS::loadNetworkConfig() {
+#ifdef DEBUG
+  unsigned long start = micros();
+#endif
 
-  // check if the config file is good. And if not - create a new one.
-  if (validateConfig(_filename) != GOOD_CONFIG) {
-    createConfig(&defaultConfig);
+  std::unique_ptr<char[]> buf;
+  StaticJsonBuffer<JSON_SIZE> jsonBuffer;
+  JsonObject* json;
+  int8_t state = parseConfig(_filename, buf, jsonBuffer, json);
+
+  // check if the config file is good. And if not - write the defaults over it
+  // (on top of what was read if it is only missing keys, so extra keys are kept)
+  if (state != GOOD_CONFIG) {
+    if (state != INCOMPLETE) {
+      jsonBuffer.clear();
+      json = &jsonBuffer.createObject();
+    }
+    setConfig(*json, &defaultConfig);
+    saveConfig(*json, _filename);
     return false;
   }
 
 
   else {
-    // create a buffer for the file data
-    std::unique_ptr<char[]> buf(new char[JSON_SIZE]);
-    loadFile(_filename, buf);
-    StaticJsonBuffer<JSON_SIZE> jsonBuffer;
-    JsonObject& json = jsonBuffer.parseObject(buf.get());
-
-
     // copy the keys into char arrays
-    strcpy(ssid, json["ssid"]);
-    strcpy(netPass, json["networkPass"]);
-    strcpy(hostName, json["hostname"]);
-    strcpy(mqtt_ip, json["mqttIP"]);
-    strcpy(otaPass, json["OTA_Password"]);
-    strcpy(mqttPort, json["mqttPORT"]);
-    strcpy(mqttUser, json["mqttUSER"]);
-    strcpy(mqttPass, json["mqttPASS"]);
-    strcpy(willTopic, json["willTopic"]);
-    strcpy(willMessage, json["willMessage"]);
-    strcpy(willQoS, json["willQoS"]);
-    strcpy(willRetain, json["willRetain"]);
+    strcpy(ssid, (*json)["ssid"]);
+    strcpy(netPass, (*json)["networkPass"]);
+    strcpy(hostName, (*json)["hostname"]);
+    strcpy(mqtt_ip, (*json)["mqttIP"]);
+    strcpy(otaPass, (*json)["OTA_Password"]);
+    strcpy(mqttPort, (*json)["mqttPORT"]);
+    strcpy(mqttUser, (*json)["mqttUSER"]);
+    strcpy(mqttPass, (*json)["mqttPASS"]);
+    strcpy(willTopic, (*json)["willTopic"]);
+    strcpy(willMessage, (*json)["willMessage"]);
+    strcpy(willQoS, (*json)["willQoS"]);
+    strcpy(willRetain, (*json)["willRetain"]);
 
     int port = atoi(mqttPort);
     int numQoS = atoi(willQoS);
@@ -222,6 +244,11 @@ bool ESPHelperFS::loadNetworkConfig() {
       willRetain : numRetain
     };
 
+#ifdef DEBUG
+    FSdebugPrint("Config loaded in (us): ");
+    FSdebugPrintln(micros() - start);
+#endif
+
     // FSdebugPrintln("Reading config file with values: ");  // FS Debug print
     // FSdebugPrint("MQTT Server: ");  // FS Debug print
     // FSdebugPrintln(_networkData.mqttHost);  // FS Debug print
@@ -255,6 +282,24 @@ bool ESPHelperFS::loadNetworkConfig() {
 }
 
 
+// compile the "rules" array of a JSON file into [rules] (see ESPHelperRules)
+// true on: file read and every rule compiled
+bool ESPHelperFS::loadRules(const char* filename, ESPHelperRules &rules) {
+  std::unique_ptr<char[]> buf;
+  if (!loadFile(filename, buf, RULES_FILE_SIZE))
+    return false;
+
+  // only needed while compiling - the rules keep their own copies of all strings
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject& json = jsonBuffer.parseObject(buf.get());
+  if (!json.success())
+    return false;
+
+  JsonArray& list = json["rules"];
+  return rules.compile(list);
+}
+
+
 // add a key to a json file
 bool ESPHelperFS::addKey(const char* keyName, const char* value) {
   if(_filename == "")
@@ -341,52 +386,28 @@ netInfo ESPHelperFS::getNetInfo() {
 
 
 bool ESPHelperFS::createConfig(const char* filename) {
-  return createConfig(_filename,
-                      defaultConfig.ssid, 
-                      defaultConfig.pass, 
-                      defaultConfig.hostname, 
-                      defaultConfig.mqttHost,  
-                      defaultConfig.mqttUser, 
-                      defaultConfig.mqttPass, 
-                      defaultConfig.mqttPort,
-                      defaultConfig.otaPassword,
-                      defaultConfig.willTopic,
-                      defaultConfig.willMessage,
-                      defaultConfig.willQoS,
-                      defaultConfig.willRetain);
+  return createConfig(&defaultConfig, _filename);
 }
 
 
 bool ESPHelperFS::createConfig(const netInfo* config) {
-  return createConfig(_filename,
-                      config->ssid, 
-                      config->pass, 
-                      config->hostname, 
-                      config->mqttHost,  
-                      config->mqttUser, 
-                      config->mqttPass, 
-                      config->mqttPort,
-                      config->otaPassword,
-                      config->willTopic,
-                      config->willMessage,
-                      config->willQoS,
-                      config->willRetain);
+  return createConfig(config, _filename);
 }
 
 bool ESPHelperFS::createConfig(const netInfo* config, const char* filename) {
-  return createConfig(filename,
-                      config->ssid, 
-                      config->pass, 
-                      config->hostname, 
-                      config->mqttHost,  
-                      config->mqttUser, 
-                      config->mqttPass, 
-                      config->mqttPort,
-                      config->otaPassword,
-                      config->willTopic,
-                      config->willMessage,
-                      config->willQoS,
-                      config->willRetain);
+  std::unique_ptr<char[]> buf;
+  StaticJsonBuffer<JSON_SIZE> jsonBuffer;
+  JsonObject* json;
+
+  // if a json file already exists then use that as the base (it is only read once)
+  int8_t state = parseConfig(filename, buf, jsonBuffer, json);
+  if (state != GOOD_CONFIG && state != INCOMPLETE) {
+    jsonBuffer.clear();
+    json = &jsonBuffer.createObject();
+  }
+
+  setConfig(*json, config);
+  return saveConfig(*json, filename);
 }
 
 bool ESPHelperFS::createConfig(const char* filename,
@@ -402,67 +423,74 @@ bool ESPHelperFS::createConfig(const char* filename,
                                const char* _willMessage,
                                const int _willQoS,
                                const int _willRetain) {
+  netInfo config;
+  config.ssid = _ssid;
+  config.pass = _networkPass;
+  config.hostname = _deviceName;
+  config.mqttHost = _mqttIP;
+  config.mqttUser = _mqttUser;
+  config.mqttPass = _mqttPass;
+  config.mqttPort = _mqttPort;
+  config.otaPassword = _otaPass;
+  config.willTopic = _willTopic;
+  config.willMessage = _willMessage;
+  config.willQoS = _willQoS;
+  config.willRetain = _willRetain;
+  return createConfig(&config, filename);
+}
+
+
+// put the netInfo keys of [config] into [json] (numbers are stored as strings)
+void ESPHelperFS::setConfig(JsonObject& json, const netInfo* config) {
 
   // FSdebugPrintln("Generating new config file with values: ");  // FS Debug print
   // FSdebugPrint("SSID: ");  // FS Debug print
-  // FSdebugPrintln(_ssid);  // FS Debug print
+  // FSdebugPrintln(config->ssid);  // FS Debug print
   // FSdebugPrint("Network Pass: ");  // FS Debug print
-  // FSdebugPrintln(_networkPass);  // FS Debug print
+  // FSdebugPrintln(config->pass);  // FS Debug print
   // FSdebugPrint("hostname: ");  // FS Debug print
-  // FSdebugPrintln(_deviceName);  // FS Debug print
+  // FSdebugPrintln(config->hostname);  // FS Debug print
   // FSdebugPrint("MQTT Server: ");  // FS Debug print
-  // FSdebugPrintln(_mqttIP);  // FS Debug print
+  // FSdebugPrintln(config->mqttHost);  // FS Debug print
   // FSdebugPrint("MQTT Username: ");  // FS Debug print
-  // FSdebugPrintln(_mqttUser);  // FS Debug print
+  // FSdebugPrintln(config->mqttUser);  // FS Debug print
   // FSdebugPrint("MQTT Password: ");  // FS Debug print
-  // FSdebugPrintln(_mqttPass);  // FS Debug print
+  // FSdebugPrintln(config->mqttPass);  // FS Debug print
   // FSdebugPrint("MQTT PORT: ");  // FS Debug print
-  // FSdebugPrintln(_mqttPort);  // FS Debug print
+  // FSdebugPrintln(config->mqttPort);  // FS Debug print
   // FSdebugPrint("OTA Password: ");  // FS Debug print
-  // FSdebugPrintln(_otaPass);  // FS Debug print
+  // FSdebugPrintln(config->otaPassword);  // FS Debug print
   // FSdebugPrint("Last Will Topic: ");  // FS Debug print
-  // FSdebugPrintln(_willTopic);  // FS Debug print
+  // FSdebugPrintln(config->willTopic);  // FS Debug print
   // FSdebugPrint("Last Will Message: ");  // FS Debug print
-  // FSdebugPrintln(_willMessage);  // FS Debug print
+  // FSdebugPrintln(config->willMessage);  // FS Debug print
   // FSdebugPrint("Last Will QoS: ");  // FS Debug print
-  // FSdebugPrintln(_willQoS);  // FS Debug print
+  // FSdebugPrintln(config->willQoS);  // FS Debug print
   // FSdebugPrint("Last Will Retain: ");  // FS Debug print
-  // FSdebugPrintln(_willRetain);  // FS Debug print
+  // FSdebugPrintln(config->willRetain);  // FS Debug print
 
+  // copied by the json buffer - the strings only have to live until here
   char portString[10];
-  sprintf(portString, "%d", _mqttPort);
+  sprintf(portString, "%d", config->mqttPort);
 
   char qoSString[10];
-  sprintf(qoSString, "%d", _willQoS);
+  sprintf(qoSString, "%d", config->willQoS);
 
   char retainString[10];
-  sprintf(retainString, "%d", _willRetain);
+  sprintf(retainString, "%d", config->willRetain);
 
-  // FSdebugPrintln("creating json");  // FS Debug print
-
-  // create a buffer for the file data
-  std::unique_ptr<char[]> buf(new char[JSON_SIZE]);
-  loadFile(filename, buf);
-  StaticJsonBuffer<JSON_SIZE> jsonBuffer;
-
-  // if a json file already exists then use that as the base
-  JsonObject& json = validateConfig(filename) == GOOD_CONFIG ? jsonBuffer.parseObject(buf.get()) : jsonBuffer.createObject();
-
-  json["ssid"] = _ssid;
-  json["networkPass"] = _networkPass;
-  json["hostname"] = _deviceName;
-  json["mqttIP"] = _mqttIP;
+  json["ssid"] = config->ssid;
+  json["networkPass"] = config->pass;
+  json["hostname"] = config->hostname;
+  json["mqttIP"] = config->mqttHost;
   json["mqttPORT"] = portString;
-  json["mqttUSER"] = _mqttUser;
-  json["mqttPASS"] = _mqttPass;
-  json["OTA_Password"] = _otaPass;
-  json["willTopic"] = _willTopic;
-  json["willMessage"] = _willMessage;
+  json["mqttUSER"] = config->mqttUser;
+  json["mqttPASS"] = config->mqttPass;
+  json["OTA_Password"] = config->otaPassword;
+  json["willTopic"] = config->willTopic;
+  json["willMessage"] = config->willMessage;
   json["willQoS"] = qoSString;
   json["willRetain"] = retainString;
-
-  // FSdebugPrintln("done");  // FS Debug print
-  return saveConfig(json, filename);
 }
 
 
@@ -76,6 +76,8 @@ class ESPHelperFS {
 
     netInfo getNetInfo();
 
+    static bool loadRules(const char* filename, ESPHelperRules &rules);
+
     static bool createConfig(  const char* filename,
                         const char* _ssid, 
                         const char* _networkPass, 
@@ -97,7 +99,12 @@ class ESPHelperFS {
 
   private:
 
-    static bool loadFile(const char* filename, std::unique_ptr<char[]> &buf);
+    static bool loadFile(const char* filename, std::unique_ptr<char[]> &buf, size_t maxSize = JSON_SIZE);
+    static int8_t parseConfig(const char* filename,
+                              std::unique_ptr<char[]> &buf,
+                              StaticJsonBuffer<JSON_SIZE> &jsonBuffer,
+                              JsonObject* &json);
+    static void setConfig(JsonObject& json, const netInfo* config);
 
     char ssid[64];
     char netPass[32];
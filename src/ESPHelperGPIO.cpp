@@ -0,0 +1,221 @@
+/*
+ESPHelperGPIO.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperGPIO.h"
+
+
+ESPHelperGPIO::ESPHelperGPIO() {
+}
+
+
+// start watching [pin] - [topic] and the payloads are not copied and must stay valid.
+// The sampler starts with the first pin
+// returns the index of the pin (for get/getState) or -1 if WATCH_PINS pins are watched
+// or the edge ring could not be allocated
+int8_t ESPHelperGPIO::watch(uint8_t pin, const char* topic, uint8_t flags, uint16_t debounceMs,
+                            const char* highPayload, const char* lowPayload) {
+  if (_count == WATCH_PINS || topic == NULL)
+    return -1;
+  if (!_edges.isEnabled() && !_edges.begin(WATCH_EDGE_SLOTS))
+    return -1;
+
+  pinMode(pin, (flags & WATCH_PULLUP) ? INPUT_PULLUP : INPUT);
+
+  gpioWatch &w = _pins[_count];
+  w = gpioWatch();
+  w.pin = pin;
+  w.flags = flags;
+  w.debounce = debounceMs;
+  w.topic = topic;
+  w.highPayload = highPayload;
+  w.lowPayload = lowPayload;
+  w.raw = digitalRead(pin);
+  w.state = w.raw;
+  w.rawSince = millis();
+
+  // the sampler only looks at pins below _count so the entry is complete before it counts
+  _count++;
+
+  if (!_running) {
+    _ticker.attach_ms(_interval, sampleTick, this);
+    _running = true;
+  }
+  return _count - 1;
+}
+
+
+// stop the sampler and forget all pins (edges not published yet are lost)
+void ESPHelperGPIO::clear() {
+  _ticker.detach();
+  _running = false;
+  _count = 0;
+  _edges.end();
+}
+
+
+// ms between samples - a restart of the sampler if it is already running
+void ESPHelperGPIO::setSampleInterval(uint16_t intervalMs) {
+  if (intervalMs == 0)
+    return;
+  _interval = intervalMs;
+  if (_running) {
+    _ticker.detach();
+    _ticker.attach_ms(_interval, sampleTick, this);
+  }
+}
+
+
+// the function changes are published with (topic, payload, retain) - false if it failed
+void ESPHelperGPIO::setPublisher(std::function<bool(const char*, const char*, bool)> publisher) {
+  _publisher = publisher;
+  _publisherSet = true;
+}
+
+
+// publish the queued edges and the pending coalesced changes - called from loop()
+// while there is somewhere to publish to (edges wait in the ring otherwise).
+// A failed publish leaves its edge queued and the rest waits for the next call
+void ESPHelperGPIO::flush() {
+  gpioEdge* edge;
+  while ((edge = _edges.front()) != NULL) {
+    if (!publishLevel(_pins[edge->index], edge->level, edge->timestamp))
+      return;
+    _edges.pop();
+  }
+
+  for (uint8_t i = 0; i < _count; i++) {
+    gpioWatch &w = _pins[i];
+    if (!w.pending)
+      continue;
+
+    // clear the flag before reading the state so a change in between is published next time
+    w.pending = false;
+    if (!publishLevel(w, w.state, w.changedAt)) {
+      w.pending = true;
+      return;
+    }
+  }
+}
+
+
+uint8_t ESPHelperGPIO::count() {
+  return _count;
+}
+
+
+// pin at [index] (config, state and counters) or NULL past the end of the table
+const gpioWatch* ESPHelperGPIO::get(uint8_t index) {
+  if (index >= _count)
+    return NULL;
+  return &_pins[index];
+}
+
+
+// debounced level of the pin at [index] (LOW for an unknown index)
+uint8_t ESPHelperGPIO::getState(uint8_t index) {
+  if (index >= _count)
+    return LOW;
+  return _pins[index].state;
+}
+
+
+// longest time (micros) from an accepted edge to its publish
+uint32_t ESPHelperGPIO::getMaxLatency() {
+  return _maxLatency;
+}
+
+
+void ESPHelperGPIO::resetCounters() {
+  for (uint8_t i = 0; i < _count; i++) {
+    _pins[i].rises = 0;
+    _pins[i].falls = 0;
+    _pins[i].published = 0;
+    _pins[i].coalesced = 0;
+    _pins[i].dropped = 0;
+  }
+  _maxLatency = 0;
+}
+
+
+void ESPHelperGPIO::sampleTick(ESPHelperGPIO* self) {
+  self->sample();
+}
+
+
+// runs from the Ticker - a level has to hold for the pin's debounce time to count
+void ESPHelperGPIO::sample() {
+  unsigned long now = millis();
+
+  for (uint8_t i = 0; i < _count; i++) {
+    gpioWatch &w = _pins[i];
+    uint8_t raw = digitalRead(w.pin);
+
+    if (raw != w.raw) {
+      w.raw = raw;
+      w.rawSince = now;
+      continue;
+    }
+    if (raw == w.state || now - w.rawSince < w.debounce)
+      continue;
+
+    w.state = raw;
+    if (raw == HIGH)
+      w.rises++;
+    else
+      w.falls++;
+
+    if (w.flags & WATCH_COALESCE) {
+      if (w.pending)
+        w.coalesced++;
+      w.changedAt = micros();
+      w.pending = true;
+      continue;
+    }
+
+    gpioEdge* edge = _edges.claim();
+    if (edge == NULL) {
+      w.dropped++;
+      continue;
+    }
+    edge->timestamp = micros();
+    edge->index = i;
+    edge->level = raw;
+    _edges.commit();
+  }
+}
+
+
+// true on: published, or nothing to publish for this level
+// false on: the publish failed (the caller keeps the edge)
+bool ESPHelperGPIO::publishLevel(gpioWatch &w, uint8_t level, uint32_t timestamp) {
+  const char* payload = (level == HIGH) ? w.highPayload : w.lowPayload;
+  if (payload == NULL || !_publisherSet)
+    return true;
+
+  if (!_publisher(w.topic, payload, (w.flags & WATCH_RETAIN) != 0))
+    return false;
+  w.published++;
+  uint32_t latency = micros() - timestamp;
+  if (latency > _maxLatency)
+    _maxLatency = latency;
+  return true;
+}
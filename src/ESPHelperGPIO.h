@@ -0,0 +1,77 @@
+/*
+ESPHelperGPIO.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_GPIO_H
+#define ESPHELPER_GPIO_H
+
+#include <Arduino.h>
+#include <Ticker.h>
+#include "sharedData.h"
+#include "ESPHelperRing.h"
+
+
+// Watches input pins and publishes their debounced state on every change.
+// A Ticker samples all pins every WATCH_SAMPLE_INTERVAL ms (it keeps running while
+// loop() is blocked in a reconnect) and queues accepted edges in a ring. loop()
+// publishes them with the payload for the new level, or only the latest state of
+// pins watched with WATCH_COALESCE. Edges are counted per pin.
+class ESPHelperGPIO {
+
+  public:
+
+    ESPHelperGPIO();
+
+    int8_t watch(uint8_t pin, const char* topic, uint8_t flags, uint16_t debounceMs,
+                 const char* highPayload, const char* lowPayload);
+    void clear();
+
+    void setSampleInterval(uint16_t intervalMs);
+    void setPublisher(std::function<bool(const char*, const char*, bool)> publisher);
+
+    void flush();
+
+    uint8_t count();
+    const gpioWatch* get(uint8_t index);
+    uint8_t getState(uint8_t index);
+    uint32_t getMaxLatency();
+    void resetCounters();
+
+  private:
+
+    static void sampleTick(ESPHelperGPIO* self);
+    void sample();
+    bool publishLevel(gpioWatch &w, uint8_t level, uint32_t timestamp);
+
+    Ticker _ticker;
+    bool _running = false;
+    uint16_t _interval = WATCH_SAMPLE_INTERVAL;
+
+    gpioWatch _pins[WATCH_PINS];
+    volatile uint8_t _count = 0;
+    ESPHelperRing<gpioEdge> _edges;
+    uint32_t _maxLatency = 0;
+
+    std::function<bool(const char*, const char*, bool)> _publisher;
+    bool _publisherSet = false;
+};
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ESPHelperHTTPUpdate.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperHTTPUpdate.h"
+
+
+// start downloading the image at [url] (http://host[:port]/path) - [md5] is the
+// optional hex MD5 of the image as downloaded, checked once it has all been written
+// true on: download started
+// false on: an update is already running or the URL is not usable
+bool ESPHelperHTTPUpdate::begin(const char* url, const char* md5) {
+  if (isRunning())
+    return false;
+
+  _error = 0;
+  _size = 0;
+  _written = 0;
+  _retries = 0;
+  _flashing = false;
+  if (url == NULL || !parseURL(url)) {
+    _error = HTTP_UPDATE_ERROR_URL;
+    _state = HTTP_UPDATE_FAILED;
+    return false;
+  }
+
+  _md5[0] = '\0';
+  if (md5 != NULL && strlen(md5) == 32)
+    strcpy(_md5, md5);
+
+  if (_monitor != NULL)
+    _monitor->start(OTA_SOURCE_HTTP, 0);
+  _state = HTTP_UPDATE_WAITING;
+  _retryAt = millis();
+  return true;
+}
+
+
+// stop a running download (nothing is installed)
+void ESPHelperHTTPUpdate::abort() {
+  if (isRunning())
+    fail(HTTP_UPDATE_ERROR_ABORTED);
+}
+
+
+// move the download along - returns the state it is in afterwards
+// (HTTP_UPDATE_DONE once the whole image is written and verified)
+uint8_t ESPHelperHTTPUpdate::loop() {
+  switch (_state) {
+    case HTTP_UPDATE_WAITING:
+      if ((long)(millis() - _retryAt) >= 0)
+        connect();
+      break;
+    case HTTP_UPDATE_HEADERS:
+      readHeaders();
+      break;
+    case HTTP_UPDATE_BODY:
+      readBody();
+      break;
+  }
+  return _state;
+}
+
+
+bool ESPHelperHTTPUpdate::isRunning() {
+  return _state == HTTP_UPDATE_WAITING || _state == HTTP_UPDATE_HEADERS || _state == HTTP_UPDATE_BODY;
+}
+
+
+uint8_t ESPHelperHTTPUpdate::getState() {
+  return _state;
+}
+
+
+uint32_t ESPHelperHTTPUpdate::getWritten() {
+  return _written;
+}
+
+
+// image size (0 until the first response)
+uint32_t ESPHelperHTTPUpdate::getSize() {
+  return _size;
+}
+
+
+// why the last update failed: an HTTP status, an Updater error or HTTP_UPDATE_ERROR_*
+int16_t ESPHelperHTTPUpdate::getError() {
+  return _error;
+}
+
+
+// report start, progress and the result of downloads to [monitor]
+void ESPHelperHTTPUpdate::setMonitor(ESPHelperOTAMonitor* monitor) {
+  _monitor = monitor;
+}
+
+
+bool ESPHelperHTTPUpdate::parseURL(const char* url) {
+  if (strncmp(url, "http://", 7) != 0)
+    return false;
+  url += 7;
+
+  size_t hostLength = strcspn(url, ":/");
+  if (hostLength == 0 || hostLength >= sizeof(_host))
+    return false;
+  memcpy(_host, url, hostLength);
+  _host[hostLength] = '\0';
+  url += hostLength;
+
+  _port = 80;
+  if (*url == ':') {
+    char* end;
+    unsigned long port = strtoul(url + 1, &end, 10);
+    if (end == url + 1 || port == 0 || port > 65535 || (*end != '/' && *end != '\0'))
+      return false;
+    _port = port;
+    url = end;
+  }
+
+  if (*url == '\0')
+    url = "/";
+  if (strlen(url) >= sizeof(_path))
+    return false;
+  strcpy(_path, url);
+  return true;
+}
+
+
+// (re)connect and ask for the rest of the image
+void ESPHelperHTTPUpdate::connect() {
+  _client.stop();
+  _lineLength = 0;
+  _status = 0;
+  _contentLength = -1;
+  _rangeStart = -1;
+  _rangeTotal = -1;
+  _chunked = false;
+  _skip = 0;
+
+  if (!_client.connect(_host, _port)) {
+    retry();
+    return;
+  }
+
+  char request[HTTP_UPDATE_URL_SIZE + 160];
+  int length = snprintf(request, sizeof(request),
+                        "GET %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESPHelper\r\nConnection: close\r\n",
+                        _path, _host);
+  if (_written > 0)
+    length += snprintf(&request[length], sizeof(request) - length, "Range: bytes=%u-\r\n", (unsigned int)_written);
+  length += snprintf(&request[length], sizeof(request) - length, "\r\n");
+  _client.write((const uint8_t*)request, length);
+
+  _lastData = millis();
+  _state = HTTP_UPDATE_HEADERS;
+}
+
+
+void ESPHelperHTTPUpdate::readHeaders() {
+  while (_client.available() > 0) {
+    int c = _client.read();
+    if (c < 0)
+      break;
+    _lastData = millis();
+
+    if (c != '\n') {
+      if (_lineLength < sizeof(_line) - 1)
+        _line[_lineLength++] = c;
+      continue;
+    }
+
+    if (_lineLength > 0 && _line[_lineLength - 1] == '\r')
+      _lineLength--;
+    _line[_lineLength] = '\0';
+
+    // a blank line ends the headers
+    if (_lineLength == 0) {
+      if (startBody()) {
+        _state = HTTP_UPDATE_BODY;
+        readBody();
+      }
+      return;
+    }
+    header(_line);
+    _lineLength = 0;
+  }
+
+  if ((!_client.connected() && _client.available() == 0) || millis() - _lastData >= HTTP_UPDATE_TIMEOUT)
+    retry();
+}
+
+
+void ESPHelperHTTPUpdate::readBody() {
+  uint8_t buf[HTTP_UPDATE_BUFFER_SIZE];
+  int available;
+
+  while (_written < _size && (available = _client.available()) > 0) {
+    int length = _client.read(buf, available < (int)sizeof(buf) ? available : sizeof(buf));
+    if (length <= 0)
+      break;
+    _lastData = millis();
+    _retries = 0;
+
+    // a server that ignored the Range header sends what we already have again
+    uint8_t* data = buf;
+    if (_skip > 0) {
+      uint32_t skipped = _skip < (uint32_t)length ? _skip : length;
+      data += skipped;
+      length -= skipped;
+      _skip -= skipped;
+    }
+    if ((uint32_t)length > _size - _written)
+      length = _size - _written;
+    if (length == 0)
+      continue;
+
+    if (Update.write(data, length) != (size_t)length) {
+      fail(Update.getError());
+      return;
+    }
+    _written += length;
+    if (_monitor != NULL)
+      _monitor->progress(_written, _size);
+  }
+
+  if (_written == _size) {
+    _client.stop();
+    _flashing = false;
+    if (!Update.end()) {
+      fail(Update.getError());
+      return;
+    }
+    _state = HTTP_UPDATE_DONE;
+    if (_monitor != NULL)
+      _monitor->finish(true);
+    return;
+  }
+
+  if ((!_client.connected() && _client.available() == 0) || millis() - _lastData >= HTTP_UPDATE_TIMEOUT)
+    retry();
+}
+
+
+// status line or a header that matters to the download
+void ESPHelperHTTPUpdate::header(char* line) {
+  if (_status == 0) {
+    char* code = strchr(line, ' ');
+    _status = (strncmp(line, "HTTP/", 5) == 0 && code != NULL) ? atoi(code + 1) : -1;
+    return;
+  }
+
+  char* value = strchr(line, ':');
+  if (value == NULL)
+    return;
+  *value++ = '\0';
+  while (*value == ' ')
+    value++;
+
+  if (strcasecmp(line, "Content-Length") == 0)
+    _contentLength = strtol(value, NULL, 10);
+  else if (strcasecmp(line, "Transfer-Encoding") == 0)
+    _chunked = strstr(value, "chunked") != NULL;
+  else if (strcasecmp(line, "Content-Range") == 0) {
+    // bytes <start>-<end>/<total>
+    char* total = strchr(value, '/');
+    if (strncmp(value, "bytes ", 6) == 0 && total != NULL && isdigit(total[1])) {
+      _rangeStart = strtol(value + 6, NULL, 10);
+      _rangeTotal = strtol(total + 1, NULL, 10);
+    }
+  }
+}
+
+
+// check the response and start flashing on the first one
+// true on: body can be read
+// false on: unusable response (the update has failed)
+bool ESPHelperHTTPUpdate::startBody() {
+  int32_t total;
+  if (_status == 200) {
+    total = _contentLength;
+    _skip = _written;
+  }
+  else if (_status == 206 && _rangeStart >= 0 && (uint32_t)_rangeStart <= _written) {
+    total = _rangeTotal;
+    _skip = _written - _rangeStart;
+  }
+  else {
+    fail(_status > 0 && _status != 206 ? _status : HTTP_UPDATE_ERROR_RESPONSE);
+    return false;
+  }
+
+  // the length has to be known up front to size the update
+  if (_chunked || total <= 0 || (_flashing && (uint32_t)total != _size)) {
+    fail(HTTP_UPDATE_ERROR_RESPONSE);
+    return false;
+  }
+
+  if (!_flashing) {
+    if (!Update.begin(total)) {
+      fail(Update.getError());
+      return false;
+    }
+    if (_md5[0] != '\0')
+      Update.setMD5(_md5);
+    _flashing = true;
+    _size = total;
+  }
+  return true;
+}
+
+
+// the connection failed or went quiet - try again (resuming) after a growing delay
+void ESPHelperHTTPUpdate::retry() {
+  _client.stop();
+  if (++_retries > HTTP_UPDATE_RETRIES) {
+    fail(HTTP_UPDATE_ERROR_CONNECT);
+    return;
+  }
+  _retryAt = millis() + (unsigned long)HTTP_UPDATE_RETRY_DELAY * _retries;
+  _state = HTTP_UPDATE_WAITING;
+}
+
+
+void ESPHelperHTTPUpdate::fail(int16_t error) {
+  _client.stop();
+  // ending an incomplete update throws it away
+  if (_flashing) {
+    Update.end();
+    _flashing = false;
+  }
+  _error = error;
+  _state = HTTP_UPDATE_FAILED;
+  if (_monitor != NULL)
+    _monitor->finish(false, error);
+}
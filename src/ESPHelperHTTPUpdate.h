@@ -0,0 +1,94 @@
+/*
+ESPHelperHTTPUpdate.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_HTTP_UPDATE_H
+#define ESPHELPER_HTTP_UPDATE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <Updater.h>
+#include "sharedData.h"
+#include "ESPHelperOTAMonitor.h"
+
+
+// Downloads a firmware image over plain HTTP and writes it to flash as it arrives.
+// Runs from loop() a buffer at a time. A gzip compressed image is written as it is -
+// the ESP8266 core recognizes it and the bootloader unpacks it when it installs the update.
+// If the connection drops or goes quiet the download is resumed where it stopped
+// with a Range request (a server that ignores Range just has the start skipped).
+class ESPHelperHTTPUpdate {
+
+  public:
+
+    bool begin(const char* url, const char* md5 = NULL);
+    void abort();
+
+    uint8_t loop();
+
+    bool isRunning();
+    uint8_t getState();
+    uint32_t getWritten();
+    uint32_t getSize();
+    int16_t getError();
+
+    void setMonitor(ESPHelperOTAMonitor* monitor);
+
+  private:
+
+    bool parseURL(const char* url);
+    void connect();
+    void readHeaders();
+    void readBody();
+    void header(char* line);
+    bool startBody();
+    void retry();
+    void fail(int16_t error);
+
+    WiFiClient _client;
+    char _host[64];
+    char _path[HTTP_UPDATE_URL_SIZE];
+    uint16_t _port = 80;
+    char _md5[33];
+
+    uint8_t _state = HTTP_UPDATE_IDLE;
+    int16_t _error = 0;
+    uint32_t _size = 0;
+    uint32_t _written = 0;
+    uint8_t _retries = 0;
+    unsigned long _lastData = 0;
+    unsigned long _retryAt = 0;
+    bool _flashing = false;
+
+    // response being read
+    char _line[96];
+    uint8_t _lineLength = 0;
+    int _status = 0;
+    int32_t _contentLength = -1;
+    int32_t _rangeStart = -1;
+    int32_t _rangeTotal = -1;
+    bool _chunked = false;
+    uint32_t _skip = 0;
+
+    ESPHelperOTAMonitor* _monitor = NULL;
+};
+
+#endif
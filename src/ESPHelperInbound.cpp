@@ -0,0 +1,150 @@
+/*
+ESPHelperInbound.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperInbound.h"
+
+
+ESPHelperInbound::ESPHelperInbound() {
+}
+
+
+// allocate the ring (once) and set what happens when it fills up
+// true on: queue ready for use
+// false on: zero slots requested or allocation failed
+bool ESPHelperInbound::begin(uint8_t slots, uint8_t policy) {
+  if (slots == 0)
+    return false;
+
+  // only reallocate if the size actually changed
+  if (!_slots || slots != _size) {
+    _slots.reset(new inboundMessage[slots]);
+    if (!_slots) {
+      _size = 0;
+      return false;
+    }
+    _size = slots;
+  }
+
+  _head = 0;
+  _count = 0;
+  _policy = policy;
+  return true;
+}
+
+
+// release the ring (any messages still waiting are lost)
+void ESPHelperInbound::end() {
+  _slots.reset();
+  _size = 0;
+  _head = 0;
+  _count = 0;
+}
+
+
+bool ESPHelperInbound::isEnabled() {
+  return _size > 0;
+}
+
+
+// true if the topic and payload fit in a slot (INBOUND_TOPIC_SIZE / INBOUND_PAYLOAD_SIZE)
+bool ESPHelperInbound::fits(const char* topic, unsigned int length) {
+  return strlen(topic) < INBOUND_TOPIC_SIZE && length <= INBOUND_PAYLOAD_SIZE;
+}
+
+
+// copy a message into the next free slot - check fits() first
+// true on: message queued
+// false on: message dropped (queue full with DROP_NEWEST, or topic/payload too big for a slot)
+bool ESPHelperInbound::push(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (!fits(topic, length)) {
+    _stats.dropped++;
+    return false;
+  }
+  size_t topicLen = strlen(topic);
+
+  if (_count == _size) {
+    if (_policy == DROP_NEWEST) {
+      _stats.dropped++;
+      return false;
+    }
+
+    // DROP_OLDEST - throw away the head to make room at the tail
+    pop();
+    _stats.dropped++;
+  }
+
+  inboundMessage &slot = _slots[(_head + _count) % _size];
+  memcpy(slot.topic, topic, topicLen + 1);
+  memcpy(slot.payload, payload, length);
+  slot.payload[length] = '\0';
+  slot.length = length;
+
+  _count++;
+  _stats.queued++;
+  if (_count > _stats.highWater)
+    _stats.highWater = _count;
+  return true;
+}
+
+
+void ESPHelperInbound::pop() {
+  if (_count == 0)
+    return;
+  _head = (_head + 1) % _size;
+  _count--;
+}
+
+
+// move the oldest waiting message into [out]. Its slot is free again right away so
+// a push while the handler runs (DROP_OLDEST) can't overwrite the message being handled
+// true on: message copied
+// false on: queue empty
+bool ESPHelperInbound::pop(inboundMessage &out) {
+  if (_count == 0)
+    return false;
+
+  inboundMessage &slot = _slots[_head];
+  strcpy(out.topic, slot.topic);
+  memcpy(out.payload, slot.payload, slot.length + 1);
+  out.length = slot.length;
+  pop();
+  return true;
+}
+
+
+uint8_t ESPHelperInbound::count() {
+  return _count;
+}
+
+
+// add the run time of one callback to the counters
+void ESPHelperInbound::recordHandler(uint32_t elapsedMicros) {
+  _stats.dispatched++;
+  _stats.handlerMicros += elapsedMicros;
+  if (elapsedMicros > _stats.maxHandlerMicros)
+    _stats.maxHandlerMicros = elapsedMicros;
+}
+
+
+inboundStats ESPHelperInbound::getStats() {
+  return _stats;
+}
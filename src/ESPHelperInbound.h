@@ -0,0 +1,69 @@
+/*
+ESPHelperInbound.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_INBOUND_H
+#define ESPHELPER_INBOUND_H
+
+#include <Arduino.h>
+#include <memory>
+#include "sharedData.h"
+
+
+// Bounded ring of inbound MQTT messages.
+// The MQTT client only copies messages into a slot (push) while it runs,
+// and ESPHelper hands a copy of them to the user callback later from loop() (pop).
+// All slots are allocated once in begin() so nothing is allocated per message.
+class ESPHelperInbound {
+
+  public:
+
+    ESPHelperInbound();
+
+    bool begin(uint8_t slots, uint8_t policy);
+    void end();
+
+    bool isEnabled();
+
+    bool fits(const char* topic, unsigned int length);
+    bool push(const char* topic, const uint8_t* payload, unsigned int length);
+
+    void pop();
+    bool pop(inboundMessage &out);
+
+    uint8_t count();
+
+    void recordHandler(uint32_t elapsedMicros);
+
+    inboundStats getStats();
+
+  private:
+
+    std::unique_ptr<inboundMessage[]> _slots;
+    uint8_t _size = 0;
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    uint8_t _policy = DROP_NEWEST;
+
+    inboundStats _stats;
+};
+
+#endif
@@ -0,0 +1,962 @@
+/*
+ESPHelperMQTT.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperMQTT.h"
+
+
+// read an MQTT variable byte integer (1-4 bytes) at [p]
+// returns the number of bytes used, 0 if it is malformed or runs past [end]
+static uint8_t readVarint(const uint8_t* p, const uint8_t* end, uint32_t &value) {
+  value = 0;
+  for (uint8_t i = 0; i < 4 && p + i < end; i++) {
+    value |= (uint32_t)(p[i] & 0x7F) << (7 * i);
+    if ((p[i] & 0x80) == 0)
+      return i + 1;
+  }
+  return 0;
+}
+
+
+// size of the value of MQTT 5 property [id] starting at [p]
+// returns 0 for unknown properties or values that run past [end]
+static uint32_t propertyLength(uint8_t id, const uint8_t* p, const uint8_t* end) {
+  uint32_t left = end - p;
+  uint32_t length;
+  switch (id) {
+    case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+      length = 1;
+      break;
+    case 0x13: case 0x21: case 0x22: case 0x23:
+      length = 2;
+      break;
+    case 0x02: case 0x11: case 0x18: case 0x27:
+      length = 4;
+      break;
+    case 0x0B: {  // subscription identifier (variable byte integer)
+      uint32_t value;
+      length = readVarint(p, end, value);
+      break;
+    }
+    case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+      // string or binary data with a 2 byte length
+      if (left < 2)
+        return 0;
+      length = 2 + ((p[0] << 8) | p[1]);
+      break;
+    case 0x26:    // user property (string pair)
+      if (left < 2)
+        return 0;
+      length = 2 + ((p[0] << 8) | p[1]);
+      if (left < length + 2)
+        return 0;
+      length += 2 + ((p[length] << 8) | p[length + 1]);
+      break;
+    default:
+      return 0;
+  }
+  return length <= left ? length : 0;
+}
+
+
+// look for a numeric property in a block of MQTT 5 properties
+// true on: property found (its value is in [value])
+static bool findProperty(const uint8_t* p, uint32_t length, uint8_t id, uint32_t &value) {
+  const uint8_t* end = p + length;
+  while (p < end) {
+    uint8_t current = *p++;
+    uint32_t size = propertyLength(current, p, end);
+    if (size == 0)
+      return false;
+    if (current == id && size <= 4) {
+      value = 0;
+      for (uint32_t i = 0; i < size; i++)
+        value = (value << 8) | p[i];
+      return true;
+    }
+    p += size;
+  }
+  return false;
+}
+
+
+// [arenaSize] is the largest inbound packet (minus its fixed header) that can be
+// parsed in one piece. The arena is only allocated once the first connection is made.
+ESPHelperMQTT::ESPHelperMQTT(uint16_t arenaSize) : _arenaSize(arenaSize) {
+}
+
+
+void ESPHelperMQTT::setClient(Client &client) {
+  _client = &client;
+}
+
+
+void ESPHelperMQTT::setServer(const char* host, uint16_t port) {
+  _host = host;
+  _port = port;
+}
+
+
+void ESPHelperMQTT::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  _callback = callback;
+  _callbackSet = true;
+}
+
+
+// open the connection and wait (max MQTT_CONNECT_TIMEOUT) for the broker to accept it
+// true on: CONNACK with return code 0
+// false on: no socket, refused or timed out
+bool ESPHelperMQTT::connect(const char* id,
+                            const char* user,
+                            const char* pass,
+                            const char* willTopic,
+                            uint8_t willQoS,
+                            bool willRetain,
+                            const char* willMessage) {
+  if (_client == NULL || _host == NULL || !allocate())
+    return false;
+
+  _connected = false;
+  if (!_client->connect(_host, _port))
+    return false;
+  resetRx();
+
+  // MQTT 5 limits only hold for one connection
+  _activeKeepAlive = _keepAlive;
+  _sendQuota = 0xFFFF;
+  _inflight = 0;
+  _maxQoS = 2;
+  _outAliasMax = 0;
+  _outAliasCount = 0;
+  for (uint8_t i = 0; i < MQTT5_TOPIC_ALIASES; i++)
+    _inAliases[i][0] = '\0';
+
+  bool v5 = _protocol == MQTT_V5;
+
+  // variable header is 10 bytes: protocol name, level, flags, keepalive
+  // (MQTT 5 adds the Topic Alias Maximum property)
+  uint32_t remaining = 10 + (v5 ? 1 + 3 : 0) + 2 + strlen(id);
+  uint8_t flags = 0x02;  // clean session
+
+  if (willTopic != NULL) {
+    remaining += (v5 ? 1 : 0) + 2 + strlen(willTopic) + 2 + strlen(willMessage);
+    flags |= 0x04 | ((willQoS & 0x03) << 3) | (willRetain ? 0x20 : 0);
+  }
+  if (user != NULL) {
+    remaining += 2 + strlen(user);
+    flags |= 0x80;
+    if (pass != NULL) {
+      remaining += 2 + strlen(pass);
+      flags |= 0x40;
+    }
+  }
+
+  beginPacket(MQTT_CONNECT, remaining);
+  putString("MQTT");
+  putByte(_protocol);
+  putByte(flags);
+  putWord(_keepAlive);
+  if (v5) {
+    putVarint(3);
+    putByte(MQTT5_TOPIC_ALIAS_MAX);
+    putWord(MQTT5_TOPIC_ALIASES);
+  }
+  putString(id);
+  if (willTopic != NULL) {
+    if (v5)
+      putVarint(0);  // no will properties
+    putString(willTopic);
+    putString(willMessage);
+  }
+  if (user != NULL) {
+    putString(user);
+    if (pass != NULL)
+      putString(pass);
+  }
+  if (!endPacket()) {
+    _client->stop();
+    return false;
+  }
+
+  unsigned long start = millis();
+  while (millis() - start < MQTT_CONNECT_TIMEOUT) {
+    uint8_t header = readPacket();
+    if (header != 0) {
+      if ((header & 0xF0) == MQTT_CONNACK && parseConnack(_arena.get(), _rxPos)) {
+        _connected = true;
+        _pingOutstanding = false;
+        _lastIn = millis();
+        return true;
+      }
+      break;
+    }
+    if (!_client->connected())
+      break;
+    yield();
+  }
+
+  _client->stop();
+  return false;
+}
+
+
+void ESPHelperMQTT::disconnect() {
+  if (_connected) {
+    uint8_t packet[2] = {MQTT_DISCONNECT, 0};
+    _client->write(packet, sizeof(packet));
+  }
+  _connected = false;
+  if (_client != NULL)
+    _client->stop();
+}
+
+
+bool ESPHelperMQTT::connected() {
+  if (_connected && !_client->connected())
+    _connected = false;
+  return _connected;
+}
+
+
+// handle keepalive and every packet that has arrived since the last call
+// true on: still connected
+// false on: connection lost (or ping timed out)
+bool ESPHelperMQTT::loop() {
+  if (!connected())
+    return false;
+
+  unsigned long now = millis();
+  unsigned long keepAlive = _activeKeepAlive * 1000UL;
+  if (keepAlive > 0 && (now - _lastIn > keepAlive || now - _lastOut > keepAlive)) {
+    // broker didn't answer the last ping within a keepalive period
+    if (_pingOutstanding) {
+      disconnect();
+      return false;
+    }
+
+    sendPing();
+  }
+
+  uint8_t header;
+  while ((header = readPacket()) != 0)
+    handlePacket(header, _arena.get(), _rxPos);
+
+  return connected();
+}
+
+
+bool ESPHelperMQTT::publish(const char* topic,
+                            const uint8_t* payload,
+                            unsigned int length,
+                            bool retain,
+                            uint8_t qos) {
+  if (!connected())
+    return false;
+
+  // QoS 2 is sent as QoS 1 (at least once), and never above what the broker allows
+  if (qos > 1)
+    qos = 1;
+  if (qos > _maxQoS)
+    qos = _maxQoS;
+
+  // the broker's Receive Maximum is used up - wait for PUBACKs
+  if (qos == 1 && _inflight >= _sendQuota)
+    return false;
+
+  if (!beginPublishPacket(topic, length, retain, qos))
+    return false;
+  put(payload, length);
+  return endPacket();
+}
+
+
+// start a QoS 0 publish whose [length] payload bytes follow through writePayload()
+bool ESPHelperMQTT::beginPublish(const char* topic, unsigned int length, bool retain) {
+  if (!connected())
+    return false;
+  return beginPublishPacket(topic, length, retain, 0);
+}
+
+
+size_t ESPHelperMQTT::writePayload(const uint8_t* buf, size_t size) {
+  put(buf, size);
+  return _txError ? 0 : size;
+}
+
+
+bool ESPHelperMQTT::endPublish() {
+  return endPacket();
+}
+
+
+bool ESPHelperMQTT::subscribe(const char* topic, uint8_t qos) {
+  return subscribe(&topic, &qos, 1);
+}
+
+
+// subscribe to [count] topics with a single SUBSCRIBE packet
+bool ESPHelperMQTT::subscribe(const char* const* topics, const uint8_t* qos, uint8_t count) {
+  if (!connected() || count == 0)
+    return false;
+
+  uint32_t remaining = _protocol == MQTT_V5 ? 3 : 2;
+  for (uint8_t i = 0; i < count; i++)
+    remaining += 2 + strlen(topics[i]) + 1;
+
+  beginPacket(MQTT_SUBSCRIBE | 0x02, remaining);
+  putWord(nextPacketId());
+  if (_protocol == MQTT_V5)
+    putVarint(0);
+  for (uint8_t i = 0; i < count; i++) {
+    putString(topics[i]);
+    putByte(qos[i] > 2 ? 2 : qos[i]);
+  }
+  return endPacket();
+}
+
+
+bool ESPHelperMQTT::unsubscribe(const char* topic) {
+  if (!connected())
+    return false;
+
+  beginPacket(MQTT_UNSUBSCRIBE | 0x02, (_protocol == MQTT_V5 ? 3 : 2) + 2 + strlen(topic));
+  putWord(nextPacketId());
+  if (_protocol == MQTT_V5)
+    putVarint(0);
+  putString(topic);
+  return endPacket();
+}
+
+
+// without a stream callback packets that don't fit in the arena are dropped
+void ESPHelperMQTT::setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE) {
+  _streamCallback = callback;
+  _streamCallbackSet = true;
+}
+
+
+// also stream PUBLISH packets larger than [packetSize] that would fit in the arena
+void ESPHelperMQTT::setStreamThreshold(uint32_t packetSize) {
+  _streamThreshold = packetSize;
+}
+
+
+// takes effect on the next connect (the broker only learns it from CONNECT)
+void ESPHelperMQTT::setKeepAlive(uint16_t seconds) {
+  _keepAlive = seconds;
+}
+
+
+// ping the broker outside the keepalive schedule (to measure the round trip)
+bool ESPHelperMQTT::ping() {
+  if (!connected() || _pingOutstanding)
+    return false;
+  return sendPing();
+}
+
+
+// called with the round trip time in micros whenever a PINGRESP arrives
+void ESPHelperMQTT::setPingCallback(std::function<void(uint32_t)> callback) {
+  _pingCallback = callback;
+  _pingCallbackSet = true;
+}
+
+
+uint16_t ESPHelperMQTT::getArenaSize() {
+  return _arenaSize;
+}
+
+
+// inbound packets thrown away because they didn't fit in the arena
+uint32_t ESPHelperMQTT::getDropped() {
+  return _dropped;
+}
+
+
+// MQTT_V311 (default) or MQTT_V5
+void ESPHelperMQTT::setProtocolVersion(uint8_t version) {
+  _protocol = version == MQTT_V5 ? MQTT_V5 : MQTT_V311;
+}
+
+
+// MQTT 5 only: the broker drops publishes it could not deliver within [seconds]
+// (0 = keep them forever)
+void ESPHelperMQTT::setMessageExpiry(uint32_t seconds) {
+  _messageExpiry = seconds;
+}
+
+
+// QoS 1 publishes that can still be sent before the broker's Receive Maximum is reached
+uint16_t ESPHelperMQTT::getSendQuota() {
+  return _inflight < _sendQuota ? _sendQuota - _inflight : 0;
+}
+
+
+// free the inbound arena while disconnected (the next connect() allocates it again)
+void ESPHelperMQTT::releaseBuffers() {
+  if (_connected)
+    return;
+  _arena.reset();
+  resetRx();
+}
+
+
+bool ESPHelperMQTT::allocate() {
+  if (!_arena)
+    _arena.reset(new uint8_t[_arenaSize + 1]);
+  return (bool)_arena;
+}
+
+
+void ESPHelperMQTT::resetRx() {
+  _rxState = RX_TYPE;
+  _rxPos = 0;
+}
+
+
+// read whatever the socket has without blocking
+// returns the fixed header byte once a whole packet is in the arena
+// (its length is then in _rxPos), 0 if no packet is complete yet
+uint8_t ESPHelperMQTT::readPacket() {
+  if (_client == NULL)
+    return 0;
+
+  int avail;
+  while ((avail = _client->available()) > 0) {
+    switch (_rxState) {
+      case RX_TYPE:
+        _rxHeader = _client->read();
+        _rxRemaining = 0;
+        _rxLengthBytes = 0;
+        _rxState = RX_LENGTH;
+        break;
+
+      case RX_LENGTH: {
+        uint8_t b = _client->read();
+        _rxRemaining |= (uint32_t)(b & 0x7F) << (7 * _rxLengthBytes++);
+        if ((b & 0x80) && _rxLengthBytes < 4)
+          break;
+
+        _rxPos = 0;
+        bool isPublish = (_rxHeader & 0xF0) == MQTT_PUBLISH;
+        bool tooBig = _rxRemaining > _arenaSize
+                      || (_streamThreshold > 0 && 1 + _rxLengthBytes + _rxRemaining > _streamThreshold);
+
+        if (_rxRemaining == 0) {
+          _rxState = RX_TYPE;
+          _lastIn = millis();
+          return _rxHeader;
+        } else if (isPublish && tooBig && _streamCallbackSet) {
+          _rxHeadLen = 0;
+          _rxState = RX_STREAM_HEAD;
+        } else if (_rxRemaining > _arenaSize) {
+          _dropped++;
+          _rxHeadLen = 0;
+          _rxPacketId = 0;
+          _rxState = RX_DISCARD;
+        } else {
+          _rxState = RX_BODY;
+        }
+        break;
+      }
+
+      case RX_BODY: {
+        uint32_t want = _rxRemaining - _rxPos;
+        if ((uint32_t)avail < want)
+          want = avail;
+        int got = _client->read(_arena.get() + _rxPos, want);
+        if (got <= 0)
+          return 0;
+        _rxPos += got;
+        if (_rxPos == _rxRemaining) {
+          _rxState = RX_TYPE;
+          _lastIn = millis();
+          return _rxHeader;
+        }
+        break;
+      }
+
+      case RX_DISCARD: {
+        uint32_t want = _rxRemaining - _rxPos;
+        if (want > _arenaSize)
+          want = _arenaSize;
+        if ((uint32_t)avail < want)
+          want = avail;
+        int got = _client->read(_arena.get(), want);
+        if (got <= 0)
+          return 0;
+        scanDiscarded(_arena.get(), got);
+        _rxPos += got;
+        if (_rxPos < _rxRemaining)
+          break;
+
+        // a dropped QoS 1/2 PUBLISH is still acknowledged - the broker would otherwise
+        // keep it in flight and send it again on every reconnect
+        _rxState = RX_TYPE;
+        _lastIn = millis();
+        if ((_rxHeader & 0xF0) == MQTT_PUBLISH && _rxRemaining >= 4u + _rxHeadLen) {
+          uint8_t qos = (_rxHeader >> 1) & 0x03;
+          if (qos == 1)
+            sendAck(MQTT_PUBACK, _rxPacketId);
+          else if (qos == 2)
+            sendAck(MQTT_PUBREC, _rxPacketId);
+        }
+        break;
+      }
+
+      case RX_STREAM_HEAD:
+        readStreamHead();
+        break;
+
+      case RX_STREAM_BODY:
+        readStreamBody();
+        break;
+    }
+  }
+  return 0;
+}
+
+
+// pick the topic length and packet id out of a PUBLISH that is being discarded -
+// [data] are the next [length] bytes of it (from offset _rxPos)
+void ESPHelperMQTT::scanDiscarded(const uint8_t* data, uint32_t length) {
+  if ((_rxHeader & 0xF0) != MQTT_PUBLISH || ((_rxHeader >> 1) & 0x03) == 0)
+    return;
+
+  for (uint32_t i = 0; i < length && _rxPos + i < 4u + _rxHeadLen; i++) {
+    uint32_t at = _rxPos + i;
+    if (at < 2)
+      _rxHeadLen = (_rxHeadLen << 8) | data[i];
+    else if (at == 2u + _rxHeadLen)
+      _rxPacketId = data[i] << 8;
+    else if (at == 3u + _rxHeadLen)
+      _rxPacketId |= data[i];
+  }
+}
+
+
+// how much of a streamed PUBLISH is head, as far as can be told from what has been read:
+// the 2 byte topic length, then topic and packet id, then (MQTT 5) the properties
+uint32_t ESPHelperMQTT::streamHeadLength() {
+  uint8_t* arena = _arena.get();
+  if (_rxPos < 2)
+    return 2;
+
+  uint8_t qos = (_rxHeader >> 1) & 0x03;
+  uint32_t length = 2 + ((arena[0] << 8) | arena[1]) + (qos > 0 ? 2 : 0);
+  if (_protocol != MQTT_V5 || _rxPos < length)
+    return length;
+
+  // property length is read one byte at a time until it is complete
+  uint32_t propLen;
+  uint8_t used = readVarint(arena + length, arena + _rxPos, propLen);
+  if (used == 0)
+    return _rxPos + 1;
+  return length + used + propLen;
+}
+
+
+// read topic (and packet id) of a streamed PUBLISH into the start of the arena
+void ESPHelperMQTT::readStreamHead() {
+  uint8_t* arena = _arena.get();
+  uint8_t qos = (_rxHeader >> 1) & 0x03;
+
+  // the head plus a terminator and at least one payload byte must fit in the arena
+  uint32_t want = streamHeadLength();
+  if (want > _rxRemaining || want + 2 > _arenaSize) {
+    disconnect();
+    return;
+  }
+
+  int got = _client->read(arena + _rxPos, want - _rxPos);
+  if (got <= 0)
+    return;
+  _rxPos += got;
+  if (_rxPos < streamHeadLength())
+    return;
+  _rxHeadLen = _rxPos;
+
+  uint16_t topicLen = (arena[0] << 8) | arena[1];
+  uint32_t pos = 2 + topicLen;
+  _rxPacketId = 0;
+  if (qos > 0) {
+    _rxPacketId = (arena[pos] << 8) | arena[pos + 1];
+    pos += 2;
+  }
+
+  uint32_t alias = 0;
+  if (_protocol == MQTT_V5) {
+    uint32_t propLen;
+    uint8_t used = readVarint(arena + pos, arena + _rxHeadLen, propLen);
+    findProperty(arena + pos + used, propLen, MQTT5_TOPIC_ALIAS, alias);
+  }
+
+  arena[2 + topicLen] = '\0';
+  _rxTopic = inboundTopic((char*)arena + 2, alias);
+  if (_rxTopic == NULL) {
+    disconnect();
+    return;
+  }
+
+  _rxTotal = _rxRemaining - _rxHeadLen;
+  _rxOffset = 0;
+  _rxState = RX_STREAM_BODY;
+
+  if (_rxTotal == 0)
+    readStreamBody();
+}
+
+
+// read the next chunk of a streamed payload into the arena (after the topic)
+// and hand it to the stream callback
+void ESPHelperMQTT::readStreamBody() {
+  uint8_t* arena = _arena.get();
+  uint16_t topicLen = (arena[0] << 8) | arena[1];
+  uint8_t* chunk = arena + topicLen + 3;
+  uint32_t chunkSize = _arenaSize - (topicLen + 3);
+
+  if (_rxTotal > 0) {
+    uint32_t want = _rxTotal - _rxOffset;
+    if (want > chunkSize)
+      want = chunkSize;
+    int avail = _client->available();
+    if ((uint32_t)avail < want)
+      want = avail;
+    int got = _client->read(chunk, want);
+    if (got <= 0)
+      return;
+
+    _streamCallback(_rxTopic, _rxOffset, chunk, got, _rxTotal);
+    _rxOffset += got;
+    if (_rxOffset < _rxTotal)
+      return;
+  } else {
+    _streamCallback(_rxTopic, 0, chunk, 0, 0);
+  }
+
+  uint8_t qos = (_rxHeader >> 1) & 0x03;
+  if (qos == 1)
+    sendAck(MQTT_PUBACK, _rxPacketId);
+  else if (qos == 2)
+    sendAck(MQTT_PUBREC, _rxPacketId);
+
+  _rxState = RX_TYPE;
+  _lastIn = millis();
+}
+
+
+void ESPHelperMQTT::handlePacket(uint8_t header, uint8_t* body, uint32_t length) {
+  switch (header & 0xF0) {
+    case MQTT_PUBLISH: {
+      uint8_t qos = (header >> 1) & 0x03;
+      if (length < 2)
+        return;
+      uint16_t topicLen = (body[0] << 8) | body[1];
+      uint32_t pos = 2 + topicLen;
+      if (pos + (qos > 0 ? 2 : 0) > length)
+        return;
+
+      uint16_t packetId = 0;
+      if (qos > 0) {
+        packetId = (body[pos] << 8) | body[pos + 1];
+        pos += 2;
+      }
+
+      uint32_t alias = 0;
+      if (_protocol == MQTT_V5) {
+        uint32_t propLen;
+        uint8_t used = readVarint(body + pos, body + length, propLen);
+        if (used == 0 || pos + used + propLen > length)
+          return;
+        findProperty(body + pos + used, propLen, MQTT5_TOPIC_ALIAS, alias);
+        pos += used + propLen;
+      }
+
+      // make the topic a C string without touching the payload:
+      // slide it back one byte over its length field and terminate it
+      memmove(body + 1, body + 2, topicLen);
+      body[1 + topicLen] = '\0';
+
+      // an alias the broker never defined is a protocol error
+      char* topic = inboundTopic((char*)body + 1, alias);
+      if (topic == NULL) {
+        disconnect();
+        return;
+      }
+
+      if (_callbackSet)
+        _callback(topic, body + pos, length - pos);
+
+      if (qos == 1)
+        sendAck(MQTT_PUBACK, packetId);
+      else if (qos == 2)
+        sendAck(MQTT_PUBREC, packetId);
+      break;
+    }
+
+    case MQTT_PUBREL:
+      if (length >= 2)
+        sendAck(MQTT_PUBCOMP, (body[0] << 8) | body[1]);
+      break;
+
+    case MQTT_PINGREQ: {
+      uint8_t packet[2] = {MQTT_PINGRESP, 0};
+      _client->write(packet, sizeof(packet));
+      break;
+    }
+
+    case MQTT_PINGRESP:
+      if (_pingOutstanding && _pingCallbackSet)
+        _pingCallback(micros() - _pingSent);
+      _pingOutstanding = false;
+      break;
+
+    case MQTT_PUBACK:
+      if (_inflight > 0)
+        _inflight--;
+      break;
+
+    // MQTT 5 brokers say why they are closing the connection
+    case MQTT_DISCONNECT:
+      _connected = false;
+      _client->stop();
+      break;
+
+    // SUBACK / UNSUBACK need no answer
+    default:
+      break;
+  }
+}
+
+
+// true on: broker accepted the connection
+// MQTT 5 brokers also send their limits along, these are kept for this connection
+bool ESPHelperMQTT::parseConnack(uint8_t* body, uint32_t length) {
+  if (length < 2 || body[1] != 0)
+    return false;
+  if (_protocol != MQTT_V5)
+    return true;
+
+  uint32_t propLen;
+  uint8_t used = readVarint(body + 2, body + length, propLen);
+  if (used == 0 || 2 + used + propLen > length)
+    return false;
+
+  uint8_t* props = body + 2 + used;
+  uint32_t value;
+  if (findProperty(props, propLen, MQTT5_RECEIVE_MAXIMUM, value) && value > 0)
+    _sendQuota = value;
+  if (findProperty(props, propLen, MQTT5_TOPIC_ALIAS_MAX, value))
+    _outAliasMax = value;
+  if (findProperty(props, propLen, MQTT5_MAXIMUM_QOS, value))
+    _maxQoS = value;
+  if (findProperty(props, propLen, MQTT5_SERVER_KEEP_ALIVE, value))
+    _activeKeepAlive = value;
+  return true;
+}
+
+
+// write the PUBLISH header for a [length] byte payload
+// MQTT 5 replaces the topic with its alias once the broker knows it and adds the message expiry
+bool ESPHelperMQTT::beginPublishPacket(const char* topic, unsigned int length, bool retain, uint8_t qos) {
+  bool sendTopic = true;
+  uint16_t alias = 0;
+  uint8_t propLen = 0;
+  if (_protocol == MQTT_V5) {
+    alias = outboundAlias(topic, sendTopic);
+    propLen = (alias > 0 ? 3 : 0) + (_messageExpiry > 0 ? 5 : 0);
+  }
+
+  uint16_t topicLen = sendTopic ? strlen(topic) : 0;
+  uint32_t remaining = 2 + topicLen + (qos > 0 ? 2 : 0) + length;
+  if (_protocol == MQTT_V5)
+    remaining += 1 + propLen;
+
+  beginPacket(MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0), remaining);
+  putWord(topicLen);
+  put((const uint8_t*)topic, topicLen);
+  if (qos > 0) {
+    putWord(nextPacketId());
+    _inflight++;
+  }
+
+  if (_protocol == MQTT_V5) {
+    putVarint(propLen);
+    if (alias > 0) {
+      putByte(MQTT5_TOPIC_ALIAS);
+      putWord(alias);
+    }
+    if (_messageExpiry > 0) {
+      putByte(MQTT5_MESSAGE_EXPIRY);
+      putWord(_messageExpiry >> 16);
+      putWord(_messageExpiry & 0xFFFF);
+    }
+  }
+  return !_txError;
+}
+
+
+// alias to publish [topic] under (0 if the broker allows no more or the topic is too long)
+// [sendTopic] is cleared when the broker already knows the alias
+uint16_t ESPHelperMQTT::outboundAlias(const char* topic, bool &sendTopic) {
+  sendTopic = true;
+  for (uint8_t i = 0; i < _outAliasCount; i++) {
+    if (strcmp(_outAliases[i], topic) == 0) {
+      sendTopic = false;
+      return i + 1;
+    }
+  }
+
+  if (_outAliasCount >= _outAliasMax || _outAliasCount == MQTT5_TOPIC_ALIASES
+      || strlen(topic) >= INBOUND_TOPIC_SIZE)
+    return 0;
+
+  strcpy(_outAliases[_outAliasCount], topic);
+  return ++_outAliasCount;
+}
+
+
+// topic of an inbound PUBLISH: an empty topic means the one its alias stands for,
+// a topic sent along with an alias (re)defines the alias
+// returns NULL for an alias that was never defined
+char* ESPHelperMQTT::inboundTopic(char* topic, uint16_t alias) {
+  if (alias == 0)
+    return topic;
+  if (alias > MQTT5_TOPIC_ALIASES)
+    return NULL;
+
+  char* known = _inAliases[alias - 1];
+  if (topic[0] == '\0')
+    return known[0] != '\0' ? known : NULL;
+
+  // topics too long to keep leave the alias undefined
+  if (strlen(topic) < INBOUND_TOPIC_SIZE)
+    strcpy(known, topic);
+  else
+    known[0] = '\0';
+  return topic;
+}
+
+
+// start building an outbound packet: fixed header + remaining length
+bool ESPHelperMQTT::beginPacket(uint8_t header, uint32_t remaining) {
+  _txLen = 0;
+  _txError = false;
+  putByte(header);
+  putVarint(remaining);
+  return true;
+}
+
+
+void ESPHelperMQTT::putVarint(uint32_t value) {
+  do {
+    uint8_t b = value & 0x7F;
+    value >>= 7;
+    if (value > 0)
+      b |= 0x80;
+    putByte(b);
+  } while (value > 0);
+}
+
+
+void ESPHelperMQTT::putByte(uint8_t b) {
+  if (_txLen == sizeof(_tx))
+    flushTx();
+  _tx[_txLen++] = b;
+}
+
+
+void ESPHelperMQTT::putWord(uint16_t w) {
+  putByte(w >> 8);
+  putByte(w & 0xFF);
+}
+
+
+void ESPHelperMQTT::putString(const char* str) {
+  uint16_t length = strlen(str);
+  putWord(length);
+  put((const uint8_t*)str, length);
+}
+
+
+// small pieces are collected in the tx buffer, anything that doesn't fit
+// is written straight from the caller's memory
+void ESPHelperMQTT::put(const uint8_t* data, size_t size) {
+  if (_txLen + size <= sizeof(_tx)) {
+    memcpy(_tx + _txLen, data, size);
+    _txLen += size;
+    return;
+  }
+
+  flushTx();
+  if (size >= sizeof(_tx)) {
+    if (_client->write(data, size) != size)
+      _txError = true;
+  } else {
+    memcpy(_tx, data, size);
+    _txLen = size;
+  }
+}
+
+
+void ESPHelperMQTT::flushTx() {
+  if (_txLen == 0)
+    return;
+  if (_client->write(_tx, _txLen) != _txLen)
+    _txError = true;
+  _txLen = 0;
+}
+
+
+// send whatever is left of the packet being built
+// true on: every byte was accepted by the socket
+bool ESPHelperMQTT::endPacket() {
+  flushTx();
+  _lastOut = millis();
+  return !_txError;
+}
+
+
+bool ESPHelperMQTT::sendAck(uint8_t header, uint16_t packetId) {
+  uint8_t packet[4] = {header, 0x02, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+  _lastOut = millis();
+  return _client->write(packet, sizeof(packet)) == sizeof(packet);
+}
+
+
+// the reply has to arrive within a keepalive period, so the wait starts now
+bool ESPHelperMQTT::sendPing() {
+  uint8_t packet[2] = {MQTT_PINGREQ, 0};
+  unsigned long now = millis();
+  _lastOut = now;
+  _lastIn = now;
+  _pingSent = micros();
+  _pingOutstanding = true;
+  return _client->write(packet, sizeof(packet)) == sizeof(packet);
+}
+
+
+// packet ids run 1..65535 (0 is not allowed)
+uint16_t ESPHelperMQTT::nextPacketId() {
+  if (++_packetId == 0)
+    _packetId = 1;
+  return _packetId;
+}
@@ -0,0 +1,205 @@
+/*
+ESPHelperMQTT.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_MQTT_H
+#define ESPHELPER_MQTT_H
+
+#include <memory>
+#include "ESPHelperTransport.h"
+
+
+// MQTT packet types (upper nibble of the fixed header)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_PUBREC      0x50
+#define MQTT_PUBREL      0x60
+#define MQTT_PUBCOMP     0x70
+#define MQTT_SUBSCRIBE   0x80
+#define MQTT_SUBACK      0x90
+#define MQTT_UNSUBSCRIBE 0xA0
+#define MQTT_UNSUBACK    0xB0
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+// protocol levels for setProtocolVersion()
+#define MQTT_V311 4
+#define MQTT_V5   5
+
+// MQTT 5 properties that are sent or acted on
+#define MQTT5_MESSAGE_EXPIRY     0x02
+#define MQTT5_SERVER_KEEP_ALIVE  0x13
+#define MQTT5_RECEIVE_MAXIMUM    0x21
+#define MQTT5_TOPIC_ALIAS_MAX    0x22
+#define MQTT5_TOPIC_ALIAS        0x23
+#define MQTT5_MAXIMUM_QOS        0x24
+
+
+// Built-in MQTT 3.1.1 (or 5) client.
+// Inbound packets are read in bulk into one arena allocated up front and parsed where
+// they lie - the callback gets pointers into the arena, nothing is copied.
+// PUBLISH packets larger than the arena are streamed to the stream callback.
+// Outbound packets are collected in a small buffer and large payloads are written
+// straight from the caller's memory. Supports QoS 0/1 publishing, multi-topic
+// SUBSCRIBE and a keepalive that can be changed at run time.
+// With setProtocolVersion(MQTT_V5) it speaks MQTT 5 instead: topics are replaced by
+// topic aliases in both directions, QoS 1 publishes stay within the broker's
+// Receive Maximum and publishes can carry a message expiry.
+class ESPHelperMQTT : public ESPHelperTransport {
+
+  public:
+
+    ESPHelperMQTT(uint16_t arenaSize = MQTT_ARENA_SIZE);
+
+    void setClient(Client &client);
+    void setServer(const char* host, uint16_t port);
+    void setCallback(MQTT_CALLBACK_SIGNATURE);
+
+    bool connect(const char* id,
+                 const char* user,
+                 const char* pass,
+                 const char* willTopic,
+                 uint8_t willQoS,
+                 bool willRetain,
+                 const char* willMessage);
+    void disconnect();
+    bool connected();
+    bool loop();
+
+    bool publish(const char* topic,
+                 const uint8_t* payload,
+                 unsigned int length,
+                 bool retain,
+                 uint8_t qos);
+
+    bool beginPublish(const char* topic, unsigned int length, bool retain);
+    size_t writePayload(const uint8_t* buf, size_t size);
+    bool endPublish();
+
+    bool subscribe(const char* topic, uint8_t qos);
+    bool subscribe(const char* const* topics, const uint8_t* qos, uint8_t count);
+    bool unsubscribe(const char* topic);
+
+    void setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE);
+    void setStreamThreshold(uint32_t packetSize);
+    void setKeepAlive(uint16_t seconds);
+    bool canSetKeepAlive() { return true; }
+    void releaseBuffers();
+
+    bool ping();
+    bool canPing() { return true; }
+    void setPingCallback(std::function<void(uint32_t)> callback);
+
+    uint16_t getArenaSize();
+    uint32_t getDropped();
+
+    // MQTT 5 (all take effect on the next connect)
+    void setProtocolVersion(uint8_t version);
+    void setMessageExpiry(uint32_t seconds);
+    uint16_t getSendQuota();
+
+  private:
+
+    enum rxState {RX_TYPE, RX_LENGTH, RX_BODY, RX_DISCARD, RX_STREAM_HEAD, RX_STREAM_BODY};
+
+    bool allocate();
+    void resetRx();
+    uint8_t readPacket();
+    void handlePacket(uint8_t header, uint8_t* body, uint32_t length);
+    void readStreamHead();
+    void readStreamBody();
+    void scanDiscarded(const uint8_t* data, uint32_t length);
+
+    bool parseConnack(uint8_t* body, uint32_t length);
+    bool beginPublishPacket(const char* topic, unsigned int length, bool retain, uint8_t qos);
+    uint16_t outboundAlias(const char* topic, bool &sendTopic);
+    char* inboundTopic(char* topic, uint16_t alias);
+    uint32_t streamHeadLength();
+
+    bool beginPacket(uint8_t header, uint32_t remaining);
+    void putVarint(uint32_t value);
+    void putByte(uint8_t b);
+    void putWord(uint16_t w);
+    void putString(const char* str);
+    void put(const uint8_t* data, size_t size);
+    void flushTx();
+    bool endPacket();
+    bool sendAck(uint8_t header, uint16_t packetId);
+    bool sendPing();
+    uint16_t nextPacketId();
+
+    Client *_client = NULL;
+    const char* _host = NULL;
+    uint16_t _port = 1883;
+
+    std::function<void(char*, uint8_t*, unsigned int)> _callback;
+    bool _callbackSet = false;
+    std::function<void(char*, unsigned int, uint8_t*, unsigned int, unsigned int)> _streamCallback;
+    bool _streamCallbackSet = false;
+    uint32_t _streamThreshold = 0;
+
+    // inbound - one extra byte past the arena so callbacks can null terminate a full payload
+    std::unique_ptr<uint8_t[]> _arena;
+    uint16_t _arenaSize;
+    uint8_t _rxState = RX_TYPE;
+    uint8_t _rxHeader = 0;
+    uint8_t _rxLengthBytes = 0;
+    uint32_t _rxRemaining = 0;
+    uint32_t _rxPos = 0;
+    uint16_t _rxHeadLen = 0;
+    uint16_t _rxPacketId = 0;
+    uint32_t _rxOffset = 0;
+    uint32_t _rxTotal = 0;
+    uint32_t _dropped = 0;
+    char* _rxTopic = NULL;
+
+    // outbound
+    uint8_t _tx[MQTT_TX_BUFFER_SIZE];
+    uint16_t _txLen = 0;
+    bool _txError = false;
+    uint16_t _packetId = 0;
+
+    uint16_t _keepAlive = MQTT_KEEPALIVE;
+    uint16_t _activeKeepAlive = MQTT_KEEPALIVE;  // what the broker agreed to
+    unsigned long _lastIn = 0;
+    unsigned long _lastOut = 0;
+    bool _pingOutstanding = false;
+    uint32_t _pingSent = 0;
+    std::function<void(uint32_t)> _pingCallback;
+    bool _pingCallbackSet = false;
+    bool _connected = false;
+
+    // MQTT 5 state - aliases only live as long as the connection
+    uint8_t _protocol = MQTT_V311;
+    uint32_t _messageExpiry = 0;
+    uint16_t _sendQuota = 0xFFFF;   // broker's Receive Maximum
+    uint16_t _inflight = 0;         // QoS 1 publishes not acknowledged yet
+    uint8_t _maxQoS = 2;
+    uint16_t _outAliasMax = 0;      // broker's Topic Alias Maximum
+    uint8_t _outAliasCount = 0;
+    char _outAliases[MQTT5_TOPIC_ALIASES][INBOUND_TOPIC_SIZE];
+    char _inAliases[MQTT5_TOPIC_ALIASES][INBOUND_TOPIC_SIZE];
+};
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ESPHelperMQTTSN.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ESPHelperMQTTSN.h"
+
+
+ESPHelperMQTTSN::ESPHelperMQTTSN() {
+}
+
+
+// set the gateway and open the local UDP socket
+// (the host name is looked up again on the first send if WiFi isn't up yet)
+// true on: socket open
+bool ESPHelperMQTTSN::begin(const char* gatewayHost, uint16_t port) {
+  if (gatewayHost == NULL || gatewayHost[0] == '\0')
+    return false;
+
+  _host = gatewayHost;
+  _port = port;
+  _resolved = false;
+  _connected = false;
+  _enabled = _udp.begin(port) == 1;
+  return _enabled;
+}
+
+
+void ESPHelperMQTTSN::end() {
+  if (_connected) {
+    uint8_t packet[2] = {2, MQTTSN_DISCONNECT};
+    sendPacket(packet, sizeof(packet), NULL, 0);
+  }
+  _udp.stop();
+  _enabled = false;
+  _connected = false;
+  _connecting = false;
+}
+
+
+bool ESPHelperMQTTSN::isEnabled() {
+  return _enabled;
+}
+
+
+// ask the gateway for a connection (needed for QoS 0, QoS -1 works without one)
+// the CONNECT is (re)sent from loop() until the gateway accepts it.
+// [clientId] is copied (and cut to 23 characters)
+void ESPHelperMQTTSN::connect(const char* clientId, uint16_t keepAlive) {
+  strncpy(_clientId, clientId, sizeof(_clientId) - 1);
+  _clientId[sizeof(_clientId) - 1] = '\0';
+  _connecting = true;
+  _keepAlive = keepAlive;
+  _connected = false;
+  _lastConnect = millis() - MQTTSN_RETRY;
+}
+
+
+bool ESPHelperMQTTSN::connected() {
+  return _connected;
+}
+
+
+// handle replies from the gateway, keepalive and connection retries
+void ESPHelperMQTTSN::loop() {
+  if (!_enabled)
+    return;
+
+  readPackets();
+
+  if (!_connecting)
+    return;
+
+  unsigned long now = millis();
+  if (!_connected) {
+    if (now - _lastConnect >= MQTTSN_RETRY)
+      sendConnect();
+    return;
+  }
+
+  unsigned long keepAlive = _keepAlive * 1000UL;
+  if (keepAlive > 0 && (now - _lastIn > keepAlive || now - _lastOut > keepAlive)) {
+    // gateway didn't answer the last ping within a keepalive period
+    if (_pingOutstanding) {
+      _connected = false;
+      return;
+    }
+
+    uint8_t packet[2] = {2, MQTTSN_PINGREQ};
+    sendPacket(packet, sizeof(packet), NULL, 0);
+    _lastIn = now;
+    _pingOutstanding = true;
+  }
+}
+
+
+// map a topic name to the id it is predefined as on the gateway
+// true on: added (or the id of an existing mapping changed)
+// false on: table full (MQTTSN_TOPICS)
+bool ESPHelperMQTTSN::addTopic(const char* topic, uint16_t topicId) {
+  for (uint8_t i = 0; i < _topicCount; i++) {
+    if (strcmp(_topics[i], topic) == 0) {
+      _topicIds[i] = topicId;
+      return true;
+    }
+  }
+
+  if (_topicCount == MQTTSN_TOPICS)
+    return false;
+
+  _topics[_topicCount] = topic;
+  _topicIds[_topicCount] = topicId;
+  _topicCount++;
+  return true;
+}
+
+
+// predefined id of a topic added with addTopic() or -1
+int32_t ESPHelperMQTTSN::findTopic(const char* topic) {
+  for (uint8_t i = 0; i < _topicCount; i++) {
+    if (strcmp(_topics[i], topic) == 0)
+      return _topicIds[i];
+  }
+  return -1;
+}
+
+
+// publish to a predefined topic id at QoS -1 or 0 (anything higher is sent as 0)
+// true on: datagram handed to the network
+// false on: not enabled, gateway unknown, QoS 0 without a connection or send failed
+bool ESPHelperMQTTSN::publish(uint16_t topicId, const uint8_t* payload, unsigned int length, int8_t qos, bool retain) {
+  if (!_enabled || (qos >= 0 && !_connected)) {
+    _failed++;
+    return false;
+  }
+
+  uint8_t flags = (qos < 0 ? MQTTSN_FLAG_QOS_M1 : 0) | (retain ? MQTTSN_FLAG_RETAIN : 0) | MQTTSN_TOPIC_PREDEFINED;
+
+  // 1 byte length up to 255, otherwise 0x01 followed by a 2 byte length
+  uint8_t header[9];
+  uint8_t pos = 0;
+  uint32_t total = 6 + length;
+  if (total + 1 <= 255) {
+    header[pos++] = total + 1;
+  } else {
+    total += 3;
+    if (total > 0xFFFF) {
+      _failed++;
+      return false;
+    }
+    header[pos++] = 0x01;
+    header[pos++] = total >> 8;
+    header[pos++] = total & 0xFF;
+  }
+  header[pos++] = MQTTSN_PUBLISH;
+  header[pos++] = flags;
+  header[pos++] = topicId >> 8;
+  header[pos++] = topicId & 0xFF;
+  // message id is only meaningful for QoS 1/2
+  header[pos++] = 0;
+  header[pos++] = 0;
+
+  if (!sendPacket(header, pos, payload, length)) {
+    _failed++;
+    return false;
+  }
+  _sent++;
+  return true;
+}
+
+
+// publish by topic name (the name must have been mapped with addTopic())
+bool ESPHelperMQTTSN::publish(const char* topic, const uint8_t* payload, unsigned int length, int8_t qos, bool retain) {
+  int32_t topicId = findTopic(topic);
+  if (topicId < 0) {
+    _failed++;
+    return false;
+  }
+  return publish((uint16_t)topicId, payload, length, qos, retain);
+}
+
+
+uint32_t ESPHelperMQTTSN::getSent() {
+  return _sent;
+}
+
+
+// publishes that could not be sent (no connection, unknown topic, socket error)
+uint32_t ESPHelperMQTTSN::getFailed() {
+  return _failed;
+}
+
+
+bool ESPHelperMQTTSN::resolve() {
+  if (!_resolved && WiFi.status() == WL_CONNECTED)
+    _resolved = WiFi.hostByName(_host, _gateway) == 1;
+  return _resolved;
+}
+
+
+// write one datagram: header then payload straight from the caller's memory
+bool ESPHelperMQTTSN::sendPacket(const uint8_t* header, uint8_t headerLen, const uint8_t* payload, unsigned int length) {
+  if (!resolve())
+    return false;
+
+  if (_udp.beginPacket(_gateway, _port) != 1)
+    return false;
+  _udp.write(header, headerLen);
+  if (length > 0 && _udp.write(payload, length) != length)
+    return false;
+  if (_udp.endPacket() != 1)
+    return false;
+
+  _lastOut = millis();
+  return true;
+}
+
+
+bool ESPHelperMQTTSN::sendConnect() {
+  uint8_t idLen = strlen(_clientId);
+  uint8_t header[6] = {(uint8_t)(6 + idLen), MQTTSN_CONNECT, MQTTSN_FLAG_CLEAN, 0x01,
+                       (uint8_t)(_keepAlive >> 8), (uint8_t)(_keepAlive & 0xFF)};
+  _lastConnect = millis();
+  return sendPacket(header, sizeof(header), (const uint8_t*)_clientId, idLen);
+}
+
+
+// replies from the gateway (anything else that arrives is ignored)
+void ESPHelperMQTTSN::readPackets() {
+  uint8_t packet[8];
+  int size;
+  while ((size = _udp.parsePacket()) > 0) {
+    int got = _udp.read(packet, sizeof(packet));
+    if (got < 2 || (uint32_t)_udp.remoteIP() != (uint32_t)_gateway)
+      continue;
+
+    switch (packet[1]) {
+      case MQTTSN_CONNACK:
+        if (got >= 3 && packet[2] == 0) {
+          _connected = true;
+          _pingOutstanding = false;
+          _lastIn = millis();
+        }
+        break;
+
+      case MQTTSN_PINGRESP:
+        _pingOutstanding = false;
+        _lastIn = millis();
+        break;
+
+      case MQTTSN_DISCONNECT:
+        _connected = false;
+        _lastConnect = millis();
+        break;
+
+      default:
+        break;
+    }
+  }
+}
@@ -0,0 +1,112 @@
+/*
+ESPHelperMQTTSN.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef ESPHELPER_MQTTSN_H
+#define ESPHELPER_MQTTSN_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "sharedData.h"
+
+
+// MQTT-SN message types used by the fast path
+#define MQTTSN_CONNECT    0x04
+#define MQTTSN_CONNACK    0x05
+#define MQTTSN_PUBLISH    0x0C
+#define MQTTSN_PINGREQ    0x16
+#define MQTTSN_PINGRESP   0x17
+#define MQTTSN_DISCONNECT 0x18
+
+// publish flags: QoS -1 and the predefined topic id type
+#define MQTTSN_FLAG_QOS_M1      0x60
+#define MQTTSN_FLAG_RETAIN      0x10
+#define MQTTSN_FLAG_CLEAN       0x04
+#define MQTTSN_TOPIC_PREDEFINED 0x01
+
+// client ids are at most 23 characters
+#define MQTTSN_CLIENT_ID_SIZE 24
+
+
+// Publish-only MQTT-SN client over UDP for high rate sensor data.
+// Topics are predefined ids configured on the gateway (no REGISTER round trip),
+// each publish is a single datagram written straight from the caller's buffer.
+// QoS -1 needs no connection at all, QoS 0 waits until the gateway has
+// accepted a CONNECT (sent and kept alive from loop()).
+class ESPHelperMQTTSN {
+
+  public:
+
+    ESPHelperMQTTSN();
+
+    bool begin(const char* gatewayHost, uint16_t port = MQTTSN_PORT);
+    void end();
+
+    bool isEnabled();
+
+    void connect(const char* clientId, uint16_t keepAlive = MQTTSN_KEEPALIVE);
+    bool connected();
+    void loop();
+
+    bool addTopic(const char* topic, uint16_t topicId);
+    int32_t findTopic(const char* topic);
+
+    bool publish(uint16_t topicId, const uint8_t* payload, unsigned int length, int8_t qos = -1, bool retain = false);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, int8_t qos = -1, bool retain = false);
+
+    uint32_t getSent();
+    uint32_t getFailed();
+
+  private:
+
+    bool resolve();
+    bool sendPacket(const uint8_t* header, uint8_t headerLen, const uint8_t* payload, unsigned int length);
+    bool sendConnect();
+    void readPackets();
+
+    WiFiUDP _udp;
+    const char* _host = NULL;
+    uint16_t _port = MQTTSN_PORT;
+    IPAddress _gateway;
+    bool _enabled = false;
+    bool _resolved = false;
+
+    char _clientId[MQTTSN_CLIENT_ID_SIZE];
+    bool _connecting = false;
+    uint16_t _keepAlive = MQTTSN_KEEPALIVE;
+    bool _connected = false;
+    bool _pingOutstanding = false;
+    unsigned long _lastConnect = 0;
+    unsigned long _lastIn = 0;
+    unsigned long _lastOut = 0;
+
+    const char* _topics[MQTTSN_TOPICS];
+    uint16_t _topicIds[MQTTSN_TOPICS];
+    uint8_t _topicCount = 0;
+
+    uint16_t _msgId = 0;
+    uint32_t _sent = 0;
+    uint32_t _failed = 0;
+};
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ESPHelperMQTTUpdate.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ESPHelperMQTTUpdate.h"
+#include "ESPHelperText.h"
+
+
+// a message from the update topic (see the header for the format)
+void ESPHelperMQTTUpdate::handle(const uint8_t* payload, unsigned int length) {
+  if (length == 0)
+    return;
+
+  switch (payload[0]) {
+    case 'B':
+      start(payload + 1, length - 1);
+      break;
+    case 'C':
+      if (isRunning())
+        chunk(payload + 1, length - 1);
+      break;
+    case 'A':
+      abort();
+      break;
+  }
+}
+
+
+// send the latest status and ask again for a chunk that is overdue - returns the state
+// afterwards (MQTT_UPDATE_DONE once the image is written and verified and "done" is out)
+uint8_t ESPHelperMQTTUpdate::loop() {
+  if (_state == MQTT_UPDATE_RECEIVING && millis() - _lastChunk >= MQTT_UPDATE_TIMEOUT) {
+    if (++_requests > MQTT_UPDATE_RETRIES)
+      fail(MQTT_UPDATE_ERROR_TIMEOUT);
+    else {
+      _lastChunk = millis();
+      status("missing", _next);
+    }
+  }
+
+  if (_statusPending && _publisherSet && _statusTopic != NULL
+      && _publisher(_statusTopic, _status, false))
+    _statusPending = false;
+
+  // don't report DONE (the caller reboots on it) before the sender has been told
+  if (_state == MQTT_UPDATE_DONE && _statusPending)
+    return MQTT_UPDATE_RECEIVING;
+  return _state;
+}
+
+
+// the connection is back - tell the sender where to carry on
+void ESPHelperMQTTUpdate::resume() {
+  if (_state != MQTT_UPDATE_RECEIVING)
+    return;
+  _requests = 0;
+  _lastChunk = millis();
+  status("missing", _next);
+}
+
+
+// stop a running update (nothing is installed)
+void ESPHelperMQTTUpdate::abort() {
+  if (isRunning())
+    fail(MQTT_UPDATE_ERROR_ABORTED);
+}
+
+
+bool ESPHelperMQTTUpdate::isRunning() {
+  return _state == MQTT_UPDATE_RECEIVING;
+}
+
+
+uint8_t ESPHelperMQTTUpdate::getState() {
+  return _state;
+}
+
+
+uint32_t ESPHelperMQTTUpdate::getWritten() {
+  return _written;
+}
+
+
+uint32_t ESPHelperMQTTUpdate::getSize() {
+  return _size;
+}
+
+
+// chunks of the current or last update that arrived more than once
+uint32_t ESPHelperMQTTUpdate::getRetransmissions() {
+  return _retransmissions;
+}
+
+
+// why the last update failed: an Updater error or MQTT_UPDATE_ERROR_*
+int16_t ESPHelperMQTTUpdate::getError() {
+  return _error;
+}
+
+
+// where acks, requests for missing chunks and the result are published
+void ESPHelperMQTTUpdate::setStatusTopic(const char* topic) {
+  _statusTopic = topic;
+}
+
+
+void ESPHelperMQTTUpdate::setPublisher(std::function<bool(const char*, const char*, bool)> publisher) {
+  _publisher = publisher;
+  _publisherSet = true;
+}
+
+
+// report start, progress, retransmissions and the result of updates to [monitor]
+void ESPHelperMQTTUpdate::setMonitor(ESPHelperOTAMonitor* monitor) {
+  _monitor = monitor;
+}
+
+
+// "<size> <chunkSize> [md5]"
+void ESPHelperMQTTUpdate::start(const uint8_t* data, unsigned int length) {
+  // an update that is already coming in some other way wins
+  if (!isRunning() && _monitor != NULL && _monitor->isRunning()) {
+    status("error", MQTT_UPDATE_ERROR_BUSY);
+    return;
+  }
+  if (isRunning())
+    fail(MQTT_UPDATE_ERROR_ABORTED);
+
+  ESPHelperTokenizer fields(data, length, ' ');
+  int32_t size, chunkSize;
+  const char* md5 = NULL;
+  size_t md5Length = 0;
+  if (!fields.nextInt(size) || !fields.nextInt(chunkSize) || size <= 0
+      || chunkSize <= 0 || chunkSize > 0xFFFF
+      || (fields.next(md5, md5Length) && md5Length != 32 && md5Length != 0)) {
+    _error = MQTT_UPDATE_ERROR_BEGIN;
+    _state = MQTT_UPDATE_FAILED;
+    status("error", MQTT_UPDATE_ERROR_BEGIN);
+    return;
+  }
+
+  _error = 0;
+  _size = size;
+  _chunkSize = chunkSize;
+  _chunks = (_size + _chunkSize - 1) / _chunkSize;
+  _next = 0;
+  _highest = 0;
+  _written = 0;
+  _retransmissions = 0;
+  _requests = 0;
+  _gapReported = false;
+
+  if (_monitor != NULL)
+    _monitor->start(OTA_SOURCE_MQTT, _size);
+  _state = MQTT_UPDATE_RECEIVING;
+  if (!Update.begin(_size)) {
+    fail(Update.getError());
+    return;
+  }
+  _flashing = true;
+  if (md5Length == 32) {
+    char hex[33];
+    memcpy(hex, md5, 32);
+    hex[32] = '\0';
+    Update.setMD5(hex);
+  }
+
+  _lastChunk = millis();
+  status("ack", 0);
+}
+
+
+// <index> <data>
+void ESPHelperMQTTUpdate::chunk(const uint8_t* data, unsigned int length) {
+  if (length < 4)
+    return;
+  uint32_t index = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
+  data += 4;
+  length -= 4;
+  if (index >= _chunks)
+    return;
+
+  if (index < _highest) {
+    _retransmissions++;
+    if (_monitor != NULL)
+      _monitor->retransmission();
+  }
+  else
+    _highest = index + 1;
+
+  // already written - the sender rewound further than it had to
+  if (index < _next)
+    return;
+
+  // something in between was lost - everything up to it is dropped until it comes again
+  uint32_t expected = index + 1 < _chunks ? _chunkSize : _size - index * _chunkSize;
+  if (index > _next || length != expected) {
+    if (!_gapReported) {
+      _gapReported = true;
+      status("missing", _next);
+    }
+    return;
+  }
+
+  if (Update.write((uint8_t*)data, length) != length) {
+    fail(Update.getError());
+    return;
+  }
+  _written += length;
+  _next++;
+  _requests = 0;
+  _gapReported = false;
+  _lastChunk = millis();
+  if (_monitor != NULL)
+    _monitor->progress(_written, _size);
+
+  if (_next == _chunks)
+    finish();
+  else if (_next % MQTT_UPDATE_ACK_EVERY == 0)
+    status("ack", _next);
+}
+
+
+// every chunk is written - check the image and mark it for installing
+void ESPHelperMQTTUpdate::finish() {
+  _flashing = false;
+  if (!Update.end()) {
+    fail(Update.getError());
+    return;
+  }
+  _state = MQTT_UPDATE_DONE;
+  strcpy(_status, "done");
+  _statusPending = true;
+  if (_monitor != NULL)
+    _monitor->finish(true);
+}
+
+
+void ESPHelperMQTTUpdate::fail(int16_t error) {
+  // ending an incomplete update throws it away
+  if (_flashing) {
+    Update.end();
+    _flashing = false;
+  }
+  _error = error;
+  _state = MQTT_UPDATE_FAILED;
+  status("error", error);
+  if (_monitor != NULL)
+    _monitor->finish(false, error);
+}
+
+
+void ESPHelperMQTTUpdate::status(const char* text, int32_t value) {
+  snprintf(_status, sizeof(_status), "%s %ld", text, (long)value);
+  _statusPending = true;
+}
@@ -0,0 +1,96 @@
+/*
+ESPHelperMQTTUpdate.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef ESPHELPER_MQTT_UPDATE_H
+#define ESPHELPER_MQTT_UPDATE_H
+
+#include <Arduino.h>
+#include <Updater.h>
+#include "sharedData.h"
+#include "ESPHelperOTAMonitor.h"
+
+
+// Receives a firmware image published in numbered chunks and writes it to flash in order.
+// Messages on the update topic start with a type byte:
+//   'B' "<size> <chunkSize> [md5]"   start an update (a running one is thrown away)
+//   'C' <index, 4 bytes big endian> <data>   chunk [index] - chunkSize bytes, the last one less
+//   'A'   abort
+// Progress goes out on the status topic as text:
+//   "ack <n>"       chunks before n are written (every MQTT_UPDATE_ACK_EVERY chunks)
+//   "missing <n>"   chunk n is needed next - send again from there
+//   "done" / "error <code>"
+// Chunks that arrive out of order are dropped and asked for again, so the sender can
+// stream a window of chunks ahead of the last ack and rewind whenever it sees "missing".
+class ESPHelperMQTTUpdate {
+
+  public:
+
+    void handle(const uint8_t* payload, unsigned int length);
+    uint8_t loop();
+    void resume();
+    void abort();
+
+    bool isRunning();
+    uint8_t getState();
+    uint32_t getWritten();
+    uint32_t getSize();
+    uint32_t getRetransmissions();
+    int16_t getError();
+
+    void setStatusTopic(const char* topic);
+    void setPublisher(std::function<bool(const char*, const char*, bool)> publisher);
+    void setMonitor(ESPHelperOTAMonitor* monitor);
+
+  private:
+
+    void start(const uint8_t* data, unsigned int length);
+    void chunk(const uint8_t* data, unsigned int length);
+    void finish();
+    void fail(int16_t error);
+    void status(const char* text, int32_t value);
+
+    uint8_t _state = MQTT_UPDATE_IDLE;
+    int16_t _error = 0;
+    uint32_t _size = 0;
+    uint16_t _chunkSize = 0;
+    uint32_t _chunks = 0;
+    uint32_t _next = 0;               // chunk that has to come next
+    uint32_t _highest = 0;            // highest chunk seen (+1) - anything below arrives again
+    uint32_t _written = 0;
+    uint32_t _retransmissions = 0;
+    uint8_t _requests = 0;            // "missing" sent in a row without progress
+    bool _gapReported = false;
+    bool _flashing = false;
+    unsigned long _lastChunk = 0;
+
+    // the latest status wins - it is sent from loop(), not from inside the MQTT client
+    const char* _statusTopic = NULL;
+    char _status[24];
+    bool _statusPending = false;
+
+    std::function<bool(const char*, const char*, bool)> _publisher;
+    bool _publisherSet = false;
+    ESPHelperOTAMonitor* _monitor = NULL;
+};
+
+#endif
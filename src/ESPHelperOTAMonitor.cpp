@@ -0,0 +1,182 @@
+/*
+ESPHelperOTAMonitor.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperOTAMonitor.h"
+
+
+// marks a report in RTC memory (anything else there is left over or random)
+#define OTA_RTC_MAGIC 0x4F544152UL
+#define OTA_RTC_WORDS ((sizeof(otaReport) + 3) / 4)
+
+
+// an update from [source] started ([size] is 0 if the image size isn't known yet)
+void ESPHelperOTAMonitor::start(uint8_t source, uint32_t size) {
+  _report = otaReport();
+  _report.result = OTA_RESULT_RUNNING;
+  _report.source = source;
+  _report.size = size;
+  _report.freeHeap = ESP.getFreeHeap();
+  _started = millis();
+  _lastProgress = _started;
+  notify(OTA_EVENT_START);
+}
+
+
+// [received] of [size] bytes written - gaps since the last call count as stalls
+void ESPHelperOTAMonitor::progress(uint32_t received, uint32_t size) {
+  if (_report.result != OTA_RESULT_RUNNING)
+    return;
+
+  unsigned long now = millis();
+  uint32_t gap = now - _lastProgress;
+  if (gap >= OTA_STALL_TIME) {
+    _report.stalls++;
+    if (gap > _report.longestStall)
+      _report.longestStall = gap;
+  }
+  _lastProgress = now;
+
+  _report.received = received;
+  if (size > 0)
+    _report.size = size;
+  _report.duration = now - _started;
+  if (_report.duration > 0)
+    _report.bytesPerSecond = (uint64_t)received * 1000 / _report.duration;
+  notify(OTA_EVENT_PROGRESS);
+}
+
+
+// a chunk of the image arrived again (updates that are sent in chunks)
+void ESPHelperOTAMonitor::retransmission() {
+  if (_report.result == OTA_RESULT_RUNNING)
+    _report.retransmissions++;
+}
+
+
+// the update is over - the report is saved for after the reboot and left pending
+void ESPHelperOTAMonitor::finish(bool success, int16_t error) {
+  if (_report.result != OTA_RESULT_RUNNING)
+    return;
+
+  _report.duration = millis() - _started;
+  if (_report.duration > 0)
+    _report.bytesPerSecond = (uint64_t)_report.received * 1000 / _report.duration;
+  _report.result = success ? OTA_RESULT_SUCCESS : OTA_RESULT_FAILED;
+  _report.error = success ? 0 : error;
+  _pending = true;
+  save();
+  notify(success ? OTA_EVENT_END : OTA_EVENT_ERROR);
+}
+
+
+bool ESPHelperOTAMonitor::isRunning() {
+  return _report.result == OTA_RESULT_RUNNING;
+}
+
+
+// the running or last finished update (result is OTA_RESULT_NONE if there was none)
+const otaReport& ESPHelperOTAMonitor::getReport() {
+  return _report;
+}
+
+
+// pick up the report an update saved before the reboot
+// true on: a report was found (it is pending until cleared)
+bool ESPHelperOTAMonitor::restore() {
+  uint32_t words[OTA_RTC_WORDS + 2];
+  if (!ESP.rtcUserMemoryRead(OTA_RTC_OFFSET, words, sizeof(words)))
+    return false;
+  if (words[0] != OTA_RTC_MAGIC || words[OTA_RTC_WORDS + 1] != checksum(&words[1], OTA_RTC_WORDS))
+    return false;
+
+  memcpy((void*)&_report, &words[1], sizeof(otaReport));
+  _pending = true;
+  return true;
+}
+
+
+bool ESPHelperOTAMonitor::isPending() {
+  return _pending;
+}
+
+
+// the report has been dealt with - forget it (in RTC memory too)
+void ESPHelperOTAMonitor::clearPending() {
+  _pending = false;
+  uint32_t magic = 0;
+  ESP.rtcUserMemoryWrite(OTA_RTC_OFFSET, &magic, sizeof(magic));
+}
+
+
+// write the report as a line of comma separated values:
+// result,source,error,received,size,durationMs,bytesPerSecond,stalls,longestStallMs,freeHeap,retransmissions
+// (result is "ok", "failed" or "running") - returns the length written (or -1 if there is no report)
+int ESPHelperOTAMonitor::formatReport(char* buf, size_t size) {
+  if (_report.result == OTA_RESULT_NONE)
+    return -1;
+
+  const char* result = _report.result == OTA_RESULT_SUCCESS ? "ok"
+                       : _report.result == OTA_RESULT_FAILED ? "failed" : "running";
+  return snprintf(buf, size, "%s,%u,%d,%u,%u,%u,%u,%u,%u,%u,%u",
+                  result,
+                  (unsigned int)_report.source,
+                  (int)_report.error,
+                  (unsigned int)_report.received,
+                  (unsigned int)_report.size,
+                  (unsigned int)_report.duration,
+                  (unsigned int)_report.bytesPerSecond,
+                  (unsigned int)_report.stalls,
+                  (unsigned int)_report.longestStall,
+                  (unsigned int)_report.freeHeap,
+                  (unsigned int)_report.retransmissions);
+}
+
+
+// called on every start, progress update, end and error with the report so far
+void ESPHelperOTAMonitor::setCallback(std::function<void(uint8_t, const otaReport&)> callback) {
+  _callback = callback;
+  _callbackSet = true;
+}
+
+
+void ESPHelperOTAMonitor::notify(uint8_t event) {
+  if (_callbackSet)
+    _callback(event, _report);
+}
+
+
+void ESPHelperOTAMonitor::save() {
+  uint32_t words[OTA_RTC_WORDS + 2];
+  memset(words, 0, sizeof(words));
+  words[0] = OTA_RTC_MAGIC;
+  memcpy(&words[1], &_report, sizeof(otaReport));
+  words[OTA_RTC_WORDS + 1] = checksum(&words[1], OTA_RTC_WORDS);
+  ESP.rtcUserMemoryWrite(OTA_RTC_OFFSET, words, sizeof(words));
+}
+
+
+uint32_t ESPHelperOTAMonitor::checksum(const uint32_t* data, uint8_t words) {
+  uint32_t sum = OTA_RTC_MAGIC;
+  for (uint8_t i = 0; i < words; i++)
+    sum = (sum << 5 | sum >> 27) ^ data[i];
+  return sum;
+}
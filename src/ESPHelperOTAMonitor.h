@@ -0,0 +1,69 @@
+/*
+ESPHelperOTAMonitor.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_OTA_MONITOR_H
+#define ESPHELPER_OTA_MONITOR_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+
+
+// Keeps track of a firmware update: start time, bytes written, throughput, stalls
+// and how it ended. The finished report is saved in RTC user memory so it is still
+// there after the reboot that follows a successful update - it stays pending until
+// clearPending() (ESPHelper does that once it has been published).
+class ESPHelperOTAMonitor {
+
+  public:
+
+    void start(uint8_t source, uint32_t size);
+    void progress(uint32_t received, uint32_t size);
+    void retransmission();
+    void finish(bool success, int16_t error = 0);
+
+    bool isRunning();
+    const otaReport& getReport();
+
+    bool restore();
+    bool isPending();
+    void clearPending();
+
+    int formatReport(char* buf, size_t size);
+
+    void setCallback(std::function<void(uint8_t, const otaReport&)> callback);
+
+  private:
+
+    void notify(uint8_t event);
+    void save();
+    uint32_t checksum(const uint32_t* data, uint8_t words);
+
+    otaReport _report;
+    unsigned long _started = 0;
+    unsigned long _lastProgress = 0;
+    bool _pending = false;
+
+    std::function<void(uint8_t, const otaReport&)> _callback;
+    bool _callbackSet = false;
+};
+
+#endif
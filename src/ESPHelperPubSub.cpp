@@ -0,0 +1,116 @@
+/*
+ESPHelperPubSub.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperPubSub.h"
+
+
+ESPHelperPubSub::ESPHelperPubSub() {
+  _client.setClient(_streamClient);
+}
+
+
+// PubSub always reads through the stream client, which reads from [client]
+void ESPHelperPubSub::setClient(Client &client) {
+  _streamClient.setClient(client);
+}
+
+
+void ESPHelperPubSub::setServer(const char* host, uint16_t port) {
+  _client.setServer(host, port);
+}
+
+
+void ESPHelperPubSub::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  _client.setCallback(callback);
+}
+
+
+// PubSubClient leaves out anything that is NULL so a single call covers
+// every user/will combination
+bool ESPHelperPubSub::connect(const char* id,
+                              const char* user,
+                              const char* pass,
+                              const char* willTopic,
+                              uint8_t willQoS,
+                              bool willRetain,
+                              const char* willMessage) {
+  return _client.connect(id, user, pass, willTopic, willQoS, willRetain, willMessage);
+}
+
+
+void ESPHelperPubSub::disconnect() {
+  _client.disconnect();
+}
+
+
+bool ESPHelperPubSub::connected() {
+  return _client.connected();
+}
+
+
+bool ESPHelperPubSub::loop() {
+  return _client.loop();
+}
+
+
+bool ESPHelperPubSub::publish(const char* topic,
+                              const uint8_t* payload,
+                              unsigned int length,
+                              bool retain,
+                              uint8_t qos) {
+  return _client.publish(topic, payload, length, retain);
+}
+
+
+bool ESPHelperPubSub::beginPublish(const char* topic, unsigned int length, bool retain) {
+  return _client.beginPublish(topic, length, retain);
+}
+
+
+size_t ESPHelperPubSub::writePayload(const uint8_t* buf, size_t size) {
+  return _client.write(buf, size);
+}
+
+
+bool ESPHelperPubSub::endPublish() {
+  return _client.endPublish();
+}
+
+
+bool ESPHelperPubSub::subscribe(const char* topic, uint8_t qos) {
+  return _client.subscribe(topic, qos);
+}
+
+
+bool ESPHelperPubSub::unsubscribe(const char* topic) {
+  return _client.unsubscribe(topic);
+}
+
+
+void ESPHelperPubSub::setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE) {
+  _streamClient.setCallback(callback);
+}
+
+
+void ESPHelperPubSub::setStreamThreshold(uint32_t packetSize) {
+  _streamClient.setThreshold(packetSize);
+}
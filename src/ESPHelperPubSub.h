@@ -0,0 +1,77 @@
+/*
+ESPHelperPubSub.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_PUBSUB_H
+#define ESPHELPER_PUBSUB_H
+
+#include "ESPHelperTransport.h"
+#include "ESPHelperStreamClient.h"
+
+
+// Default transport - PubSubClient behind an ESPHelperStreamClient so payloads
+// larger than MQTT_MAX_PACKET_SIZE can still be streamed.
+// (publishes are always QoS 0, that is all PubSubClient can send)
+class ESPHelperPubSub : public ESPHelperTransport {
+
+  public:
+
+    ESPHelperPubSub();
+
+    void setClient(Client &client);
+    void setServer(const char* host, uint16_t port);
+    void setCallback(MQTT_CALLBACK_SIGNATURE);
+
+    bool connect(const char* id,
+                 const char* user,
+                 const char* pass,
+                 const char* willTopic,
+                 uint8_t willQoS,
+                 bool willRetain,
+                 const char* willMessage);
+    void disconnect();
+    bool connected();
+    bool loop();
+
+    bool publish(const char* topic,
+                 const uint8_t* payload,
+                 unsigned int length,
+                 bool retain,
+                 uint8_t qos);
+
+    bool beginPublish(const char* topic, unsigned int length, bool retain);
+    size_t writePayload(const uint8_t* buf, size_t size);
+    bool endPublish();
+
+    bool subscribe(const char* topic, uint8_t qos);
+    bool unsubscribe(const char* topic);
+    using ESPHelperTransport::subscribe;
+
+    void setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE);
+    void setStreamThreshold(uint32_t packetSize);
+
+  private:
+
+    PubSubClient _client;
+    ESPHelperStreamClient _streamClient;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ESPHelperRTT.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ESPHelperRTT.h"
+
+
+ESPHelperRTT::ESPHelperRTT() {
+}
+
+
+// record a round trip (the oldest sample drops out once the window is full)
+void ESPHelperRTT::addSample(uint32_t micros) {
+  _samples[_next] = micros;
+  _next = (_next + 1) % RTT_WINDOW;
+  if (_count < RTT_WINDOW)
+    _count++;
+  _total++;
+  _last = micros;
+}
+
+
+void ESPHelperRTT::addTimeout() {
+  _timeouts++;
+}
+
+
+uint8_t ESPHelperRTT::count() {
+  return _count;
+}
+
+
+// nearest rank percentile [pct] (0-100) of the current window, 0 without samples
+uint32_t ESPHelperRTT::percentile(uint8_t pct) {
+  uint32_t values[RTT_WINDOW];
+  uint8_t n = sorted(values);
+  if (n == 0)
+    return 0;
+
+  uint16_t rank = (pct * n + 99) / 100;
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+
+rttStats ESPHelperRTT::getStats() {
+  rttStats stats;
+  stats.samples = _total;
+  stats.timeouts = _timeouts;
+  stats.last = _last;
+
+  // sort once for all three
+  uint32_t values[RTT_WINDOW];
+  uint8_t n = sorted(values);
+  if (n > 0) {
+    stats.p50 = values[(50 * n + 99) / 100 - 1];
+    stats.p95 = values[(95 * n + 99) / 100 - 1];
+    stats.p99 = values[(99 * n + 99) / 100 - 1];
+  }
+  return stats;
+}
+
+
+void ESPHelperRTT::reset() {
+  _next = 0;
+  _count = 0;
+  _total = 0;
+  _timeouts = 0;
+  _last = 0;
+}
+
+
+// copy the window into [out] in ascending order (insertion sort - the window is small)
+uint8_t ESPHelperRTT::sorted(uint32_t* out) {
+  for (uint8_t i = 0; i < _count; i++) {
+    uint32_t value = _samples[i];
+    uint8_t j = i;
+    while (j > 0 && out[j - 1] > value) {
+      out[j] = out[j - 1];
+      j--;
+    }
+    out[j] = value;
+  }
+  return _count;
+}
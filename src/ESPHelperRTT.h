@@ -0,0 +1,61 @@
+/*
+ESPHelperRTT.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef ESPHELPER_RTT_H
+#define ESPHELPER_RTT_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+
+
+// Sliding window of broker round trip times.
+// Percentiles are worked out on demand from a sorted copy of the window,
+// adding a sample is only a store.
+class ESPHelperRTT {
+
+  public:
+
+    ESPHelperRTT();
+
+    void addSample(uint32_t micros);
+    void addTimeout();
+
+    uint8_t count();
+    uint32_t percentile(uint8_t pct);
+    rttStats getStats();
+
+    void reset();
+
+  private:
+
+    uint8_t sorted(uint32_t* out);
+
+    uint32_t _samples[RTT_WINDOW];
+    uint8_t _next = 0;
+    uint8_t _count = 0;
+    uint32_t _total = 0;
+    uint32_t _timeouts = 0;
+    uint32_t _last = 0;
+};
+
+#endif
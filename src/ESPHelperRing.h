@@ -0,0 +1,125 @@
+/*
+ESPHelperRing.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_RING_H
+#define ESPHELPER_RING_H
+
+#include <Arduino.h>
+#include <memory>
+
+
+// Ring of fixed size slots with one producer and one consumer, e.g. ESPHelperGPIO's
+// Ticker callback filling it and loop() draining it. On ESP8266 both run in the same
+// context - Ticker callbacks only run between loop() passes or while it waits in
+// delay()/yield(), never in the middle of a claim()/commit() or front()/pop() - so no
+// lock is needed. Slots are filled in place: claim() a slot, fill it and commit() it -
+// front() and pop() on the other side.
+// One slot is kept empty to tell a full ring from an empty one.
+template <typename T>
+class ESPHelperRing {
+
+  public:
+
+    // allocate room for [slots] entries (anything still queued is lost)
+    // true on: ring ready
+    // false on: zero slots requested or allocation failed
+    bool begin(uint16_t slots) {
+      end();
+      if (slots == 0)
+        return false;
+      _slots.reset(new T[slots + 1]);
+      if (!_slots)
+        return false;
+      _size = slots + 1;
+      return true;
+    }
+
+    void end() {
+      _slots.reset();
+      _size = 0;
+      _head = 0;
+      _tail = 0;
+    }
+
+    bool isEnabled() {
+      return _size > 0;
+    }
+
+    // producer - free slot to fill or NULL if the ring is full (counted as dropped)
+    T* claim() {
+      if (_size == 0)
+        return NULL;
+      if ((_tail + 1) % _size == _head) {
+        _dropped++;
+        return NULL;
+      }
+      return &_slots[_tail];
+    }
+
+    // producer - hand the claimed slot to the consumer
+    void commit() {
+      __sync_synchronize();
+      _tail = (_tail + 1) % _size;
+      _queued++;
+    }
+
+    // consumer - oldest entry or NULL if the ring is empty
+    T* front() {
+      if (_size == 0 || _head == _tail)
+        return NULL;
+      __sync_synchronize();
+      return &_slots[_head];
+    }
+
+    // consumer - release the entry returned by front()
+    void pop() {
+      if (_size == 0 || _head == _tail)
+        return;
+      __sync_synchronize();
+      _head = (_head + 1) % _size;
+    }
+
+    uint16_t count() {
+      if (_size == 0)
+        return 0;
+      return (_tail + _size - _head) % _size;
+    }
+
+    uint32_t getQueued() {
+      return _queued;
+    }
+
+    uint32_t getDropped() {
+      return _dropped;
+    }
+
+  private:
+
+    std::unique_ptr<T[]> _slots;
+    uint16_t _size = 0;
+    volatile uint16_t _head = 0;
+    volatile uint16_t _tail = 0;
+    volatile uint32_t _queued = 0;
+    volatile uint32_t _dropped = 0;
+};
+
+#endif
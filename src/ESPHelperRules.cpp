@@ -0,0 +1,303 @@
+/*
+ESPHelperRules.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "ESPHelperRules.h"
+#include "ESPHelper.h"
+
+
+ESPHelperRules::ESPHelperRules() {
+}
+
+
+// replace the current rules with the JSON [rules] array
+// true on: every rule compiled
+// false on: too many rules, a rule that doesn't make sense or out of arena space
+//           (no rules are active then)
+bool ESPHelperRules::compile(JsonArray &rules) {
+  clear();
+  if (!rules.success() || rules.size() == 0 || rules.size() > MAX_RULES)
+    return false;
+
+  _rules.reset(new localRule[rules.size()]);
+  _arena.reset(new char[RULES_ARENA_SIZE]);
+  if (!_rules || !_arena) {
+    clear();
+    return false;
+  }
+
+  // offset 0 is the empty string for fields a rule doesn't use
+  _arena[0] = '\0';
+  _arenaUsed = 1;
+
+  for (size_t i = 0; i < rules.size(); i++) {
+    JsonObject &json = rules[i];
+    if (!compileRule(json, _rules[i])) {
+      clear();
+      return false;
+    }
+  }
+  _count = rules.size();
+  return true;
+}
+
+
+void ESPHelperRules::clear() {
+  _rules.reset();
+  _arena.reset();
+  _count = 0;
+  _arenaUsed = 0;
+  _evaluations = 0;
+}
+
+
+// how rules publish (ESPHelper points this at its own publish)
+void ESPHelperRules::setPublisher(std::function<void(const char*, const char*)> publisher) {
+  _publisher = publisher;
+  _publisherSet = true;
+}
+
+
+// run the topic rules against a message sent or received by the device
+void ESPHelperRules::onMessage(const char* topic, const uint8_t* payload, unsigned int length) {
+  if (_firing)
+    return;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    localRule &rule = _rules[i];
+    if (rule.source != RULE_TOPIC)
+      continue;
+
+    _evaluations++;
+    if (ESPHelper::topicMatches(&_arena[rule.topic], topic) && matches(rule, payload, length))
+      fire(rule);
+  }
+}
+
+
+// sample the inputs of the gpio rules and fire on debounced edges
+void ESPHelperRules::loop() {
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < _count; i++) {
+    localRule &rule = _rules[i];
+    if (rule.source != RULE_GPIO)
+      continue;
+
+    uint8_t level = digitalRead(rule.pin);
+    if (level == rule.inputLevel) {
+      rule.changedAt = now;
+      continue;
+    }
+    if (now - rule.changedAt < RULES_DEBOUNCE)
+      continue;
+
+    rule.inputLevel = level;
+    rule.changedAt = now;
+    _evaluations++;
+    if (rule.condition == RULE_CHANGE
+        || (rule.condition == RULE_HIGH && level == HIGH)
+        || (rule.condition == RULE_LOW && level == LOW))
+      fire(rule);
+  }
+}
+
+
+uint8_t ESPHelperRules::count() {
+  return _count;
+}
+
+
+const localRule* ESPHelperRules::get(uint8_t index) {
+  if (index >= _count)
+    return NULL;
+  return &_rules[index];
+}
+
+
+// a string of a compiled rule (topic, value, publishTopic or payload)
+const char* ESPHelperRules::getString(uint16_t offset) {
+  if (!_arena || offset >= _arenaUsed)
+    return "";
+  return &_arena[offset];
+}
+
+
+// number of times a rule condition was checked
+uint32_t ESPHelperRules::getEvaluations() {
+  return _evaluations;
+}
+
+
+void ESPHelperRules::resetCounters() {
+  _evaluations = 0;
+  for (uint8_t i = 0; i < _count; i++)
+    _rules[i].hits = 0;
+}
+
+
+// one line per rule: index,source (topic or pin),hits
+void ESPHelperRules::printTo(Print &out) {
+  for (uint8_t i = 0; i < _count; i++) {
+    const localRule &rule = _rules[i];
+    out.print(i);
+    out.print(',');
+    if (rule.source == RULE_TOPIC)
+      out.print(&_arena[rule.topic]);
+    else
+      out.print(rule.pin);
+    out.print(',');
+    out.println((unsigned long)rule.hits);
+  }
+}
+
+
+bool ESPHelperRules::compileRule(JsonObject &json, localRule &rule) {
+  static const char* const conditions[] = {"any", "eq", "ne", "gt", "lt", "high", "low", "change"};
+  static const char* const actions[] = {"publish", "set", "toggle"};
+
+  const char* on = json["on"];
+  const char* condition = json["if"];
+  const char* action = json["do"];
+  if (on == NULL || action == NULL)
+    return false;
+
+  rule = localRule();
+  rule.source = strcmp(on, "gpio") == 0 ? RULE_GPIO : RULE_TOPIC;
+
+  rule.condition = rule.source == RULE_GPIO ? RULE_CHANGE : RULE_ANY;
+  if (condition != NULL) {
+    uint8_t i = 0;
+    while (i < sizeof(conditions) / sizeof(conditions[0]) && strcmp(condition, conditions[i]) != 0)
+      i++;
+    if (i == sizeof(conditions) / sizeof(conditions[0]))
+      return false;
+    rule.condition = i;
+  }
+
+  uint8_t i = 0;
+  while (i < sizeof(actions) / sizeof(actions[0]) && strcmp(action, actions[i]) != 0)
+    i++;
+  if (i == sizeof(actions) / sizeof(actions[0]))
+    return false;
+  rule.action = i;
+
+  // the condition has to fit the source
+  bool gpioCondition = rule.condition >= RULE_HIGH;
+  if (gpioCondition != (rule.source == RULE_GPIO))
+    return false;
+
+  if (rule.source == RULE_GPIO) {
+    if (!json.containsKey("pin"))
+      return false;
+    rule.pin = json["pin"].as<int>();
+    pinMode(rule.pin, json["pullup"].as<bool>() ? INPUT_PULLUP : INPUT);
+    rule.inputLevel = digitalRead(rule.pin);
+    rule.changedAt = millis();
+  } else {
+    const char* topic = json["topic"];
+    if (topic == NULL || (rule.topic = store(topic)) == 0)
+      return false;
+    if (rule.condition != RULE_ANY) {
+      const char* value = json["value"];
+      if (value == NULL || (rule.value = store(value)) == 0)
+        return false;
+      rule.number = atof(value);
+    }
+  }
+
+  if (rule.action == RULE_PUBLISH) {
+    const char* publishTopic = json["publish"];
+    const char* payload = json["payload"];
+    if (publishTopic == NULL || (rule.publishTopic = store(publishTopic)) == 0)
+      return false;
+    if (payload != NULL && payload[0] != '\0' && (rule.payload = store(payload)) == 0)
+      return false;
+  } else {
+    if (!json.containsKey("out"))
+      return false;
+    rule.outPin = json["out"].as<int>();
+    rule.level = json["level"].as<int>() ? HIGH : LOW;
+    pinMode(rule.outPin, OUTPUT);
+  }
+  return true;
+}
+
+
+// copy a string into the arena
+// returns its offset or 0 if the arena is full (or the string is empty)
+uint16_t ESPHelperRules::store(const char* str) {
+  size_t length = strlen(str);
+  if (length == 0 || _arenaUsed + length + 1 > RULES_ARENA_SIZE)
+    return 0;
+
+  uint16_t offset = _arenaUsed;
+  memcpy(&_arena[offset], str, length + 1);
+  _arenaUsed += length + 1;
+  return offset;
+}
+
+
+// compare the payload against the rule's value
+bool ESPHelperRules::matches(const localRule &rule, const uint8_t* payload, unsigned int length) {
+  if (rule.condition == RULE_ANY)
+    return true;
+
+  const char* value = &_arena[rule.value];
+  if (rule.condition == RULE_EQ || rule.condition == RULE_NE) {
+    bool equal = strlen(value) == length && memcmp(value, payload, length) == 0;
+    return equal == (rule.condition == RULE_EQ);
+  }
+
+  // numbers are short - anything longer can't be one
+  char number[16];
+  if (length == 0 || length >= sizeof(number))
+    return false;
+  memcpy(number, payload, length);
+  number[length] = '\0';
+  char* end;
+  float received = strtod(number, &end);
+  if (end == number)
+    return false;
+  return rule.condition == RULE_GT ? received > rule.number : received < rule.number;
+}
+
+
+void ESPHelperRules::fire(localRule &rule) {
+  rule.hits++;
+  switch (rule.action) {
+    case RULE_SET:
+      digitalWrite(rule.outPin, rule.level);
+      break;
+
+    case RULE_TOGGLE:
+      digitalWrite(rule.outPin, !digitalRead(rule.outPin));
+      break;
+
+    case RULE_PUBLISH:
+      if (_publisherSet) {
+        _firing = true;
+        _publisher(&_arena[rule.publishTopic], &_arena[rule.payload]);
+        _firing = false;
+      }
+      break;
+  }
+}
@@ -0,0 +1,82 @@
+/*
+ESPHelperRules.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef ESPHELPER_RULES_H
+#define ESPHELPER_RULES_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <memory>
+#include "sharedData.h"
+
+
+// On-device rules that react to messages and inputs without the broker:
+//   {"rules":[
+//     {"on":"gpio", "pin":0, "pullup":true, "if":"low", "do":"toggle", "out":12},
+//     {"on":"topic", "topic":"home/relay", "if":"eq", "value":"on", "do":"set", "out":12, "level":1},
+//     {"on":"topic", "topic":"home/temp", "if":"gt", "value":"30", "do":"publish",
+//      "publish":"home/fan", "payload":"on"}]}
+// "if" is any/eq/ne/gt/lt for topics (matched with wildcards) and high/low/change for inputs.
+// The JSON is compiled into a table of localRule with all strings in one arena, so
+// nothing is parsed or allocated when rules are evaluated. Messages published by a
+// rule do not trigger further rules.
+class ESPHelperRules {
+
+  public:
+
+    ESPHelperRules();
+
+    bool compile(JsonArray &rules);
+    void clear();
+
+    void setPublisher(std::function<void(const char*, const char*)> publisher);
+
+    void onMessage(const char* topic, const uint8_t* payload, unsigned int length);
+    void loop();
+
+    uint8_t count();
+    const localRule* get(uint8_t index);
+    const char* getString(uint16_t offset);
+    uint32_t getEvaluations();
+    void resetCounters();
+    void printTo(Print &out);
+
+  private:
+
+    bool compileRule(JsonObject &json, localRule &rule);
+    uint16_t store(const char* str);
+    bool matches(const localRule &rule, const uint8_t* payload, unsigned int length);
+    void fire(localRule &rule);
+
+    std::unique_ptr<localRule[]> _rules;
+    uint8_t _count = 0;
+    std::unique_ptr<char[]> _arena;
+    uint16_t _arenaUsed = 0;
+    uint32_t _evaluations = 0;
+    bool _firing = false;
+
+    std::function<void(const char*, const char*)> _publisher;
+    bool _publisherSet = false;
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ESPHelperSensor.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperSensor.h"
+
+
+ESPHelperSensors::ESPHelperSensors() {
+}
+
+
+// measure [sensor] every [intervalMs] and publish it to [topic] with [decimals] places.
+// The sensor and topic are not copied and must stay valid
+// returns the index of the sensor or -1 if MAX_SENSORS are added or begin() failed
+int8_t ESPHelperSensors::add(ESPHelperSensor &sensor, const char* topic, uint32_t intervalMs,
+                             uint8_t decimals, bool retain) {
+  if (_count == MAX_SENSORS || !sensor.begin())
+    return -1;
+
+  sensorSlot &slot = _slots[_count];
+  slot = sensorSlot();
+  slot.sensor = &sensor;
+  slot.topic = topic;
+  slot.interval = intervalMs;
+  slot.decimals = decimals;
+  slot.retain = retain;
+  slot.value = NAN;
+
+  // the first measurement starts on the next loop
+  slot.lastStart = millis() - intervalMs;
+  return _count++;
+}
+
+
+void ESPHelperSensors::clear() {
+  _count = 0;
+}
+
+
+// the function readings are published with (topic, payload, retain)
+void ESPHelperSensors::setPublisher(std::function<void(const char*, const char*, bool)> publisher) {
+  _publisher = publisher;
+  _publisherSet = true;
+}
+
+
+// called with the index and value of every valid reading
+void ESPHelperSensors::setCallback(std::function<void(int8_t, float)> callback) {
+  _callback = callback;
+  _callbackSet = true;
+}
+
+
+void ESPHelperSensors::loop() {
+  unsigned long now = millis();
+
+  for (uint8_t i = 0; i < _count; i++) {
+    sensorSlot &slot = _slots[i];
+
+    if (!slot.converting) {
+      if (now - slot.lastStart < slot.interval)
+        continue;
+      slot.lastStart = now;
+      if (slot.sensor->startConversion())
+        slot.converting = true;
+      else
+        slot.errors++;
+      continue;
+    }
+
+    if (slot.sensor->isReady()) {
+      slot.converting = false;
+      slot.lastDuration = now - slot.lastStart;
+      if (slot.lastDuration > slot.maxDuration)
+        slot.maxDuration = slot.lastDuration;
+      finish(i, slot);
+    }
+    else if (now - slot.lastStart >= SENSOR_TIMEOUT) {
+      slot.converting = false;
+      slot.errors++;
+    }
+  }
+}
+
+
+uint8_t ESPHelperSensors::count() {
+  return _count;
+}
+
+
+// sensor at [index] (settings, last value and counters) or NULL past the end of the table
+const sensorSlot* ESPHelperSensors::get(uint8_t index) {
+  if (index >= _count)
+    return NULL;
+  return &_slots[index];
+}
+
+
+// last valid reading of the sensor at [index] (NAN before the first one)
+float ESPHelperSensors::getValue(uint8_t index) {
+  if (index >= _count)
+    return NAN;
+  return _slots[index].value;
+}
+
+
+void ESPHelperSensors::finish(int8_t index, sensorSlot &slot) {
+  float value;
+  if (!slot.sensor->read(value)) {
+    slot.errors++;
+    return;
+  }
+
+  slot.value = value;
+  slot.reads++;
+
+  if (slot.topic != NULL && _publisherSet) {
+    char payload[24];
+    dtostrf(value, 1, slot.decimals, payload);
+    _publisher(slot.topic, payload, slot.retain);
+  }
+  if (_callbackSet)
+    _callback(index, value);
+}
@@ -0,0 +1,106 @@
+/*
+ESPHelperSensor.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_SENSOR_H
+#define ESPHELPER_SENSOR_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+
+
+// A sensor whose measurement is started, polled and read in separate steps so
+// a slow conversion never blocks loop() (see ESPHelperDS18B20 for an example).
+// None of the methods may wait for the sensor.
+class ESPHelperSensor {
+
+  public:
+
+    virtual ~ESPHelperSensor() {}
+
+    // called once when the sensor is added
+    virtual bool begin() { return true; }
+
+    // start a measurement - false if the sensor could not be started
+    virtual bool startConversion() = 0;
+
+    // true once the measurement can be read
+    virtual bool isReady() = 0;
+
+    // the finished measurement - false if the sensor did not give a valid one
+    virtual bool read(float &value) = 0;
+};
+
+
+struct sensorSlot{
+  ESPHelperSensor* sensor;
+  const char* topic;              //NULL to only keep the value / run the callback
+  uint32_t interval;
+  uint8_t decimals;
+  bool retain;
+
+  bool converting;
+  unsigned long lastStart;
+  float value;
+
+  uint32_t reads;                 //valid measurements
+  uint32_t errors;                //start/read failures and timeouts
+  uint32_t lastDuration;          //ms from start to ready for the last measurement
+  uint32_t maxDuration;
+};
+typedef struct sensorSlot sensorSlot;
+
+
+// Runs every added sensor from loop(): each call starts the measurements that are due
+// and reads the ones that finished, so conversions of several sensors overlap with
+// each other and with the network. Readings are published as text and passed to the callback.
+class ESPHelperSensors {
+
+  public:
+
+    ESPHelperSensors();
+
+    int8_t add(ESPHelperSensor &sensor, const char* topic, uint32_t intervalMs, uint8_t decimals, bool retain);
+    void clear();
+
+    void setPublisher(std::function<void(const char*, const char*, bool)> publisher);
+    void setCallback(std::function<void(int8_t, float)> callback);
+
+    void loop();
+
+    uint8_t count();
+    const sensorSlot* get(uint8_t index);
+    float getValue(uint8_t index);
+
+  private:
+
+    void finish(int8_t index, sensorSlot &slot);
+
+    sensorSlot _slots[MAX_SENSORS];
+    uint8_t _count = 0;
+
+    std::function<void(const char*, const char*, bool)> _publisher;
+    bool _publisherSet = false;
+    std::function<void(int8_t, float)> _callback;
+    bool _callbackSet = false;
+};
+
+#endif
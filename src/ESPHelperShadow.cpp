@@ -0,0 +1,449 @@
+/*
+ESPHelperShadow.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperShadow.h"
+
+
+// marks the reported version in RTC memory (anything else there is left over or random)
+#define SHADOW_RTC_MAGIC 0x53484457UL
+
+static const uint32_t powersOf10[TEXT_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+
+// report to [reportedTopic] (NULL to only follow desired state) and take desired
+// state from [desiredTopic] (NULL to only report). Fields are kept.
+// true on: at least one of the topics is set
+bool ESPHelperShadow::begin(const char* reportedTopic, const char* desiredTopic, bool retain) {
+  if (reportedTopic == NULL && desiredTopic == NULL)
+    return false;
+
+  _reportedTopic = reportedTopic;
+  _desiredTopic = desiredTopic;
+  _retain = retain;
+  _desiredSeen = false;
+  _enabled = true;
+  restoreVersion();
+  markAll();
+  return true;
+}
+
+
+void ESPHelperShadow::end() {
+  _enabled = false;
+}
+
+
+bool ESPHelperShadow::isEnabled() {
+  return _enabled;
+}
+
+
+// add a field - returns its handle or -1 if the table is full or the name is taken
+int8_t ESPHelperShadow::addBool(const char* name, bool initial) {
+  return addField(name, SHADOW_BOOL, initial ? 1 : 0);
+}
+
+
+int8_t ESPHelperShadow::addInt(const char* name, int32_t initial) {
+  return addField(name, SHADOW_INT, initial);
+}
+
+
+// a float reported and compared with [decimals] places (changes smaller than that
+// are not reported)
+int8_t ESPHelperShadow::addFloat(const char* name, float initial, uint8_t decimals) {
+  int8_t field = addField(name, SHADOW_FLOAT, 0);
+  if (field < 0)
+    return -1;
+  _fields[field].decimals = decimals > TEXT_MAX_DECIMALS ? TEXT_MAX_DECIMALS : decimals;
+  setFloat(field, initial);
+  return field;
+}
+
+
+// a string of up to [maxLength] characters (longer values are cut short)
+// -1 also if there is no room left for it in the string arena
+int8_t ESPHelperShadow::addString(const char* name, uint16_t maxLength, const char* initial) {
+  if (_stringsUsed + maxLength + 1 > SHADOW_STRING_SIZE)
+    return -1;
+  int8_t field = addField(name, SHADOW_STRING, 0);
+  if (field < 0)
+    return -1;
+
+  _fields[field].offset = _stringsUsed;
+  _fields[field].capacity = maxLength + 1;
+  _stringsUsed += maxLength + 1;
+  _strings[_fields[field].offset] = '\0';
+  setString(field, initial);
+  return field;
+}
+
+
+// handle of the field called [name] or -1
+int8_t ESPHelperShadow::find(const char* name) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (strcmp(_fields[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+// set a field's value - it is reported on the next loop() if it changed
+// true on: field exists and has that type
+bool ESPHelperShadow::setBool(int8_t field, bool value) {
+  return setValue(field, SHADOW_BOOL, value ? 1 : 0);
+}
+
+
+bool ESPHelperShadow::setInt(int8_t field, int32_t value) {
+  return setValue(field, SHADOW_INT, value);
+}
+
+
+bool ESPHelperShadow::setFloat(int8_t field, float value) {
+  if (field < 0 || field >= _count)
+    return false;
+
+  float scaled = value * powersOf10[_fields[field].decimals];
+  return setValue(field, SHADOW_FLOAT, (int32_t)(scaled + (scaled >= 0 ? 0.5f : -0.5f)));
+}
+
+
+bool ESPHelperShadow::setString(int8_t field, const char* value) {
+  if (field < 0 || field >= _count || _fields[field].type != SHADOW_STRING || value == NULL)
+    return false;
+  storeString(_fields[field], value, strlen(value), false);
+  return true;
+}
+
+
+bool ESPHelperShadow::getBool(int8_t field) {
+  return getInt(field) != 0;
+}
+
+
+int32_t ESPHelperShadow::getInt(int8_t field) {
+  if (field < 0 || field >= _count)
+    return 0;
+  return _fields[field].value;
+}
+
+
+float ESPHelperShadow::getFloat(int8_t field) {
+  if (field < 0 || field >= _count)
+    return 0;
+  if (_fields[field].type != SHADOW_FLOAT)
+    return _fields[field].value;
+  return (float)_fields[field].value / powersOf10[_fields[field].decimals];
+}
+
+
+// value of a string field ("" for other fields)
+const char* ESPHelperShadow::getString(int8_t field) {
+  if (field < 0 || field >= _count || _fields[field].type != SHADOW_STRING)
+    return "";
+  return &_strings[_fields[field].offset];
+}
+
+
+// report every field on the next loop()
+void ESPHelperShadow::markAll() {
+  for (uint8_t i = 0; i < _count; i++)
+    _fields[i].dirty = true;
+}
+
+
+// apply a desired state document - fields that are missing, have the wrong type or
+// don't parse are left alone. Fields that change are reported back on the next loop()
+// true on: document applied
+// false on: not a JSON object or stale version
+bool ESPHelperShadow::applyDesired(const uint8_t* payload, unsigned int length) {
+  unsigned int start = 0;
+  while (start < length && isspace(payload[start]))
+    start++;
+  if (start == length || payload[start] != '{') {
+    _stats.rejected++;
+    return false;
+  }
+
+  int32_t version;
+  if (ESPHelperText::jsonInt(payload, length, "v", version)) {
+    if (_desiredSeen && (int32_t)(version - _stats.desiredVersion) <= 0) {
+      _stats.stale++;
+      return false;
+    }
+    _desiredSeen = true;
+    _stats.desiredVersion = version;
+  }
+
+  for (uint8_t i = 0; i < _count; i++) {
+    shadowField &field = _fields[i];
+    const char* value;
+    size_t valueLength;
+    if (!ESPHelperText::jsonField(payload, length, field.name, value, valueLength))
+      continue;
+
+    int32_t before = field.value;
+    bool changed = false;
+    int32_t number;
+    switch (field.type) {
+      case SHADOW_BOOL:
+        if (valueLength == 4 && memcmp(value, "true", 4) == 0)
+          setValue(i, SHADOW_BOOL, 1);
+        else if (valueLength == 5 && memcmp(value, "false", 5) == 0)
+          setValue(i, SHADOW_BOOL, 0);
+        break;
+      case SHADOW_INT:
+        if (ESPHelperText::parseInt(value, valueLength, number))
+          setValue(i, SHADOW_INT, number);
+        break;
+      case SHADOW_FLOAT:
+        if (ESPHelperText::parseFixed(value, valueLength, field.decimals, number))
+          setValue(i, SHADOW_FLOAT, number);
+        break;
+      case SHADOW_STRING:
+        changed = storeString(field, value, valueLength, true);
+        break;
+    }
+
+    if ((changed || field.value != before) && _callbackSet)
+      _callback(i);
+  }
+
+  _stats.applied++;
+  return true;
+}
+
+
+bool ESPHelperShadow::isDesiredTopic(const char* topic) {
+  return _enabled && _desiredTopic != NULL && strcmp(topic, _desiredTopic) == 0;
+}
+
+
+const char* ESPHelperShadow::getDesiredTopic() {
+  return _desiredTopic;
+}
+
+
+// [publisher] returns false if the document could not be sent (it is retried)
+void ESPHelperShadow::setPublisher(std::function<bool(const char*, const char*, bool)> publisher) {
+  _publisher = publisher;
+  _publisherSet = true;
+}
+
+
+// called with the handle of every field a desired document changed
+void ESPHelperShadow::setCallback(std::function<void(int8_t)> callback) {
+  _callback = callback;
+  _callbackSet = true;
+}
+
+
+// publish the changed fields - as many documents as it takes for all of them to fit
+// in SHADOW_DOCUMENT_SIZE. Stops (and retries next time) if publishing fails
+void ESPHelperShadow::loop() {
+  if (!_enabled || !_publisherSet || _reportedTopic == NULL)
+    return;
+
+  while (true) {
+    char doc[SHADOW_DOCUMENT_SIZE];
+    int pos = snprintf(doc, sizeof(doc), "{\"v\":%u", (unsigned int)(_stats.version + 1));
+    uint32_t included = 0;
+
+    for (uint8_t i = 0; i < _count; i++) {
+      if (!_fields[i].dirty)
+        continue;
+
+      // leave room for the closing brace
+      int len = appendField(_fields[i], doc, pos, sizeof(doc) - 1);
+      if (len < 0) {
+        // a field that doesn't fit in an otherwise empty document never will
+        if (included == 0)
+          _fields[i].dirty = false;
+        continue;
+      }
+      pos = len;
+      included |= 1UL << i;
+    }
+    if (included == 0)
+      return;
+
+    doc[pos++] = '}';
+    doc[pos] = '\0';
+    if (!_publisher(_reportedTopic, doc, _retain))
+      return;
+
+    for (uint8_t i = 0; i < _count; i++) {
+      if (included & (1UL << i))
+        _fields[i].dirty = false;
+    }
+    _stats.version++;
+    _stats.reports++;
+    saveVersion();
+  }
+}
+
+
+// carry on from the version reported before the last reset (if RTC memory still has it)
+void ESPHelperShadow::restoreVersion() {
+  uint32_t words[3];
+  if (!ESP.rtcUserMemoryRead(SHADOW_RTC_OFFSET, words, sizeof(words)))
+    return;
+  if (words[0] != SHADOW_RTC_MAGIC || words[2] != ~words[1])
+    return;
+  if ((int32_t)(words[1] - _stats.version) > 0)
+    _stats.version = words[1];
+}
+
+
+void ESPHelperShadow::saveVersion() {
+  uint32_t words[3] = {SHADOW_RTC_MAGIC, _stats.version, ~_stats.version};
+  ESP.rtcUserMemoryWrite(SHADOW_RTC_OFFSET, words, sizeof(words));
+}
+
+
+shadowStats ESPHelperShadow::getStats() {
+  return _stats;
+}
+
+
+int8_t ESPHelperShadow::addField(const char* name, uint8_t type, int32_t value) {
+  if (_count == SHADOW_FIELDS || name == NULL || strcmp(name, "v") == 0 || find(name) >= 0)
+    return -1;
+
+  shadowField &field = _fields[_count];
+  field.name = name;
+  field.type = type;
+  field.decimals = 0;
+  field.dirty = true;
+  field.value = value;
+  field.offset = 0;
+  field.capacity = 0;
+  return _count++;
+}
+
+
+// float fields also take a plain int (already scaled) through here
+bool ESPHelperShadow::setValue(int8_t field, uint8_t type, int32_t value) {
+  if (field < 0 || field >= _count || _fields[field].type != type)
+    return false;
+
+  if (_fields[field].value != value) {
+    _fields[field].value = value;
+    _fields[field].dirty = true;
+  }
+  return true;
+}
+
+
+// copy a string into the field's space - [escaped] strings come straight
+// from a JSON document and have their escapes (\" \\ \n ...) undone.
+// Returns true if the value changed
+bool ESPHelperShadow::storeString(shadowField &field, const char* value, size_t length, bool escaped) {
+  char buf[SHADOW_STRING_SIZE];
+  size_t out = 0;
+
+  for (size_t i = 0; i < length && out + 1 < field.capacity; i++) {
+    char c = value[i];
+    if (escaped && c == '\\' && i + 1 < length) {
+      c = value[++i];
+      if (c == 'n')
+        c = '\n';
+      else if (c == 'r')
+        c = '\r';
+      else if (c == 't')
+        c = '\t';
+      else if (c == 'u') {
+        // only plain ASCII is kept, anything else becomes '?'
+        uint16_t code = 0;
+        uint8_t digits = 0;
+        for (; digits < 4 && i + 1 < length && isxdigit(value[i + 1]); digits++) {
+          char h = value[++i];
+          code = code * 16 + (isdigit(h) ? h - '0' : (tolower(h) - 'a' + 10));
+        }
+        c = (digits == 4 && code >= 0x20 && code < 0x7F) ? (char)code : '?';
+      }
+    }
+    buf[out++] = c;
+  }
+  buf[out] = '\0';
+
+  char* current = &_strings[field.offset];
+  if (strcmp(current, buf) == 0)
+    return false;
+  memcpy(current, buf, out + 1);
+  field.dirty = true;
+  return true;
+}
+
+
+// write ,"name":value at [pos] - returns the new position or -1 if it didn't fit
+int ESPHelperShadow::appendField(const shadowField &field, char* buf, size_t pos, size_t size) {
+  int len = snprintf(&buf[pos], size - pos, ",\"%s\":", field.name);
+  if (len < 0 || pos + len >= size)
+    return -1;
+  size_t end = pos + len;
+
+  switch (field.type) {
+    case SHADOW_BOOL:
+      len = snprintf(&buf[end], size - end, "%s", field.value ? "true" : "false");
+      if (len < 0 || end + len >= size)
+        len = -1;
+      break;
+    case SHADOW_INT:
+      len = ESPHelperText::formatInt(field.value, &buf[end], size - end);
+      break;
+    case SHADOW_FLOAT:
+      len = ESPHelperText::formatFixed(field.value, field.decimals, &buf[end], size - end);
+      break;
+    case SHADOW_STRING: {
+      const char* str = &_strings[field.offset];
+      size_t out = end;
+      if (out + 1 >= size)
+        return -1;
+      buf[out++] = '"';
+      for (; *str != '\0'; str++) {
+        // escapes take up to 6 characters, plus the closing quote
+        if (out + 7 >= size)
+          return -1;
+        uint8_t c = *str;
+        if (c == '"' || c == '\\') {
+          buf[out++] = '\\';
+          buf[out++] = c;
+        }
+        else if (c < 0x20)
+          out += snprintf(&buf[out], size - out, "\\u%04x", c);
+        else
+          buf[out++] = c;
+      }
+      buf[out++] = '"';
+      buf[out] = '\0';
+      len = out - end;
+      break;
+    }
+  }
+
+  if (len < 0)
+    return -1;
+  return end + len;
+}
@@ -0,0 +1,107 @@
+/*
+ESPHelperShadow.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_SHADOW_H
+#define ESPHELPER_SHADOW_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+#include "ESPHelperText.h"
+
+
+// Device state kept in typed fields and synchronized as small JSON documents.
+// Changing a field only marks it - loop() publishes the changed fields together as
+// one delta ({"v":12,"relay":true,"level":40}) on the reported topic and markAll()
+// makes the next one a full report (done on every reconnect).
+// Desired state arrives as the same kind of flat document on the desired topic and is
+// written into the matching fields, each change going to the callback. If it has a "v"
+// that is not newer than the last applied one it is dropped as stale, so a retained
+// desired document is only applied once even though it is delivered on every reconnect.
+// "v" is reserved and can't be used as a field name.
+// The reported "v" is kept in RTC memory, so it keeps counting up across resets, deep
+// sleep and the restart after an update. Only a power cycle starts it at 1 again -
+// a consumer that sees it go down should take the document as a fresh full report.
+class ESPHelperShadow {
+
+  public:
+
+    bool begin(const char* reportedTopic, const char* desiredTopic, bool retain);
+    void end();
+    bool isEnabled();
+
+    int8_t addBool(const char* name, bool initial = false);
+    int8_t addInt(const char* name, int32_t initial = 0);
+    int8_t addFloat(const char* name, float initial = 0, uint8_t decimals = 2);
+    int8_t addString(const char* name, uint16_t maxLength, const char* initial = "");
+    int8_t find(const char* name);
+
+    bool setBool(int8_t field, bool value);
+    bool setInt(int8_t field, int32_t value);
+    bool setFloat(int8_t field, float value);
+    bool setString(int8_t field, const char* value);
+
+    bool getBool(int8_t field);
+    int32_t getInt(int8_t field);
+    float getFloat(int8_t field);
+    const char* getString(int8_t field);
+
+    void markAll();
+    bool applyDesired(const uint8_t* payload, unsigned int length);
+    bool isDesiredTopic(const char* topic);
+    const char* getDesiredTopic();
+
+    void setPublisher(std::function<bool(const char*, const char*, bool)> publisher);
+    void setCallback(std::function<void(int8_t)> callback);
+
+    void loop();
+
+    shadowStats getStats();
+
+  private:
+
+    int8_t addField(const char* name, uint8_t type, int32_t value);
+    bool setValue(int8_t field, uint8_t type, int32_t value);
+    bool storeString(shadowField &field, const char* value, size_t length, bool escaped);
+    int appendField(const shadowField &field, char* buf, size_t pos, size_t size);
+    void restoreVersion();
+    void saveVersion();
+
+    const char* _reportedTopic = NULL;
+    const char* _desiredTopic = NULL;
+    bool _retain = false;
+    bool _enabled = false;
+
+    shadowField _fields[SHADOW_FIELDS];
+    uint8_t _count = 0;
+    char _strings[SHADOW_STRING_SIZE];
+    uint16_t _stringsUsed = 0;
+
+    bool _desiredSeen = false;
+    shadowStats _stats;
+
+    std::function<bool(const char*, const char*, bool)> _publisher;
+    bool _publisherSet = false;
+    std::function<void(int8_t)> _callback;
+    bool _callbackSet = false;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ESPHelperStats.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperStats.h"
+
+
+ESPHelperStats::ESPHelperStats() {
+}
+
+
+// allocate a table for [entries] topics (clears any previous counters)
+// true on: table ready
+// false on: zero entries requested or allocation failed
+bool ESPHelperStats::begin(uint8_t entries) {
+  if (entries == 0)
+    return false;
+
+  _entries.reset(new topicStats[entries]);
+  if (!_entries) {
+    _size = 0;
+    return false;
+  }
+  _size = entries;
+  reset();
+  return true;
+}
+
+
+void ESPHelperStats::end() {
+  _entries.reset();
+  _size = 0;
+  _count = 0;
+}
+
+
+bool ESPHelperStats::isEnabled() {
+  return _size > 0;
+}
+
+
+void ESPHelperStats::recordIn(const char* topic, unsigned int length) {
+  topicStats* entry = find(topic, true);
+  if (entry == NULL)
+    return;
+  entry->messagesIn++;
+  entry->bytesIn += length;
+  entry->lastSeen = millis();
+}
+
+
+void ESPHelperStats::recordOut(const char* topic, unsigned int length) {
+  topicStats* entry = find(topic, true);
+  if (entry == NULL)
+    return;
+  entry->messagesOut++;
+  entry->bytesOut += length;
+  entry->lastSeen = millis();
+}
+
+
+void ESPHelperStats::recordHandler(const char* topic, uint32_t elapsedMicros) {
+  topicStats* entry = find(topic, false);
+  if (entry == NULL)
+    return;
+  entry->handlerMicros += elapsedMicros;
+  if (elapsedMicros > entry->maxHandlerMicros)
+    entry->maxHandlerMicros = elapsedMicros;
+}
+
+
+uint8_t ESPHelperStats::count() {
+  return _count;
+}
+
+
+// entry at [index] or NULL past the end of the table
+const topicStats* ESPHelperStats::get(uint8_t index) {
+  if (index >= _count)
+    return NULL;
+  return &_entries[index];
+}
+
+
+// messages that could not be counted because the table was full
+uint32_t ESPHelperStats::untracked() {
+  return _untracked;
+}
+
+
+// write one entry as a line of comma separated values:
+// topic,messagesIn,bytesIn,messagesOut,bytesOut,msSinceLastSeen,handlerMicros,maxHandlerMicros
+// returns the length written (or -1 if there is no such entry)
+int ESPHelperStats::formatEntry(uint8_t index, char* buf, size_t size) {
+  const topicStats* entry = get(index);
+  if (entry == NULL)
+    return -1;
+
+  return snprintf(buf, size, "%s,%u,%u,%u,%u,%u,%u,%u",
+                  entry->topic,
+                  (unsigned int)entry->messagesIn,
+                  (unsigned int)entry->bytesIn,
+                  (unsigned int)entry->messagesOut,
+                  (unsigned int)entry->bytesOut,
+                  (unsigned int)(millis() - entry->lastSeen),
+                  (unsigned int)entry->handlerMicros,
+                  (unsigned int)entry->maxHandlerMicros);
+}
+
+
+// dump the whole table (one formatEntry line per topic)
+void ESPHelperStats::printTo(Print &out) {
+  char line[INBOUND_TOPIC_SIZE + 96];
+  for (uint8_t i = 0; i < _count; i++) {
+    formatEntry(i, line, sizeof(line));
+    out.println(line);
+  }
+}
+
+
+void ESPHelperStats::reset() {
+  _count = 0;
+  _untracked = 0;
+}
+
+
+// look up the entry for a topic, adding it if [create] is set and there is room
+topicStats* ESPHelperStats::find(const char* topic, bool create) {
+  if (_size == 0)
+    return NULL;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    if (strcmp(_entries[i].topic, topic) == 0)
+      return &_entries[i];
+  }
+
+  if (!create)
+    return NULL;
+
+  if (_count == _size || strlen(topic) >= INBOUND_TOPIC_SIZE) {
+    _untracked++;
+    return NULL;
+  }
+
+  topicStats &entry = _entries[_count++];
+  entry = topicStats();
+  strcpy(entry.topic, topic);
+  return &entry;
+}
@@ -0,0 +1,68 @@
+/*
+ESPHelperStats.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_STATS_H
+#define ESPHELPER_STATS_H
+
+#include <Arduino.h>
+#include <memory>
+#include "sharedData.h"
+
+
+// Bounded per-topic traffic table. Inbound messages are counted against the
+// subscription filter they matched, outbound ones against the published topic.
+// Once the table is full new topics are only counted in untracked().
+class ESPHelperStats {
+
+  public:
+
+    ESPHelperStats();
+
+    bool begin(uint8_t entries);
+    void end();
+
+    bool isEnabled();
+
+    void recordIn(const char* topic, unsigned int length);
+    void recordOut(const char* topic, unsigned int length);
+    void recordHandler(const char* topic, uint32_t elapsedMicros);
+
+    uint8_t count();
+    const topicStats* get(uint8_t index);
+    uint32_t untracked();
+
+    void printTo(Print &out);
+    int formatEntry(uint8_t index, char* buf, size_t size);
+
+    void reset();
+
+  private:
+
+    topicStats* find(const char* topic, bool create);
+
+    std::unique_ptr<topicStats[]> _entries;
+    uint8_t _size = 0;
+    uint8_t _count = 0;
+    uint32_t _untracked = 0;
+};
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ESPHelperStreamClient.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperStreamClient.h"
+
+
+ESPHelperStreamClient::ESPHelperStreamClient() {
+}
+
+
+// set the real (network) client that all traffic goes through
+void ESPHelperStreamClient::setClient(Client &client) {
+  _client = &client;
+  reset();
+}
+
+
+// set the function that receives oversized payloads chunk by chunk
+void ESPHelperStreamClient::setCallback(MQTT_STREAM_CALLBACK_SIGNATURE) {
+  _streamCallback = callback;
+  _streamCallbackSet = true;
+}
+
+
+// PUBLISH packets (header included) larger than [packetSize] bytes are streamed
+// (defaults to MQTT_MAX_PACKET_SIZE, the largest packet PubSubClient can hold)
+void ESPHelperStreamClient::setThreshold(uint32_t packetSize) {
+  _threshold = packetSize;
+}
+
+
+int ESPHelperStreamClient::connect(IPAddress ip, uint16_t port) {
+  reset();
+  return _client->connect(ip, port);
+}
+
+
+int ESPHelperStreamClient::connect(const char *host, uint16_t port) {
+  reset();
+  return _client->connect(host, port);
+}
+
+
+size_t ESPHelperStreamClient::write(uint8_t b) {
+  return _client->write(b);
+}
+
+
+size_t ESPHelperStreamClient::write(const uint8_t *buf, size_t size) {
+  return _client->write(buf, size);
+}
+
+
+// number of bytes of normal (non-streamed) packets that PubSubClient can read right now
+int ESPHelperStreamClient::available() {
+  if (_client == NULL)
+    return 0;
+
+  pump();
+  if (_state != PASS_THROUGH)
+    return 0;
+
+  uint32_t body = _client->available();
+  if (body > _remaining)
+    body = _remaining;
+  return (_headerLen - _headerPos) + body;
+}
+
+
+int ESPHelperStreamClient::read() {
+  if (_state != PASS_THROUGH) {
+    pump();
+    if (_state != PASS_THROUGH)
+      return -1;
+  }
+
+  int b;
+  if (_headerPos < _headerLen) {
+    b = _header[_headerPos++];
+  } else if (_remaining > 0) {
+    b = _client->read();
+    if (b < 0)
+      return -1;
+    _remaining--;
+  } else {
+    return -1;
+  }
+
+  // the whole packet has been handed over - start looking for the next one
+  if (_headerPos == _headerLen && _remaining == 0) {
+    _state = READ_HEADER;
+    _headerLen = 0;
+  }
+  return b;
+}
+
+
+int ESPHelperStreamClient::read(uint8_t *buf, size_t size) {
+  size_t count = 0;
+  while (count < size && available() > 0)
+    buf[count++] = read();
+  return count;
+}
+
+
+int ESPHelperStreamClient::peek() {
+  if (_state != PASS_THROUGH)
+    return -1;
+  if (_headerPos < _headerLen)
+    return _header[_headerPos];
+  if (_remaining > 0)
+    return _client->peek();
+  return -1;
+}
+
+
+void ESPHelperStreamClient::flush() {
+  _client->flush();
+}
+
+
+void ESPHelperStreamClient::stop() {
+  reset();
+  _client->stop();
+}
+
+
+uint8_t ESPHelperStreamClient::connected() {
+  return _client != NULL && _client->connected();
+}
+
+
+ESPHelperStreamClient::operator bool() {
+  return _client != NULL && (bool)*_client;
+}
+
+
+// forget any half read packet (called on every new connection)
+void ESPHelperStreamClient::reset() {
+  _state = READ_HEADER;
+  _headerLen = 0;
+  _headerPos = 0;
+  _remaining = 0;
+}
+
+
+// consume as much from the socket as possible without blocking until either a normal
+// packet is ready to be passed through or there is nothing left to read
+void ESPHelperStreamClient::pump() {
+  while (_client != NULL && _state != PASS_THROUGH) {
+    if (_state == READ_PAYLOAD) {
+      uint32_t count = _client->available();
+      if (count > _remaining)
+        count = _remaining;
+      if (count > STREAM_CHUNK_SIZE)
+        count = STREAM_CHUNK_SIZE;
+      if (count == 0)
+        return;
+
+      int got = _client->read(_chunk, count);
+      if (got <= 0)
+        return;
+
+      _streamCallback(_topic, _payloadOffset, _chunk, got, _payloadTotal);
+      _payloadOffset += got;
+      _remaining -= got;
+      if (_remaining == 0)
+        finishStream();
+      continue;
+    }
+
+    // every other state is read one byte at a time
+    if (_client->available() <= 0)
+      return;
+    uint8_t b = _client->read();
+
+    switch (_state) {
+      case READ_HEADER:
+        _header[_headerLen++] = b;
+        if (_headerLen == 1) {
+          _remaining = 0;
+        } else {
+          // remaining length is 1-4 bytes, 7 bits each, least significant first
+          _remaining += (uint32_t)(b & 0x7F) << (7 * (_headerLen - 2));
+          if (!(b & 0x80) || _headerLen == sizeof(_header))
+            startPacket();
+        }
+        break;
+
+      case READ_TOPIC_LENGTH:
+        _topicLen = (_topicLen << 8) | b;
+        _remaining--;
+        if (++_topicPos == 2) {
+          _topicPos = 0;
+          // a topic (and packet id) that doesn't fit in the packet means we lost sync
+          if ((uint32_t)_topicLen + (_qos > 0 ? 2 : 0) > _remaining) {
+            stop();
+            return;
+          }
+          _state = READ_TOPIC;
+          if (_topicLen == 0) {
+            _topic[0] = '\0';
+            _state = _qos > 0 ? READ_PACKET_ID : READ_PAYLOAD;
+            _payloadTotal = _remaining;
+          }
+        }
+        break;
+
+      case READ_TOPIC:
+        // topics longer than the buffer are cut short
+        if (_topicPos < sizeof(_topic) - 1)
+          _topic[_topicPos] = b;
+        _topicPos++;
+        _remaining--;
+        if (_topicPos == _topicLen) {
+          _topic[_topicLen < sizeof(_topic) ? _topicLen : sizeof(_topic) - 1] = '\0';
+          _state = _qos > 0 ? READ_PACKET_ID : READ_PAYLOAD;
+          _payloadTotal = _remaining;
+        }
+        break;
+
+      case READ_PACKET_ID:
+        _packetId = (_packetId << 8) | b;
+        _remaining--;
+        if (++_idPos == 2) {
+          _state = READ_PAYLOAD;
+          _payloadTotal = _remaining;
+        }
+        break;
+    }
+
+    // empty payload - nothing to deliver but the packet still has to be finished
+    if (_state == READ_PAYLOAD && _remaining == 0) {
+      _streamCallback(_topic, 0, _chunk, 0, 0);
+      finishStream();
+    }
+  }
+}
+
+
+// a full fixed header has been read - decide whether PubSubClient gets this packet
+void ESPHelperStreamClient::startPacket() {
+  uint32_t packetSize = _headerLen + _remaining;
+
+  if ((_header[0] & 0xF0) == 0x30 && packetSize > _threshold && _streamCallbackSet) {
+    _qos = (_header[0] >> 1) & 0x03;
+    _topicLen = 0;
+    _topicPos = 0;
+    _packetId = 0;
+    _idPos = 0;
+    _payloadOffset = 0;
+    _state = READ_TOPIC_LENGTH;
+  } else {
+    _headerPos = 0;
+    _state = PASS_THROUGH;
+  }
+}
+
+
+// the last chunk of a streamed message has been delivered. PubSubClient never saw the
+// packet so it won't acknowledge it - do that here for QoS 1
+void ESPHelperStreamClient::finishStream() {
+  if (_qos == 1) {
+    uint8_t puback[4] = {0x40, 0x02, (uint8_t)(_packetId >> 8), (uint8_t)(_packetId & 0xFF)};
+    _client->write(puback, sizeof(puback));
+  }
+
+  _state = READ_HEADER;
+  _headerLen = 0;
+}
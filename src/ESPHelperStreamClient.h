@@ -0,0 +1,96 @@
+/*
+ESPHelperStreamClient.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_STREAM_CLIENT_H
+#define ESPHELPER_STREAM_CLIENT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <PubSubClient.h>
+#include "sharedData.h"
+
+
+// Client that sits between PubSubClient and the real Wi-Fi client.
+// It follows the MQTT framing of everything PubSubClient reads and passes
+// normal packets straight through. PUBLISH packets too big for PubSubClient's
+// buffer are taken off the socket here instead and handed to the stream
+// callback STREAM_CHUNK_SIZE bytes at a time, so the full payload is never held in RAM.
+class ESPHelperStreamClient : public Client {
+
+  public:
+
+    ESPHelperStreamClient();
+
+    void setClient(Client &client);
+    void setCallback(MQTT_STREAM_CALLBACK_SIGNATURE);
+    void setThreshold(uint32_t packetSize);
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t *buf, size_t size);
+    int available();
+    int read();
+    int read(uint8_t *buf, size_t size);
+    int peek();
+    void flush();
+    void stop();
+    uint8_t connected();
+    operator bool();
+
+  private:
+
+    enum streamState {READ_HEADER, PASS_THROUGH, READ_TOPIC_LENGTH, READ_TOPIC, READ_PACKET_ID, READ_PAYLOAD};
+
+    void reset();
+    void pump();
+    void startPacket();
+    void finishStream();
+
+    Client *_client = NULL;
+
+    std::function<void(char*, unsigned int, uint8_t*, unsigned int, unsigned int)> _streamCallback;
+    bool _streamCallbackSet = false;
+
+    uint32_t _threshold = MQTT_MAX_PACKET_SIZE;
+
+    uint8_t _state = READ_HEADER;
+
+    // fixed header of the packet currently being read (type byte + up to 4 length bytes)
+    uint8_t _header[5];
+    uint8_t _headerLen = 0;
+    uint8_t _headerPos = 0;
+    uint32_t _remaining = 0;
+
+    // streamed PUBLISH state
+    char _topic[INBOUND_TOPIC_SIZE];
+    uint16_t _topicLen = 0;
+    uint16_t _topicPos = 0;
+    uint8_t _qos = 0;
+    uint16_t _packetId = 0;
+    uint8_t _idPos = 0;
+    uint32_t _payloadTotal = 0;
+    uint32_t _payloadOffset = 0;
+    uint8_t _chunk[STREAM_CHUNK_SIZE];
+};
+
+#endif
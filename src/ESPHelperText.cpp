@@ -0,0 +1,529 @@
+/*
+ESPHelperText.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperText.h"
+
+
+static const uint32_t powersOf10[10] = {1, 10, 100, 1000, 10000, 100000, 1000000,
+                                        10000000, 100000000, 1000000000};
+
+static const char* skipSpace(const char* p, const char* end);
+static const char* skipString(const char* p, const char* end);
+static const char* skipValue(const char* p, const char* end);
+
+
+int ESPHelperText::formatInt(int32_t value, char* buf, size_t size) {
+  if (value >= 0)
+    return formatDigits(value, 1, buf, size);
+
+  if (size < 2)
+    return -1;
+  buf[0] = '-';
+  int len = formatDigits((uint32_t)(-(int64_t)value), 1, &buf[1], size - 1);
+  return len < 0 ? -1 : len + 1;
+}
+
+
+int ESPHelperText::formatUInt(uint32_t value, char* buf, size_t size) {
+  return formatDigits(value, 1, buf, size);
+}
+
+
+// a fixed point value with [decimals] places (e.g. 2150 with 2 -> "21.50")
+int ESPHelperText::formatFixed(int32_t value, uint8_t decimals, char* buf, size_t size) {
+  if (decimals > TEXT_MAX_DECIMALS)
+    decimals = TEXT_MAX_DECIMALS;
+
+  uint32_t magnitude = value < 0 ? (uint32_t)(-(int64_t)value) : (uint32_t)value;
+  size_t pos = 0;
+  if (value < 0) {
+    if (size < 2)
+      return -1;
+    buf[pos++] = '-';
+  }
+
+  int len = formatDigits(magnitude / powersOf10[decimals], 1, &buf[pos], size - pos);
+  if (len < 0)
+    return -1;
+  pos += len;
+  if (decimals == 0)
+    return pos;
+
+  if (pos + 1 >= size)
+    return -1;
+  buf[pos++] = '.';
+  len = formatDigits(magnitude % powersOf10[decimals], decimals, &buf[pos], size - pos);
+  return len < 0 ? -1 : pos + len;
+}
+
+
+// a float rounded to [decimals] places (like dtostrf but bounded by [size]).
+// Values too large to write without an exponent (1e12 and up) don't fit
+int ESPHelperText::formatFloat(float value, uint8_t decimals, char* buf, size_t size) {
+  const char* special = NULL;
+  if (isnan(value))
+    special = "nan";
+  else if (isinf(value))
+    special = value < 0 ? "-inf" : "inf";
+  if (special != NULL) {
+    size_t len = strlen(special);
+    if (len >= size)
+      return -1;
+    memcpy(buf, special, len + 1);
+    return len;
+  }
+
+  if (decimals > TEXT_MAX_DECIMALS)
+    decimals = TEXT_MAX_DECIMALS;
+  double scaled = fabs((double)value) * powersOf10[decimals] + 0.5;
+  if (scaled >= 1e18)
+    return -1;
+
+  uint64_t fixed = (uint64_t)scaled;
+  size_t pos = 0;
+  if (value < 0 && fixed != 0) {
+    if (size < 2)
+      return -1;
+    buf[pos++] = '-';
+  }
+
+  int len = formatDigits(fixed / powersOf10[decimals], 1, &buf[pos], size - pos);
+  if (len < 0)
+    return -1;
+  pos += len;
+  if (decimals == 0)
+    return pos;
+
+  if (pos + 1 >= size)
+    return -1;
+  buf[pos++] = '.';
+  len = formatDigits(fixed % powersOf10[decimals], decimals, &buf[pos], size - pos);
+  return len < 0 ? -1 : pos + len;
+}
+
+
+// whole field as a signed 32 bit integer
+// true on: valid number that fits
+// false on: empty field, stray characters or overflow
+bool ESPHelperText::parseInt(const char* str, size_t length, int32_t &value) {
+  trim(str, length);
+
+  bool negative = false;
+  size_t i = 0;
+  if (length > 0 && (str[0] == '-' || str[0] == '+')) {
+    negative = str[0] == '-';
+    i++;
+  }
+  if (i == length)
+    return false;
+
+  uint32_t limit = negative ? 2147483648UL : 2147483647UL;
+  uint32_t result = 0;
+  for (; i < length; i++) {
+    if (str[i] < '0' || str[i] > '9')
+      return false;
+    uint8_t digit = str[i] - '0';
+    if (result > (limit - digit) / 10)
+      return false;
+    result = result * 10 + digit;
+  }
+
+  value = negative ? (int32_t)(0 - result) : (int32_t)result;
+  return true;
+}
+
+
+// decimal number as fixed point with [decimals] places ("21.456" with 2 -> 2146).
+// The first digit past [decimals] rounds the result, any after it are ignored
+// true on: valid number that fits
+// false on: empty field, stray characters or overflow
+bool ESPHelperText::parseFixed(const char* str, size_t length, uint8_t decimals, int32_t &value) {
+  trim(str, length);
+  if (decimals > TEXT_MAX_DECIMALS)
+    decimals = TEXT_MAX_DECIMALS;
+
+  bool negative = false;
+  size_t i = 0;
+  if (length > 0 && (str[0] == '-' || str[0] == '+')) {
+    negative = str[0] == '-';
+    i++;
+  }
+
+  uint64_t result = 0;
+  uint8_t places = 0;
+  bool digits = false;
+  bool point = false;
+  bool extra = false;
+  bool roundUp = false;
+  for (; i < length; i++) {
+    char c = str[i];
+    if (c == '.' && !point) {
+      point = true;
+      continue;
+    }
+    if (c < '0' || c > '9')
+      return false;
+    digits = true;
+
+    if (point && places == decimals) {
+      if (!extra)
+        roundUp = c >= '5';
+      extra = true;
+      continue;
+    }
+
+    result = result * 10 + (c - '0');
+    if (point)
+      places++;
+    if (result > 0x80000000ULL)
+      return false;
+  }
+  if (!digits)
+    return false;
+
+  result = result * powersOf10[decimals - places] + (roundUp ? 1 : 0);
+  if (result > (negative ? 0x80000000ULL : 0x7FFFFFFFULL))
+    return false;
+  value = negative ? (int32_t)(0 - (uint32_t)result) : (int32_t)result;
+  return true;
+}
+
+
+// decimal number with optional fraction and exponent ("-1.5", "2e3")
+// true on: valid number
+// false on: empty field or stray characters
+bool ESPHelperText::parseFloat(const char* str, size_t length, float &value) {
+  trim(str, length);
+
+  bool negative = false;
+  size_t i = 0;
+  if (length > 0 && (str[0] == '-' || str[0] == '+')) {
+    negative = str[0] == '-';
+    i++;
+  }
+
+  // up to 18 significant digits are kept, the rest only move the exponent
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  bool point = false;
+  for (; i < length; i++) {
+    char c = str[i];
+    if (c == '.' && !point) {
+      point = true;
+      continue;
+    }
+    if (c < '0' || c > '9')
+      break;
+    digits = true;
+    if (mantissa < 100000000000000000ULL) {
+      mantissa = mantissa * 10 + (c - '0');
+      if (point)
+        exponent--;
+    }
+    else if (!point)
+      exponent++;
+  }
+  if (!digits)
+    return false;
+
+  if (i < length && (str[i] == 'e' || str[i] == 'E')) {
+    i++;
+    bool negativeExp = false;
+    if (i < length && (str[i] == '-' || str[i] == '+')) {
+      negativeExp = str[i] == '-';
+      i++;
+    }
+    if (i == length)
+      return false;
+    int exp = 0;
+    for (; i < length; i++) {
+      if (str[i] < '0' || str[i] > '9')
+        return false;
+      if (exp < 1000)
+        exp = exp * 10 + (str[i] - '0');
+    }
+    exponent += negativeExp ? -exp : exp;
+  }
+  if (i != length)
+    return false;
+
+  double result = mantissa;
+  if (exponent > 400)
+    exponent = 400;
+  else if (exponent < -400)
+    exponent = -400;
+  while (exponent > 0) {
+    uint8_t step = exponent > 9 ? 9 : exponent;
+    result *= powersOf10[step];
+    exponent -= step;
+  }
+  while (exponent < 0) {
+    uint8_t step = exponent < -9 ? 9 : -exponent;
+    result /= powersOf10[step];
+    exponent += step;
+  }
+
+  value = negative ? -result : result;
+  return true;
+}
+
+
+// find [key] among the top level fields of a JSON object. Nested objects, arrays and
+// escaped strings are skipped over but keys are compared as written (no unescaping).
+// [value] points into [json] - string values come back without their quotes
+// true on: key found
+// false on: key missing or payload is not a JSON object
+bool ESPHelperText::jsonField(const uint8_t* json, unsigned int length, const char* key,
+                              const char* &value, size_t &valueLength) {
+  if (json == NULL || key == NULL)
+    return false;
+
+  const char* p = (const char*)json;
+  const char* end = p + length;
+  size_t keyLength = strlen(key);
+
+  p = skipSpace(p, end);
+  if (p == end || *p != '{')
+    return false;
+  p++;
+
+  while (true) {
+    p = skipSpace(p, end);
+    if (p == end || *p != '"')
+      return false;
+
+    const char* name = p + 1;
+    p = skipString(p, end);
+    if (p == NULL)
+      return false;
+    size_t nameLength = p - 1 - name;
+
+    p = skipSpace(p, end);
+    if (p == end || *p != ':')
+      return false;
+    p = skipSpace(p + 1, end);
+
+    const char* valueEnd = skipValue(p, end);
+    if (valueEnd == NULL)
+      return false;
+
+    if (nameLength == keyLength && memcmp(name, key, keyLength) == 0) {
+      if (*p == '"') {
+        value = p + 1;
+        valueLength = valueEnd - p - 2;
+      }
+      else {
+        value = p;
+        valueLength = valueEnd - p;
+      }
+      return true;
+    }
+
+    p = skipSpace(valueEnd, end);
+    if (p == end || *p != ',')
+      return false;
+    p++;
+  }
+}
+
+
+bool ESPHelperText::jsonInt(const uint8_t* json, unsigned int length, const char* key, int32_t &value) {
+  const char* field;
+  size_t fieldLength;
+  return jsonField(json, length, key, field, fieldLength) && parseInt(field, fieldLength, value);
+}
+
+
+bool ESPHelperText::jsonFloat(const uint8_t* json, unsigned int length, const char* key, float &value) {
+  const char* field;
+  size_t fieldLength;
+  return jsonField(json, length, key, field, fieldLength) && parseFloat(field, fieldLength, value);
+}
+
+
+bool ESPHelperText::jsonBool(const uint8_t* json, unsigned int length, const char* key, bool &value) {
+  const char* field;
+  size_t fieldLength;
+  if (!jsonField(json, length, key, field, fieldLength))
+    return false;
+
+  if (fieldLength == 4 && memcmp(field, "true", 4) == 0)
+    value = true;
+  else if (fieldLength == 5 && memcmp(field, "false", 5) == 0)
+    value = false;
+  else
+    return false;
+  return true;
+}
+
+
+// write [value] in decimal, zero padded to at least [minDigits]
+int ESPHelperText::formatDigits(uint64_t value, uint8_t minDigits, char* buf, size_t size) {
+  char digits[20];
+  uint8_t count = 0;
+
+  // 32 bit division is much cheaper on the ESP so only use 64 bit when needed
+  if (value <= 0xFFFFFFFFULL) {
+    uint32_t small = value;
+    do {
+      digits[count++] = '0' + small % 10;
+      small /= 10;
+    } while (small != 0);
+  }
+  else {
+    do {
+      digits[count++] = '0' + value % 10;
+      value /= 10;
+    } while (value != 0);
+  }
+  while (count < minDigits && count < sizeof(digits))
+    digits[count++] = '0';
+
+  if (count >= size)
+    return -1;
+  for (uint8_t i = 0; i < count; i++)
+    buf[i] = digits[count - 1 - i];
+  buf[count] = '\0';
+  return count;
+}
+
+
+void ESPHelperText::trim(const char* &str, size_t &length) {
+  if (str == NULL) {
+    length = 0;
+    return;
+  }
+  while (length > 0 && isspace(str[0])) {
+    str++;
+    length--;
+  }
+  while (length > 0 && isspace(str[length - 1]))
+    length--;
+}
+
+
+
+
+ESPHelperTokenizer::ESPHelperTokenizer(const uint8_t* data, unsigned int length, char delimiter)
+  : _data((const char*)data), _length(data == NULL ? 0 : length), _delimiter(delimiter) {
+  _done = _length == 0;
+}
+
+
+// next field (not null terminated) - false once every field has been returned
+bool ESPHelperTokenizer::next(const char* &field, size_t &length) {
+  if (_done)
+    return false;
+
+  unsigned int start = _pos;
+  while (_pos < _length && _data[_pos] != _delimiter)
+    _pos++;
+  field = &_data[start];
+  length = _pos - start;
+
+  if (_pos < _length)
+    _pos++;
+  else
+    _done = true;
+  return true;
+}
+
+
+// the typed versions consume the field even if it doesn't parse
+bool ESPHelperTokenizer::nextInt(int32_t &value) {
+  const char* field;
+  size_t length;
+  return next(field, length) && ESPHelperText::parseInt(field, length, value);
+}
+
+
+bool ESPHelperTokenizer::nextFixed(uint8_t decimals, int32_t &value) {
+  const char* field;
+  size_t length;
+  return next(field, length) && ESPHelperText::parseFixed(field, length, decimals, value);
+}
+
+
+bool ESPHelperTokenizer::nextFloat(float &value) {
+  const char* field;
+  size_t length;
+  return next(field, length) && ESPHelperText::parseFloat(field, length, value);
+}
+
+
+bool ESPHelperTokenizer::atEnd() {
+  return _done;
+}
+
+
+
+
+static const char* skipSpace(const char* p, const char* end) {
+  while (p < end && isspace(*p))
+    p++;
+  return p;
+}
+
+
+// [p] is on the opening quote - returns just past the closing one
+static const char* skipString(const char* p, const char* end) {
+  for (p++; p < end; p++) {
+    if (*p == '\\')
+      p++;
+    else if (*p == '"')
+      return p + 1;
+  }
+  return NULL;
+}
+
+
+// returns just past the value starting at [p] (NULL if it is malformed or cut off)
+static const char* skipValue(const char* p, const char* end) {
+  if (p == end)
+    return NULL;
+  if (*p == '"')
+    return skipString(p, end);
+
+  if (*p == '{' || *p == '[') {
+    uint8_t depth = 0;
+    while (p < end) {
+      if (*p == '"') {
+        p = skipString(p, end);
+        if (p == NULL)
+          return NULL;
+        continue;
+      }
+      if (*p == '{' || *p == '[')
+        depth++;
+      else if ((*p == '}' || *p == ']') && --depth == 0)
+        return p + 1;
+      p++;
+    }
+    return NULL;
+  }
+
+  const char* start = p;
+  while (p < end && *p != ',' && *p != '}' && *p != ']' && !isspace(*p))
+    p++;
+  return p == start ? NULL : p;
+}
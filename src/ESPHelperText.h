@@ -0,0 +1,86 @@
+/*
+ESPHelperText.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_TEXT_H
+#define ESPHELPER_TEXT_H
+
+#include <Arduino.h>
+#include "sharedData.h"
+
+
+// Number <-> text helpers that only use the stack.
+// The format functions write into the caller's buffer, null terminate it and return
+// the length (or -1 if it doesn't fit). The parse functions take a pointer and a
+// length so they work right on an MQTT payload or a tokenizer field without copying
+// it or null terminating it - the whole field (minus surrounding spaces) must be the number.
+class ESPHelperText {
+
+  public:
+
+    static int formatInt(int32_t value, char* buf, size_t size);
+    static int formatUInt(uint32_t value, char* buf, size_t size);
+    static int formatFixed(int32_t value, uint8_t decimals, char* buf, size_t size);
+    static int formatFloat(float value, uint8_t decimals, char* buf, size_t size);
+
+    static bool parseInt(const char* str, size_t length, int32_t &value);
+    static bool parseFixed(const char* str, size_t length, uint8_t decimals, int32_t &value);
+    static bool parseFloat(const char* str, size_t length, float &value);
+
+    // top level fields of a flat JSON object, e.g. {"on":true,"level":42,"name":"x"}
+    static bool jsonField(const uint8_t* json, unsigned int length, const char* key,
+                          const char* &value, size_t &valueLength);
+    static bool jsonInt(const uint8_t* json, unsigned int length, const char* key, int32_t &value);
+    static bool jsonFloat(const uint8_t* json, unsigned int length, const char* key, float &value);
+    static bool jsonBool(const uint8_t* json, unsigned int length, const char* key, bool &value);
+
+  private:
+
+    static int formatDigits(uint64_t value, uint8_t minDigits, char* buf, size_t size);
+    static void trim(const char* &str, size_t &length);
+};
+
+
+// Splits a payload into fields at [delimiter] without copying it,
+// e.g. "255,128,0" -> nextInt() x3. Empty fields are returned as empty.
+class ESPHelperTokenizer {
+
+  public:
+
+    ESPHelperTokenizer(const uint8_t* data, unsigned int length, char delimiter = ',');
+
+    bool next(const char* &field, size_t &length);
+    bool nextInt(int32_t &value);
+    bool nextFixed(uint8_t decimals, int32_t &value);
+    bool nextFloat(float &value);
+
+    bool atEnd();
+
+  private:
+
+    const char* _data;
+    unsigned int _length;
+    unsigned int _pos = 0;
+    char _delimiter;
+    bool _done = false;
+};
+
+#endif
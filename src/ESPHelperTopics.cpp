@@ -0,0 +1,123 @@
+/*
+ESPHelperTopics.cpp
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ESPHelperTopics.h"
+
+
+// register a template - returns its handle or -1 if the table is full
+// (or, once expanded, if the arena has no room left for it)
+int8_t ESPHelperTopics::add(const topicTemplate &topic) {
+  if (_count == MAX_TOPICS || topic.text == NULL)
+    return -1;
+  if (!_table)
+    _table.reset(new topicTable);
+
+  _table->templates[_count] = topic;
+  _table->offsets[_count] = -1;
+  if (_expanded && !expandOne(_count))
+    return -1;
+  return _count++;
+}
+
+
+// expand every template with the first [length] characters of [prefix]
+// (only the first call with templates to expand does anything - topics that were
+// subscribed keep their text)
+// true on: every template fit in the arena or there is nothing to expand yet
+// false on: already expanded, prefix too long or some templates did not fit
+bool ESPHelperTopics::expand(const char* prefix, size_t length) {
+  if (_expanded || prefix == NULL || length + 1 > TOPIC_ARENA_SIZE || length > 255)
+    return false;
+  if (!_table)
+    return true;
+
+  memcpy(_table->arena, prefix, length);
+  _table->arena[length] = '\0';
+  _prefixLength = length;
+  _used = length + 1;
+  _expanded = true;
+
+  bool result = true;
+  for (uint8_t i = 0; i < _count; i++)
+    result &= expandOne(i);
+  return result;
+}
+
+
+bool ESPHelperTopics::isExpanded() {
+  return _expanded;
+}
+
+
+// expanded topic or NULL if the handle is invalid or the topic is not expanded (yet)
+const char* ESPHelperTopics::get(int8_t handle) {
+  if (handle < 0 || handle >= _count || _table->offsets[handle] < 0)
+    return NULL;
+  return &_table->arena[_table->offsets[handle]];
+}
+
+
+const char* ESPHelperTopics::getPrefix() {
+  return _expanded ? _table->arena : NULL;
+}
+
+
+uint8_t ESPHelperTopics::count() {
+  return _count;
+}
+
+
+uint16_t ESPHelperTopics::getArenaUsed() {
+  return _used;
+}
+
+
+bool ESPHelperTopics::expandOne(uint8_t index) {
+  const topicTemplate &topic = _table->templates[index];
+  const size_t tokenLength = sizeof(TOPIC_DEVICE) - 1;
+  size_t length = topic.length + topic.devices * _prefixLength - topic.devices * tokenLength;
+  if (_used + length + 1 > TOPIC_ARENA_SIZE)
+    return false;
+
+  char* out = &_table->arena[_used];
+  if (topic.devices == 0)
+    memcpy(out, topic.text, topic.length);
+  else {
+    const char* in = topic.text;
+    const char* end = topic.text + topic.length;
+    while (in < end) {
+      if (*in == TOPIC_DEVICE[0] && in + tokenLength <= end && memcmp(in, TOPIC_DEVICE, tokenLength) == 0) {
+        memcpy(out, _table->arena, _prefixLength);
+        out += _prefixLength;
+        in += tokenLength;
+      }
+      else
+        *out++ = *in++;
+    }
+    out = &_table->arena[_used];
+  }
+  out[length] = '\0';
+
+  _table->offsets[index] = _used;
+  _used += length + 1;
+  return true;
+}
@@ -0,0 +1,96 @@
+/*
+ESPHelperTopics.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_TOPICS_H
+#define ESPHELPER_TOPICS_H
+
+#include <Arduino.h>
+#include <memory>
+#include "sharedData.h"
+
+
+// A topic with TOPIC_DEVICE placeholders, e.g. makeTopic("home/{device}/status").
+// Its length and number of placeholders are worked out by the compiler so the
+// expansion is just a few copies into the arena.
+struct topicTemplate {
+  const char* text;
+  uint8_t length;
+  uint8_t devices;
+};
+
+constexpr bool topicTokenAt(const char* text, const char* token) {
+  return *token == '\0' || (*text == *token && topicTokenAt(text + 1, token + 1));
+}
+
+constexpr uint8_t topicDeviceCount(const char* text) {
+  return *text == '\0' ? 0
+         : topicTokenAt(text, TOPIC_DEVICE) ? 1 + topicDeviceCount(text + sizeof(TOPIC_DEVICE) - 1)
+         : topicDeviceCount(text + 1);
+}
+
+template <size_t N>
+constexpr topicTemplate makeTopic(const char (&text)[N]) {
+  static_assert(N <= 256, "topic template too long");
+  return topicTemplate{text, (uint8_t)(N - 1), topicDeviceCount(text)};
+}
+
+
+// templates and the arena their expansions live in (only allocated by the first add())
+struct topicTable {
+  topicTemplate templates[MAX_TOPICS];
+  int16_t offsets[MAX_TOPICS];
+  // the prefix is kept at the start of the arena
+  char arena[TOPIC_ARENA_SIZE];
+};
+
+
+// Topics registered as templates and expanded once with the device prefix
+// (see ESPHelper::addTopic). Expanded topics live in one fixed arena and never
+// move, so the pointers from get() can be handed to subscriptions.
+// Templates added before expand() are expanded by it, later ones straight away.
+// Nothing is allocated until the first template is added.
+class ESPHelperTopics {
+
+  public:
+
+    int8_t add(const topicTemplate &topic);
+    bool expand(const char* prefix, size_t length);
+    bool isExpanded();
+
+    const char* get(int8_t handle);
+    const char* getPrefix();
+    uint8_t count();
+    uint16_t getArenaUsed();
+
+  private:
+
+    bool expandOne(uint8_t index);
+
+    std::unique_ptr<topicTable> _table;
+    uint8_t _count = 0;
+
+    uint16_t _used = 0;
+    uint8_t _prefixLength = 0;
+    bool _expanded = false;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ESPHelperTransport.h
+Copyright (c) 2018 ItKindaWorks Inc All right reserved.
+github.com/ItKindaWorks
+
+This file is part of ESPHelper
+
+ESPHelper is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+ESPHelper is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ESPHELPER_TRANSPORT_H
+#define ESPHELPER_TRANSPORT_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <PubSubClient.h>
+#include "sharedData.h"
+
+
+// Everything ESPHelper needs from an MQTT client.
+// ESPHelper only talks to its broker through this interface so the client
+// can be swapped with ESPHelper::setTransport() (see ESPHelperPubSub and ESPHelperMQTT).
+class ESPHelperTransport {
+
+  public:
+
+    virtual ~ESPHelperTransport() {}
+
+    virtual void setClient(Client &client) = 0;
+    virtual void setServer(const char* host, uint16_t port) = 0;
+    virtual void setCallback(MQTT_CALLBACK_SIGNATURE) = 0;
+
+    // NULL user/pass/willTopic leave that part out of the CONNECT packet
+    virtual bool connect(const char* id,
+                         const char* user,
+                         const char* pass,
+                         const char* willTopic,
+                         uint8_t willQoS,
+                         bool willRetain,
+                         const char* willMessage) = 0;
+    virtual void disconnect() = 0;
+    virtual bool connected() = 0;
+    virtual bool loop() = 0;
+
+    virtual bool publish(const char* topic,
+                         const uint8_t* payload,
+                         unsigned int length,
+                         bool retain,
+                         uint8_t qos) = 0;
+
+    // streaming publish - write exactly [length] payload bytes between begin and end
+    virtual bool beginPublish(const char* topic, unsigned int length, bool retain) = 0;
+    virtual size_t writePayload(const uint8_t* buf, size_t size) = 0;
+    virtual bool endPublish() = 0;
+
+    virtual bool subscribe(const char* topic, uint8_t qos) = 0;
+    virtual bool unsubscribe(const char* topic) = 0;
+
+    // subscribe to several topics at once (one SUBSCRIBE packet where the client supports it)
+    virtual bool subscribe(const char* const* topics, const uint8_t* qos, uint8_t count) {
+      bool result = true;
+      for (uint8_t i = 0; i < count; i++)
+        result &= subscribe(topics[i], qos[i]);
+      return result;
+    }
+
+    // optional features - ignored by clients that don't have them
+    virtual void setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE) {}
+    virtual void setStreamThreshold(uint32_t packetSize) {}
+    virtual void setKeepAlive(uint16_t seconds) {}
+    virtual bool canSetKeepAlive() { return false; }
+
+    // free buffers that are only needed while connected (connect() allocates them again)
+    virtual void releaseBuffers() {}
+
+    // send a PINGREQ now - the round trip (micros) of every ping, including the keepalive
+    // ones, goes to the ping callback. false if a ping is outstanding or not supported
+    virtual bool ping() { return false; }
+    virtual bool canPing() { return false; }
+    virtual void setPingCallback(std::function<void(uint32_t)> callback) {}
+};
+
+#endif
@@ -25,6 +25,7 @@ Refactoring and improvements by Suren Khorenyan
 #include "ESPHelperWebConfig.h"
 #include "WebConfigHTML.h"
 #include <FS.h>
+#include <Updater.h>
 
 #define CFG_NOT_SET "[fillConfig not set]"
 
@@ -124,6 +125,18 @@ bool ESPHelperWebConfig::handle() {
   return _configLoaded;
 }
 
+// stop serving (and close the listening socket) until resume() - used while an OTA update runs.
+// A server passed in by the sketch is left alone, like in begin()
+void ESPHelperWebConfig::pause() {
+  if (_runningLocal)
+    _server->stop();
+}
+
+void ESPHelperWebConfig::resume() {
+  if (_runningLocal)
+    _server->begin();
+}
+
 
 netInfo ESPHelperWebConfig::getConfig() {
   _configLoaded = false;
@@ -163,6 +176,18 @@ void ESPHelperWebConfig::handleGetInfo() {
   _server->sendContent(String((_preFill ? _fillData->mqttHost : CFG_NOT_SET)));
   _server->sendContent(HTML_INFO_4);
   _server->sendContent(String(millis()));
+  if (_statusSource != NULL) {
+    rttStats rtt = _statusSource->getRTTStats();
+    char line[48];
+    snprintf(line, sizeof(line), "%u.%u / %u.%u / %u.%u",
+             (unsigned int)(rtt.p50 / 1000), (unsigned int)(rtt.p50 % 1000 / 100),
+             (unsigned int)(rtt.p95 / 1000), (unsigned int)(rtt.p95 % 1000 / 100),
+             (unsigned int)(rtt.p99 / 1000), (unsigned int)(rtt.p99 % 1000 / 100));
+    _server->sendContent(HTML_INFO_RTT);
+    _server->sendContent(line);
+    _server->sendContent(HTML_INFO_KEEPALIVE);
+    _server->sendContent(String(rtt.keepAlive));
+  }
   _server->sendContent(HTML_INFO_5);
   _server->sendContent(String(_configPageURI));
   _server->sendContent(HTML_INFO_6);
@@ -215,6 +240,11 @@ void ESPHelperWebConfig::handleGetConfig() {
     _server->sendContent(_resetURI);
     _server->sendContent(HTML_CFG_RESET_END);
   }
+  if (_uploadSet) {
+    _server->sendContent(HTML_CFG_UPLOAD_START);
+    _server->sendContent(_uploadURI);
+    _server->sendContent(HTML_CFG_UPLOAD_END);
+  }
   _server->sendContent(HTML_CLOSE);
 
   // Stop is needed because we sent no content length!
@@ -313,6 +343,28 @@ void ESPHelperWebConfig::setSpiffsReset(const char* URI){
 }
 
 
+// accept firmware images posted to [uri] as multipart/form-data (the config page gets an
+// upload form). The image is written to flash as it arrives, nothing is buffered, and the
+// device only restarts into it once Update has verified it - add ?md5=<hex> to the URI to
+// have the MD5 checked as well.
+// Uploads need HTTP basic auth as WEB_UPDATE_USER with [password], or with the OTA
+// password of the fillConfig() data if none is given - without a password every upload
+// is refused. From a shell:
+//   curl -u admin:<password> -F "firmware=@sketch.ino.bin" http://<device><uri>
+void ESPHelperWebConfig::setFirmwareUpload(const char* uri, const char* password){
+  _uploadURI = uri;
+  _uploadPassword = password;
+  _server->on(_uploadURI, HTTP_POST, [this](){handleUploadDone();}, [this](){handleUpload();});
+  _uploadSet = true;
+}
+
+
+// show live connection figures (MQTT round trip, keepalive) of [helper] on the info page
+// and report firmware uploads through its OTA monitor (see ESPHelper::publishOTAReport)
+void ESPHelperWebConfig::setStatusSource(ESPHelper *helper) {
+  _statusSource = helper;
+}
+
 void ESPHelperWebConfig::handleReset(){
   _server->send(200, "text/html", HTML_SPIFFS_FORMAT);
 
@@ -321,6 +373,110 @@ void ESPHelperWebConfig::handleReset(){
 }
 
 
+// called by the server for every part of the uploaded file as it comes in
+void ESPHelperWebConfig::handleUpload(){
+  HTTPUpload& upload = _server->upload();
+  ESPHelperOTAMonitor* monitor = uploadMonitor();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    _uploadDone = false;
+    _uploadError = 0;
+    // nothing is written before the credentials are checked
+    if (!uploadAuthorized()) {
+      _uploadError = WEB_UPDATE_ERROR_AUTH;
+      return;
+    }
+    if (monitor->isRunning()) {
+      _uploadError = WEB_UPDATE_ERROR_BUSY;
+      return;
+    }
+
+    // the size isn't known until the end - make room for the largest image that fits
+    monitor->start(OTA_SOURCE_WEB, 0);
+    uint32_t space = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+    if (!Update.begin(space)) {
+      failUpload(Update.getError());
+      return;
+    }
+    if (_server->hasArg("md5") && _server->arg("md5").length() == 32)
+      Update.setMD5(_server->arg("md5").c_str());
+    _uploadFlashing = true;
+  }
+  else if (upload.status == UPLOAD_FILE_WRITE && _uploadFlashing) {
+    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
+      failUpload(Update.getError());
+      return;
+    }
+    monitor->progress(upload.totalSize, 0);
+  }
+  else if (upload.status == UPLOAD_FILE_END && _uploadFlashing) {
+    _uploadFlashing = false;
+    monitor->progress(upload.totalSize, upload.totalSize);
+    if (!Update.end(true)) {
+      failUpload(Update.getError());
+      return;
+    }
+    monitor->finish(true);
+    _uploadDone = true;
+  }
+  else if (upload.status == UPLOAD_FILE_ABORTED && _uploadFlashing)
+    failUpload(WEB_UPDATE_ERROR_ABORTED);
+}
+
+// the whole request has been read - answer and restart if the image is good
+void ESPHelperWebConfig::handleUploadDone(){
+  char line[64];
+
+  if (!uploadAuthorized()) {
+    _uploadError = 0;
+    _server->requestAuthentication();
+    return;
+  }
+
+  if (!_uploadDone) {
+    snprintf(line, sizeof(line), "%d", _uploadError != 0 ? _uploadError : WEB_UPDATE_ERROR_NO_FILE);
+    _server->send(500, "text/html", String(HTML_UPDATE_FAILED) + line + HTML_UPDATE_CLOSE);
+    _uploadError = 0;
+    return;
+  }
+
+  const otaReport& report = uploadMonitor()->getReport();
+  snprintf(line, sizeof(line), "%u bytes in %u ms (%u bytes/s)",
+           (unsigned int)report.received, (unsigned int)report.duration, (unsigned int)report.bytesPerSecond);
+  _server->send(200, "text/html", String(HTML_UPDATE_SUCCESS) + line + HTML_UPDATE_CLOSE);
+  _server->client().stop();
+  ESP.restart();
+}
+
+void ESPHelperWebConfig::failUpload(int16_t error){
+  // ending an incomplete update throws it away
+  if (_uploadFlashing) {
+    Update.end();
+    _uploadFlashing = false;
+  }
+  _uploadError = error;
+  uploadMonitor()->finish(false, error);
+}
+
+// true on: the request carries the upload credentials
+// false on: wrong or missing credentials, or no password to check them against
+bool ESPHelperWebConfig::uploadAuthorized(){
+  const char* password = _uploadPassword;
+  if (password == NULL && _preFill)
+    password = _fillData->otaPassword;
+  if (password == NULL || password[0] == '\0')
+    return false;
+  return _server->authenticate(WEB_UPDATE_USER, password);
+}
+
+// the status source's monitor, so the upload ends up in its OTA report
+ESPHelperOTAMonitor* ESPHelperWebConfig::uploadMonitor(){
+  if (_statusSource != NULL)
+    return _statusSource->getOTAMonitor();
+  return &_uploadMonitor;
+}
+
+
 void ESPHelperWebConfig::handleNotFound(){
    // Send HTTP status 404 (Not Found) when there's no handler for the URI in the request
   _server->send(404, "text/html",
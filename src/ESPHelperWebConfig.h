@@ -63,6 +63,13 @@ class ESPHelperWebConfig {
 
     void setSpiffsReset(const char* uri);
 
+    void setFirmwareUpload(const char* uri, const char* password = NULL);
+
+    void setStatusSource(ESPHelper *helper);
+
+    void pause();
+    void resume();
+
 
   private:
     void handleGetInfo();
@@ -70,6 +77,11 @@ class ESPHelperWebConfig {
     void handlePostConfig();
     void handleNotFound();
     void handleReset();
+    void handleUpload();
+    void handleUploadDone();
+    void failUpload(int16_t error);
+    bool uploadAuthorized();
+    ESPHelperOTAMonitor* uploadMonitor();
     void startLargeResponse();
 
     ESP8266WebServer *_server;
@@ -89,11 +101,21 @@ class ESPHelperWebConfig {
     const char* _configPageURI;
     const char* _resetURI;
 
+    ESPHelper* _statusSource = NULL;
+
     netInfo* _fillData;
     bool _preFill = false;
 
     bool _resetSet = false;
 
+    const char* _uploadURI;
+    const char* _uploadPassword = NULL;
+    bool _uploadSet = false;
+    bool _uploadFlashing = false;
+    bool _uploadDone = false;
+    int16_t _uploadError = 0;
+    ESPHelperOTAMonitor _uploadMonitor;
+
     netInfo _config;
     bool _configLoaded = false;
     bool _runningLocal = false;
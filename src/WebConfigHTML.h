@@ -54,6 +54,10 @@ by Suren Khorenyan
 #define HTML_CFG_RESET_START "<hr><br><div class=\"al ad\"><b>WARNING!</b> This will clear the filesystem! All stored files will be removed (including the network configuration file)!</div><form action=\""
 #define HTML_CFG_RESET_END "\" method=\"POST\"><button type=\"submit\" class=\"btn btn-d btn-sm\">Format filesystem</button></form>"
 
+// Firmware upload form
+#define HTML_CFG_UPLOAD_START "<hr><br><div class=\"al ai\">Upload a firmware image (.bin or .bin.gz) - the device restarts into it once it has been written and verified.</div><form action=\""
+#define HTML_CFG_UPLOAD_END "\" method=\"POST\" enctype=\"multipart/form-data\"><div class=\"fg\"><div class=\"cs9\"><input type=\"file\" name=\"firmware\" accept=\".bin,.gz\" required=\"\" class=\"fc\"></div><div class=\"cs3\"><button type=\"submit\" class=\"btn btn-pr\">Upload firmware</button></div></div></form>"
+
 
 // Info lines
 
@@ -69,7 +73,13 @@ by Suren Khorenyan
 // Close MQTT Broker Host, open uptime
 #define HTML_INFO_4 "</code></div></div><div class=\"fg\"><div class=\"cs3\">Uptime (ms):</div><div class=\"cs9\"><code>"
 
-// Close uptime, open configuration page URI
+// Close uptime, open MQTT round trip percentiles
+#define HTML_INFO_RTT "</code></div></div><div class=\"fg\"><div class=\"cs3\">MQTT RTT p50 / p95 / p99 (ms):</div><div class=\"cs9\"><code>"
+
+// Close MQTT round trip, open keepalive
+#define HTML_INFO_KEEPALIVE "</code></div></div><div class=\"fg\"><div class=\"cs3\">MQTT Keepalive (s):</div><div class=\"cs9\"><code>"
+
+// Close uptime (or keepalive), open configuration page URI
 #define HTML_INFO_5 "</code></div></div><br><div><a href=\""
 
 // Close configure page URI
@@ -88,6 +98,9 @@ by Suren Khorenyan
 #define HTML_400_PARAMS_MISSING "<h1>Invalid Request - Did you make sure to specify an SSID and Hostname?</h1>"
 #define HTML_400_MQTT_NO_HOST "<h1>Invalid Request - MQTT info specified without host</h1>"
 #define HTML_CONFIG_SUCCESS "<h1>Config info successfully loaded, restarting!</h1><h2>Power reconnect may be needed</h2>"
+#define HTML_UPDATE_SUCCESS "<h1>Firmware verified, restarting!</h1><h2>"
+#define HTML_UPDATE_FAILED "<h1>Firmware update failed - nothing was installed</h1><h2>Error "
+#define HTML_UPDATE_CLOSE "</h2>"
 #define HTML_SPIFFS_FORMAT "<h1>Formatting SPIFFS and restarting with default values</h1><h2>Power reconnect may be needed</h2>"
 
 
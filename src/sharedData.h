@@ -33,9 +33,158 @@ along with ESPHelper.  If not, see <http://www.gnu.org/licenses/>.
 
 #define DEFAULT_QOS 1;  //at least once - devices are guarantee to get a message.
 
+//Inbound message queue (see ESPHelper::enableInboundQueue)
+//number of messages that can wait for dispatch and the largest topic/payload a slot can hold
+#define INBOUND_QUEUE_SLOTS 8
+#define INBOUND_TOPIC_SIZE 64
+#define INBOUND_PAYLOAD_SIZE 128
+
+//default time (in microseconds) that loop() may spend running queued handlers
+#define INBOUND_DISPATCH_BUDGET 5000
+
+//Streaming of large inbound payloads (see ESPHelper::setMQTTStreamCallback)
+//largest piece of a payload handed to the stream callback at once
+#define STREAM_CHUNK_SIZE 256
+
+//Last-value cache for subscriptions (see ESPHelper::addCachedSubscription)
+//bytes shared by all cached values and how long (ms) a reconnect waits for retained values
+#define VALUE_CACHE_SIZE 512
+#define VALUE_CACHE_PRIME_TIMEOUT 250
+
+//Per-topic traffic accounting (see ESPHelper::enableTopicStats)
+//number of topics tracked before new ones are only counted as untracked
+#define TOPIC_STATS_SIZE 16
+
+//Built-in MQTT client (see ESPHelperMQTT)
+//default size of the buffer inbound packets are parsed in, the buffer small outbound
+//packets are collected in before they are sent and how long (ms) to wait for a CONNACK
+#define MQTT_ARENA_SIZE 1024
+#define MQTT_TX_BUFFER_SIZE 128
+#define MQTT_CONNECT_TIMEOUT 5000
+
+//MQTT 5 topic aliases kept per direction (topics longer than INBOUND_TOPIC_SIZE never get one)
+#define MQTT5_TOPIC_ALIASES 8
+
+//MQTT-SN (UDP) fast path - gateway port, predefined topic names that can be mapped to ids,
+//keepalive (seconds) and how long to wait before retrying a CONNECT (ms)
+#define MQTTSN_PORT 10000
+#define MQTTSN_TOPICS 8
+#define MQTTSN_KEEPALIVE 60
+#define MQTTSN_RETRY 5000
+
+//Broker round trip time (see ESPHelper::enableRTTProbe)
+//samples kept for the percentiles, default probe interval (ms), keepalive is kept at
+//least RTT_KEEPALIVE_FACTOR x p99 and grows after RTT_STABLE_PERIODS quiet keepalive periods
+#define RTT_WINDOW 32
+#define RTT_PROBE_INTERVAL 10000
+#define RTT_KEEPALIVE_FACTOR 4
+#define RTT_STABLE_PERIODS 10
+
+//Local rule engine (see ESPHelperRules)
+//max rules, bytes for all their strings, largest rules file and GPIO debounce (ms)
+#define MAX_RULES 16
+#define RULES_ARENA_SIZE 512
+#define RULES_FILE_SIZE 2048
+#define RULES_DEBOUNCE 30
+
+//Embedded broker for broadcast mode (see ESPHelperBroker)
+//clients served at once, largest packet a client may send, subscriptions per client
+//and bytes for all retained messages
+#define BROKER_CLIENTS 4
+#define BROKER_PACKET_SIZE 512
+#define BROKER_SUBSCRIPTIONS 8
+#define BROKER_RETAINED_SIZE 1024
+
+//Events queued from interrupt handlers (see ESPHelper::enableEvents)
+//slots in the ring, topics that can be registered and data bytes per event
+#define EVENT_QUEUE_SLOTS 16
+#define EVENT_TOPICS 8
+#define EVENT_DATA_SIZE 8
+
+//GPIO watcher (see ESPHelper::watchPin) - pins watched at once, ms between samples,
+//default debounce (ms) and edges that can wait for loop()
+#define WATCH_PINS 8
+#define WATCH_SAMPLE_INTERVAL 2
+#define WATCH_DEBOUNCE 20
+#define WATCH_EDGE_SLOTS 16
+
+//watchPin() flags
+#define WATCH_PULLUP 0x01     //enable the internal pull-up
+#define WATCH_COALESCE 0x02   //only publish the latest state when several edges wait for loop()
+#define WATCH_RETAIN 0x04     //publish retained
+
+//Sensor scheduler (see ESPHelper::addSensor) - sensors at once and how long (ms)
+//a conversion may take before it counts as an error
+#define MAX_SENSORS 8
+#define SENSOR_TIMEOUT 2000
+
+//Windowed aggregation (see ESPHelper::addSeries) - series at once and the most
+//decimal places a series can keep
+#define MAX_SERIES 8
+#define SERIES_MAX_DECIMALS 6
+
+//most decimal places the fixed point helpers in ESPHelperText handle
+#define TEXT_MAX_DECIMALS 6
+
+//Topic templates (see ESPHelper::addTopic) - templates at once, the arena the expanded
+//topics (and the device prefix) are kept in and the placeholder replaced by the prefix
+#define MAX_TOPICS 16
+#define TOPIC_ARENA_SIZE 512
+#define TOPIC_DEVICE "{device}"
+
+//Device shadow (see ESPHelper::enableShadow) - fields at once, room for the values of
+//string fields and the largest document published or applied in one go
+#define SHADOW_FIELDS 16
+#define SHADOW_STRING_SIZE 128
+#define SHADOW_DOCUMENT_SIZE 256
+
+//where the reported version is kept in RTC user memory (in 4 byte blocks, 3 of them)
+//so it keeps counting up across resets
+#define SHADOW_RTC_OFFSET 92
+
+//OTA instrumentation (see ESPHelper::publishOTAReport) - a gap between progress updates
+//this long (ms) counts as a stall, and where the report is kept in RTC user memory
+//(in 4 byte blocks) so it survives the reboot after an update
+#define OTA_STALL_TIME 1000
+#define OTA_RTC_OFFSET 96
+
+//HTTP pull updates (see ESPHelper::startHTTPUpdate) - longest URL, bytes read from the
+//socket at a time, how long (ms) the download may go without data before it is resumed,
+//how often in a row it is resumed and how long (ms, times the attempt) to wait before that
+#define HTTP_UPDATE_URL_SIZE 160
+#define HTTP_UPDATE_BUFFER_SIZE 512
+#define HTTP_UPDATE_TIMEOUT 10000
+#define HTTP_UPDATE_RETRIES 5
+#define HTTP_UPDATE_RETRY_DELAY 2000
+
+//Firmware over MQTT (see ESPHelper::enableMQTTUpdate) - chunks written between acks, how
+//long (ms) to wait for the next chunk before asking for it again and how often in a row
+#define MQTT_UPDATE_ACK_EVERY 8
+#define MQTT_UPDATE_TIMEOUT 3000
+#define MQTT_UPDATE_RETRIES 10
+
+//CBOR payloads up to this size are built on the stack and published normally,
+//bigger ones are streamed (see ESPHelper::publishCBOR), and how deep skip() may nest
+#define CBOR_STACK_SIZE 128
+#define CBOR_MAX_DEPTH 8
+
+//topic, offset of this chunk, chunk, chunk length, total payload length
+#define MQTT_STREAM_CALLBACK_SIGNATURE std::function<void(char*, unsigned int, uint8_t*, unsigned int, unsigned int)> callback
+
 
 enum connStatus {NO_CONNECTION, BROADCAST, WIFI_ONLY, FULL_CONNECTION};
 
+//what to do with a new inbound message when the queue is full
+enum overflowPolicy {DROP_NEWEST, DROP_OLDEST};
+
+//type of the next item in an ESPHelperCBORReader
+enum cborType {CBOR_UINT, CBOR_NEGINT, CBOR_BYTES, CBOR_TEXT, CBOR_ARRAY, CBOR_MAP, CBOR_TAG,
+               CBOR_BOOL, CBOR_NULL, CBOR_FLOAT, CBOR_END, CBOR_INVALID};
+
+enum ruleSource {RULE_TOPIC, RULE_GPIO};
+enum ruleCondition {RULE_ANY, RULE_EQ, RULE_NE, RULE_GT, RULE_LT, RULE_HIGH, RULE_LOW, RULE_CHANGE};
+enum ruleAction {RULE_PUBLISH, RULE_SET, RULE_TOGGLE};
+
 struct netInfo {
   const char* name;
   const char* mqttHost;
@@ -218,8 +367,243 @@ struct netInfo {
 struct subscription{
   bool isUsed = false;
   const char* topic;
+
+  //last-value cache (only used when cached is set)
+  bool cached = false;
+  uint16_t cacheOffset = 0;    //start of this value in the cache arena
+  uint16_t cacheCapacity = 0;  //bytes reserved in the arena
+  uint16_t cacheLength = 0;    //length of the current value
+  uint32_t cacheSeq = 0;       //bumped on every new value (0 = nothing received yet)
 };
 typedef struct subscription subscription;
 
 
+struct inboundMessage{
+  char topic[INBOUND_TOPIC_SIZE];
+  uint8_t payload[INBOUND_PAYLOAD_SIZE + 1];  //+1 so the payload can always be null terminated
+  unsigned int length;
+};
+typedef struct inboundMessage inboundMessage;
+
+
+struct isrEvent{
+  uint32_t timestamp;             //micros() when the event was queued
+  uint8_t topicId;
+  uint8_t length;
+  uint8_t data[EVENT_DATA_SIZE];
+};
+typedef struct isrEvent isrEvent;
+
+
+struct eventStats{
+  uint32_t queued = 0;            //events accepted by queueEvent()
+  uint32_t published = 0;         //events published from loop()
+  uint32_t failed = 0;            //publishes that failed (the event stays queued and is tried again)
+  uint32_t overflows = 0;         //events lost because the ring was full
+  uint32_t lastLatency = 0;       //micros from queueEvent() to publish for the last event
+  uint32_t maxLatency = 0;        //longest of those
+};
+typedef struct eventStats eventStats;
+
+
+struct gpioWatch{
+  uint8_t pin;
+  uint8_t flags;
+  uint16_t debounce;
+  const char* topic;
+  const char* highPayload;
+  const char* lowPayload;
+
+  //sampler state
+  uint8_t raw;
+  uint8_t state;
+  unsigned long rawSince;
+  volatile bool pending;          //coalesced change waiting for loop()
+  uint32_t changedAt;             //micros() of the latest change
+
+  uint32_t rises;                 //debounced low -> high edges
+  uint32_t falls;                 //debounced high -> low edges
+  uint32_t published;
+  uint32_t coalesced;             //edges merged into a later publish
+  uint32_t dropped;               //edges lost because the edge ring was full
+};
+typedef struct gpioWatch gpioWatch;
+
+
+struct gpioEdge{
+  uint32_t timestamp;             //micros() when the edge was accepted
+  uint8_t index;
+  uint8_t level;
+};
+typedef struct gpioEdge gpioEdge;
+
+
+struct seriesWindow{
+  int32_t min = 0;                //all values are fixed point (value * 10^decimals)
+  int32_t max = 0;
+  int32_t mean = 0;
+  int32_t last = 0;
+  uint32_t count = 0;             //samples in the window (0 = no window closed yet)
+};
+typedef struct seriesWindow seriesWindow;
+
+
+struct aggregateSeries{
+  const char* topic;
+  uint32_t window;
+  uint8_t decimals;
+  unsigned long windowStart;
+
+  //running window
+  int32_t min;
+  int32_t max;
+  int32_t last;
+  int64_t sum;
+  uint32_t count;
+
+  seriesWindow closed;            //the last window that closed
+  uint32_t windows;               //windows closed so far
+};
+typedef struct aggregateSeries aggregateSeries;
+
+
+enum shadowType {SHADOW_BOOL, SHADOW_INT, SHADOW_FLOAT, SHADOW_STRING};
+
+struct shadowField{
+  const char* name;
+  uint8_t type;
+  uint8_t decimals;               //float fields are kept in fixed point (value * 10^decimals)
+  bool dirty;                     //changed since it was last reported
+  int32_t value;                  //bool, int or fixed point value
+  uint16_t offset;                //string fields - value in the string arena
+  uint16_t capacity;
+};
+typedef struct shadowField shadowField;
+
+
+struct shadowStats{
+  uint32_t version = 0;           //version of the last reported document
+  uint32_t desiredVersion = 0;    //version of the last desired document applied
+  uint32_t reports = 0;           //documents published
+  uint32_t applied = 0;           //desired documents applied
+  uint32_t stale = 0;             //desired documents dropped for an old version
+  uint32_t rejected = 0;          //desired documents that were not a JSON object
+};
+typedef struct shadowStats shadowStats;
+
+
+enum otaResult {OTA_RESULT_NONE, OTA_RESULT_RUNNING, OTA_RESULT_SUCCESS, OTA_RESULT_FAILED};
+enum otaSource {OTA_SOURCE_ARDUINO, OTA_SOURCE_HTTP, OTA_SOURCE_MQTT, OTA_SOURCE_WEB};
+enum otaEvent {OTA_EVENT_START, OTA_EVENT_PROGRESS, OTA_EVENT_END, OTA_EVENT_ERROR};
+
+struct otaReport{
+  uint8_t result = OTA_RESULT_NONE;
+  uint8_t source = OTA_SOURCE_ARDUINO;
+  int16_t error = 0;              //error code of the updater that failed (ota_error_t for ArduinoOTA)
+  uint32_t size = 0;              //image size (0 if not known)
+  uint32_t received = 0;          //bytes written so far
+  uint32_t duration = 0;          //ms from start to the end or the error
+  uint32_t bytesPerSecond = 0;
+  uint32_t stalls = 0;            //gaps of OTA_STALL_TIME or more between progress updates
+  uint32_t longestStall = 0;      //ms
+  uint32_t freeHeap = 0;          //free heap when the update started
+  uint32_t retransmissions = 0;   //chunks that arrived more than once (MQTT updates)
+};
+typedef struct otaReport otaReport;
+
+enum httpUpdateState {HTTP_UPDATE_IDLE, HTTP_UPDATE_WAITING, HTTP_UPDATE_HEADERS,
+                      HTTP_UPDATE_BODY, HTTP_UPDATE_DONE, HTTP_UPDATE_FAILED};
+
+//errors of a failed HTTP update that are not an HTTP status or an Updater error
+#define HTTP_UPDATE_ERROR_CONNECT -1     //no connection / no data after every retry
+#define HTTP_UPDATE_ERROR_RESPONSE -2    //response without a usable length or range
+#define HTTP_UPDATE_ERROR_URL -3         //not an http:// URL
+#define HTTP_UPDATE_ERROR_ABORTED -4     //stopped with abort()
+
+enum mqttUpdateState {MQTT_UPDATE_IDLE, MQTT_UPDATE_RECEIVING, MQTT_UPDATE_DONE, MQTT_UPDATE_FAILED};
+
+//errors of a failed MQTT update that are not an Updater error
+#define MQTT_UPDATE_ERROR_BEGIN -1       //start message without a usable size / chunk size
+#define MQTT_UPDATE_ERROR_TIMEOUT -2     //chunks stopped coming after every request
+#define MQTT_UPDATE_ERROR_ABORTED -3     //aborted or replaced by a new start message
+#define MQTT_UPDATE_ERROR_BUSY -4        //another update is already running
+
+//errors of a failed firmware upload (ESPHelperWebConfig) that are not an Updater error
+#define WEB_UPDATE_ERROR_BUSY -1         //another update is already running
+#define WEB_UPDATE_ERROR_ABORTED -2      //the upload was cut off
+#define WEB_UPDATE_ERROR_NO_FILE -3      //request without a file
+#define WEB_UPDATE_ERROR_AUTH -4         //wrong or missing credentials
+
+//user name firmware uploads to ESPHelperWebConfig authenticate as (HTTP basic auth)
+#define WEB_UPDATE_USER "admin"
+
+
+struct inboundStats{
+  uint32_t queued = 0;            //messages copied into the queue
+  uint32_t dispatched = 0;        //messages handed to the callback
+  uint32_t dropped = 0;           //messages lost to a full queue or an oversized topic/payload
+  uint32_t handlerMicros = 0;     //total time spent inside the callback
+  uint32_t maxHandlerMicros = 0;  //longest single callback run
+  uint8_t highWater = 0;          //most messages that were waiting at once
+};
+typedef struct inboundStats inboundStats;
+
+
+struct topicStats{
+  char topic[INBOUND_TOPIC_SIZE];
+  uint32_t messagesIn = 0;
+  uint32_t bytesIn = 0;
+  uint32_t messagesOut = 0;
+  uint32_t bytesOut = 0;
+  uint32_t lastSeen = 0;          //millis() of the last message either way
+  uint32_t handlerMicros = 0;     //total time spent in the callback for this topic
+  uint32_t maxHandlerMicros = 0;  //longest single callback run for this topic
+};
+typedef struct topicStats topicStats;
+
+
+//all times in microseconds
+struct rttStats{
+  uint32_t samples = 0;      //round trips measured since start
+  uint32_t timeouts = 0;     //probes that never came back
+  uint32_t last = 0;
+  uint32_t p50 = 0;          //percentiles over the last RTT_WINDOW samples
+  uint32_t p95 = 0;
+  uint32_t p99 = 0;
+  uint16_t keepAlive = 0;    //keepalive (seconds) used for the next connection
+};
+typedef struct rttStats rttStats;
+
+
+//compiled rule - strings are offsets into the rule engine's arena
+struct localRule{
+  uint8_t source = RULE_TOPIC;
+  uint8_t condition = RULE_ANY;
+  uint8_t action = RULE_PUBLISH;
+  uint8_t pin = 0;              //input pin (gpio rules)
+  uint8_t outPin = 0;           //output pin (set / toggle)
+  uint8_t level = 0;            //level to set
+  uint8_t inputLevel = 0;       //debounced input level (gpio rules)
+  uint16_t topic = 0;           //topic filter (topic rules)
+  uint16_t value = 0;           //value compared against
+  uint16_t publishTopic = 0;
+  uint16_t payload = 0;
+  float number = 0;             //value as a number (gt / lt)
+  uint32_t changedAt = 0;       //millis() the raw input last changed
+  uint32_t hits = 0;            //times the rule fired
+};
+typedef struct localRule localRule;
+
+
+struct brokerStats{
+  uint8_t clients = 0;          //clients connected right now
+  uint32_t messagesIn = 0;      //PUBLISH packets received from clients
+  uint32_t messagesOut = 0;     //PUBLISH packets delivered to clients
+  uint32_t dropped = 0;         //oversized packets and retained messages that didn't fit
+  uint32_t refused = 0;         //connections turned away (no free slot / bad CONNECT)
+  uint16_t retainedUsed = 0;    //bytes of the retained arena in use
+};
+typedef struct brokerStats brokerStats;
+
+
 #endif
\ No newline at end of file